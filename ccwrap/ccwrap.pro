@@ -0,0 +1,21 @@
+DESTDIR = ../build
+
+QT += core
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = ccwrap
+TEMPLATE = app
+INSTALLS += target
+
+SOURCES += \
+    main.cpp
+
+unix {
+    isEmpty(PREFIX) {
+        PREFIX = /usr
+    }
+    target.path = $$PREFIX/bin
+}
@@ -0,0 +1,342 @@
+/*
+ * This file is part of ccwrap, utility of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <QtCore>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+
+// Launcher used as make CC/CXX prefix: ccwrap <compiler> <args...>
+// With EIDE_PROFILE_LOG set every invocation appends one JSON line to that file
+// With EIDE_CCACHE_DIR set object files are looked up in a content addressed cache,
+// EIDE_CCACHE_LOG receives one hit/miss/skip line per invocation. Size is bounded by the IDE
+
+struct RunResult {
+    int exitCode{ 127 };
+    qint64 userUs{ 0 };
+    qint64 sysUs{ 0 };
+    qint64 maxRssKb{ 0 };
+};
+
+struct CacheJob {
+    QString source;
+    QString output;
+    QString depFile;
+    QStringList preprocessArgs;
+    QString key;
+};
+
+static qint64 nowUs()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static bool isSourceFile(const QString& arg)
+{
+    static const QStringList SUFFIXES{ "c", "cc", "cp", "cpp", "cxx", "c++", "C", "s", "S", "sx", "m", "mm" };
+    return SUFFIXES.contains(QFileInfo(arg).suffix());
+}
+
+static QString outputOf(const QStringList& args)
+{
+    for(int i = 0; i < args.size(); i++) {
+        if (args.at(i) == "-o" && i + 1 < args.size())
+            return args.at(i + 1);
+        if (args.at(i).startsWith("-o") && args.at(i).size() > 2)
+            return args.at(i).mid(2);
+    }
+    return QString();
+}
+
+static QStringList sourcesOf(const QStringList& args)
+{
+    QStringList sources;
+    for(int i = 0; i < args.size(); i++) {
+        const auto& a = args.at(i);
+        if (a == "-o" || a == "-MF" || a == "-MT" || a == "-MQ" || a == "-include" || a == "-x") {
+            i++;
+            continue;
+        }
+        if (!a.startsWith('-') && isSourceFile(a))
+            sources.append(a);
+    }
+    return sources;
+}
+
+static RunResult run(char **argv, int stderrFd = -1)
+{
+    RunResult r;
+#ifdef Q_OS_UNIX
+    auto pid = ::fork();
+    if (pid < 0) {
+        ::perror("ccwrap: fork");
+        return r;
+    }
+    if (pid == 0) {
+        if (stderrFd >= 0)
+            ::dup2(stderrFd, STDERR_FILENO);
+        ::execvp(argv[0], argv);
+        ::perror(argv[0]);
+        ::_exit(127);
+    }
+    // Ctrl-C reaches the compiler through the process group, outlive it to report
+    ::signal(SIGINT, SIG_IGN);
+    int status = 0;
+    struct rusage ru{};
+    pid_t w;
+    do {
+        w = ::wait4(pid, &status, 0, &ru);
+    } while (w < 0 && errno == EINTR);
+    if (w == pid) {
+        r.exitCode = WIFEXITED(status)? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        r.userUs = qint64(ru.ru_utime.tv_sec) * 1000000 + ru.ru_utime.tv_usec;
+        r.sysUs = qint64(ru.ru_stime.tv_sec) * 1000000 + ru.ru_stime.tv_usec;
+        r.maxRssKb = ru.ru_maxrss;
+    }
+#else
+    Q_UNUSED(stderrFd)
+    QStringList args;
+    for(int i = 1; argv[i]; i++)
+        args.append(QString::fromLocal8Bit(argv[i]));
+    QProcess p;
+    p.setProcessChannelMode(QProcess::ForwardedChannels);
+    p.start(QString::fromLocal8Bit(argv[0]), args);
+    if (p.waitForFinished(-1))
+        r.exitCode = p.exitStatus() == QProcess::NormalExit? p.exitCode() : 128;
+#endif
+    return r;
+}
+
+static void appendLine(const QString& logPath, const QByteArray& line)
+{
+#ifdef Q_OS_UNIX
+    // A single O_APPEND write keeps lines from parallel compiles whole
+    auto fd = ::open(QFile::encodeName(logPath).constData(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        if (::write(fd, line.constData(), size_t(line.size())) < 0)
+            ::perror("ccwrap: log");
+        ::close(fd);
+    }
+#else
+    QFile f(logPath);
+    if (f.open(QFile::WriteOnly | QFile::Append))
+        f.write(line);
+#endif
+}
+
+// Plain -c compiles of one source into one object are the only thing worth caching
+static bool prepareCacheJob(const QStringList& args, CacheJob *job)
+{
+    if (!args.contains("-c") || args.contains("-E") || args.contains("-S") ||
+            args.contains("-M") || args.contains("-MM"))
+        return false;
+    auto sources = sourcesOf(args);
+    job->output = outputOf(args);
+    if (sources.size() != 1 || job->output.isEmpty())
+        return false;
+    job->source = sources.first();
+    auto wantDeps = false;
+    for(int i = 0; i < args.size(); i++) {
+        const auto& a = args.at(i);
+        if (a == "-c" || a == "-MP") {
+            continue;
+        } else if (a == "-MD" || a == "-MMD") {
+            wantDeps = true;
+        } else if (a == "-o" || a == "-MT" || a == "-MQ") {
+            i++;
+        } else if (a == "-MF") {
+            if (i + 1 < args.size())
+                job->depFile = args.at(i + 1);
+            i++;
+        } else if (a.startsWith("-MF")) {
+            job->depFile = a.mid(3);
+        } else if (!(a.startsWith("-o") || a.startsWith("-MT") || a.startsWith("-MQ"))) {
+            job->preprocessArgs.append(a);
+        }
+    }
+    if (!wantDeps)
+        job->depFile.clear();
+    else if (job->depFile.isEmpty())
+        job->depFile = QFileInfo(job->output).path() + '/' + QFileInfo(job->output).completeBaseName() + ".d";
+    job->preprocessArgs.append("-E");
+    return true;
+}
+
+static QByteArray compilerFingerprint(const QString& compiler)
+{
+    auto path = QStandardPaths::findExecutable(compiler);
+    if (path.isEmpty())
+        path = compiler;
+    QFileInfo info(path);
+    return QString("%1\n%2\n%3").arg(info.canonicalFilePath()).arg(info.size())
+            .arg(info.lastModified().toMSecsSinceEpoch()).toUtf8();
+}
+
+static bool computeKey(const QString& compiler, const QStringList& args, CacheJob *job)
+{
+    QProcess cpp;
+    cpp.setProcessChannelMode(QProcess::SeparateChannels);
+    cpp.setStandardErrorFile(QProcess::nullDevice());
+    cpp.start(compiler, job->preprocessArgs);
+    if (!cpp.waitForFinished(-1) || cpp.exitStatus() != QProcess::NormalExit || cpp.exitCode() != 0)
+        return false; // The real compile reports the error
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(compilerFingerprint(compiler));
+    hash.addData(args.join(QChar(0)).toUtf8());
+    // Debug info records the compile directory and replayed diagnostics use paths relative to it
+    hash.addData(QDir::currentPath().toUtf8().append('\0'));
+    hash.addData(cpp.readAllStandardOutput());
+    job->key = hash.result().toHex();
+    return true;
+}
+
+static QString entryPath(const QString& cacheDir, const QString& key, const QString& suffix)
+{
+    return QString("%1/%2/%3%4").arg(cacheDir, key.left(2), key, suffix);
+}
+
+static bool copyReplacing(const QString& from, const QString& to)
+{
+    // Copy then rename so a concurrent reader never sees half a file
+    auto tmp = QString("%1.%2.tmp").arg(to).arg(QCoreApplication::applicationPid());
+    QFile::remove(tmp);
+    if (!QFile::copy(from, tmp))
+        return false;
+    QFile::remove(to);
+    return QFile::rename(tmp, to);
+}
+
+static void touch(const QString& path)
+{
+    QFile f(path);
+    if (f.open(QFile::ReadWrite))
+        f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+}
+
+static bool restoreFromCache(const QString& cacheDir, const CacheJob& job)
+{
+    auto object = entryPath(cacheDir, job.key, ".o");
+    auto deps = entryPath(cacheDir, job.key, ".d");
+    if (!QFile::exists(object) || (!job.depFile.isEmpty() && !QFile::exists(deps)))
+        return false;
+    if (!copyReplacing(object, job.output))
+        return false;
+    if (!job.depFile.isEmpty() && !copyReplacing(deps, job.depFile))
+        return false;
+    QFile err(entryPath(cacheDir, job.key, ".stderr"));
+    if (err.open(QFile::ReadOnly)) {
+        auto text = err.readAll();
+        std::fwrite(text.constData(), 1, size_t(text.size()), stderr);
+    }
+    // Modification time is the LRU clock the IDE trims by
+    touch(object);
+    return true;
+}
+
+static void storeInCache(const QString& cacheDir, const CacheJob& job, const QByteArray& errorText)
+{
+    QDir().mkpath(QFileInfo(entryPath(cacheDir, job.key, ".o")).path());
+    if (!job.depFile.isEmpty())
+        copyReplacing(job.depFile, entryPath(cacheDir, job.key, ".d"));
+    if (!errorText.isEmpty()) {
+        QFile f(entryPath(cacheDir, job.key, ".stderr"));
+        if (f.open(QFile::WriteOnly | QFile::Truncate))
+            f.write(errorText);
+    }
+    // The object goes last, its presence marks a complete entry
+    copyReplacing(job.output, entryPath(cacheDir, job.key, ".o"));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <compiler> [args...]\n", argv[0]);
+        return 127;
+    }
+    auto compilerArgv = argv + 1;
+    QCoreApplication app(argc, argv);
+
+    auto compiler = QString::fromLocal8Bit(compilerArgv[0]);
+    QStringList args;
+    for(int i = 1; compilerArgv[i]; i++)
+        args.append(QString::fromLocal8Bit(compilerArgv[i]));
+
+    auto start = nowUs();
+    RunResult result;
+    auto cacheDir = QString::fromLocal8Bit(qgetenv("EIDE_CCACHE_DIR"));
+    auto cacheLog = QString::fromLocal8Bit(qgetenv("EIDE_CCACHE_LOG"));
+    CacheJob job;
+    if (!cacheDir.isEmpty() && prepareCacheJob(args, &job) && computeKey(compiler, args, &job)) {
+        if (restoreFromCache(cacheDir, job)) {
+            result.exitCode = 0;
+            if (!cacheLog.isEmpty())
+                appendLine(cacheLog, "hit\n");
+        } else {
+            QTemporaryFile errorFile;
+            QByteArray errorText;
+            if (errorFile.open()) {
+                result = run(compilerArgv, errorFile.handle());
+                errorFile.seek(0);
+                errorText = errorFile.readAll();
+                std::fwrite(errorText.constData(), 1, size_t(errorText.size()), stderr);
+            } else {
+                result = run(compilerArgv);
+            }
+            if (result.exitCode == 0)
+                storeInCache(cacheDir, job, errorText);
+            if (!cacheLog.isEmpty())
+                appendLine(cacheLog, "miss\n");
+        }
+    } else {
+        result = run(compilerArgv);
+        if (!cacheDir.isEmpty() && !cacheLog.isEmpty())
+            appendLine(cacheLog, "skip\n");
+    }
+    auto end = nowUs();
+
+    auto logPath = QString::fromLocal8Bit(qgetenv("EIDE_PROFILE_LOG"));
+    if (!logPath.isEmpty()) {
+        auto isCompile = args.contains("-c") || args.contains("-S") || args.contains("-E");
+        auto sources = sourcesOf(args);
+        auto output = outputOf(args);
+        auto record = QJsonObject{
+            { "file", isCompile && !sources.isEmpty()? sources.first() : output },
+            { "output", output },
+            { "kind", isCompile? "compile" : "link" },
+            { "cwd", QDir::currentPath() },
+            { "start", start },
+            { "end", end },
+            { "user", result.userUs },
+            { "sys", result.sysUs },
+            { "rss", result.maxRssKb },
+            { "exit", result.exitCode },
+        };
+        appendLine(logPath, QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    }
+    return result.exitCode;
+}
@@ -149,7 +149,9 @@ static bool completeToLeft(QJsonObject& left, const QJsonObject& right)
 AppConfig::AppConfig() : QObject(QApplication::instance()), priv(new Priv_t)
 {
     priv->sysenv = QProcessEnvironment::systemEnvironment();
-    addResourcesFont();
+    // Command line modes run without a GUI application, fonts need one
+    if (qobject_cast<QGuiApplication*>(QCoreApplication::instance()))
+        addResourcesFont();
 
 //    connect(this, &AppConfig::configChanged, [this]() {
 //        if (useDarkStyle()) {
@@ -478,6 +480,32 @@ bool AppConfig::numberOfJobsOptimal() const
     return CFG_LOCAL.value("numberOfJobsOptimal").toBool(false);
 }
 
+bool AppConfig::buildProfiling() const
+{
+    return CFG_LOCAL.value("buildProfiling").toBool(false);
+}
+
+bool AppConfig::buildCache() const
+{
+    return CFG_LOCAL.value("buildCache").toBool(false);
+}
+
+int AppConfig::buildCacheSize() const
+{
+    constexpr auto DEFAULT_CACHE_MB = 2048;
+    return CFG_LOCAL.value("buildCacheSize").toInt(DEFAULT_CACHE_MB);
+}
+
+bool AppConfig::staticAnalysis() const
+{
+    return CFG_LOCAL.value("staticAnalysis").toBool(false);
+}
+
+int AppConfig::staticAnalysisJobs() const
+{
+    return CFG_LOCAL.value("staticAnalysisJobs").toInt(1);
+}
+
 QByteArray AppConfig::fileHash(const QString &filename)
 {
     auto path = QDir(workspacePath()).filePath("hashes.json");
@@ -719,6 +747,31 @@ void AppConfig::setNumberOfJobsOptimal(bool en)
     CFG_LOCAL.insert("numberOfJobsOptimal", en);
 }
 
+void AppConfig::setBuildProfiling(bool en)
+{
+    CFG_LOCAL.insert("buildProfiling", en);
+}
+
+void AppConfig::setBuildCache(bool en)
+{
+    CFG_LOCAL.insert("buildCache", en);
+}
+
+void AppConfig::setBuildCacheSize(int megabytes)
+{
+    CFG_LOCAL.insert("buildCacheSize", megabytes);
+}
+
+void AppConfig::setStaticAnalysis(bool en)
+{
+    CFG_LOCAL.insert("staticAnalysis", en);
+}
+
+void AppConfig::setStaticAnalysisJobs(int n)
+{
+    CFG_LOCAL.insert("staticAnalysisJobs", n);
+}
+
 void AppConfig::addHash(const QString &filename, const QByteArray &hash)
 {
     auto path = QDir(workspacePath()).filePath("hashes.json");
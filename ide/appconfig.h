@@ -91,6 +91,11 @@ public:
 
     int numberOfJobs() const;
     bool numberOfJobsOptimal() const;
+    bool buildProfiling() const;
+    bool buildCache() const;
+    int buildCacheSize() const;
+    bool staticAnalysis() const;
+    int staticAnalysisJobs() const;
 
     QByteArray fileHash(const QString& filename);
 
@@ -137,6 +142,11 @@ public slots:
 
     void setNumberOfJobs(int n);
     void setNumberOfJobsOptimal(bool en);
+    void setBuildProfiling(bool en);
+    void setBuildCache(bool en);
+    void setBuildCacheSize(int megabytes);
+    void setStaticAnalysis(bool en);
+    void setStaticAnalysisJobs(int n);
 
     void addHash(const QString& filename, const QByteArray& hash);
     void purgeHash();
@@ -0,0 +1,311 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildconfigurations.h"
+#include "projectmanager.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <csignal>
+#endif
+
+#include <QtDebug>
+
+// Lives next to the Makefile so the board list can be shared with the sources
+static constexpr auto CONFIGURATIONS_FILE = ".embedded_ide-configs.json";
+static constexpr auto DEFAULT_OUTPUT_VARIABLE = "BUILD_DIR";
+static constexpr auto DEFAULT_OUTPUT_DIR = "build";
+static constexpr auto SHM_PATH = "/dev/shm";
+static constexpr auto PATH_HASH_CHARS = 8;
+static constexpr auto RAM_ROOT_PREFIX = "embedded-ide-";
+// Names the IDE instance using a RAM root, the startup sweep leaves trees of live instances alone
+static constexpr auto OWNER_FILE = ".owner-pid";
+
+static const QStringList ARTIFACT_PATTERNS{ "*.elf", "*.bin", "*.hex", "*.map" };
+
+class BuildConfigurations::Priv_t
+{
+public:
+    ProjectManager *proj{ nullptr };
+    QList<Configuration> list;
+    QString outputVariable{ DEFAULT_OUTPUT_VARIABLE };
+    bool plainRamDisk{ false };
+    QString ramRoot;
+    // Roots of closed projects, makes and copies may still be using them
+    QStringList retiredRamRoots;
+
+    QString filePath() const {
+        return QDir(proj->projectPath()).absoluteFilePath(CONFIGURATIONS_FILE);
+    }
+
+    void load() {
+        list.clear();
+        outputVariable = DEFAULT_OUTPUT_VARIABLE;
+        plainRamDisk = false;
+        QFile f(filePath());
+        if (!f.open(QFile::ReadOnly))
+            return;
+        auto root = QJsonDocument::fromJson(f.readAll()).object();
+        outputVariable = root.value("outputVariable").toString(DEFAULT_OUTPUT_VARIABLE);
+        plainRamDisk = root.value("plainRamDisk").toBool();
+        for(const auto& v: root.value("configurations").toArray()) {
+            auto o = v.toObject();
+            Configuration c;
+            c.name = o.value("name").toString();
+            c.outputDir = o.value("outputDir").toString();
+            c.selected = o.value("selected").toBool();
+            c.ramDisk = o.value("ramDisk").toBool();
+            const auto vars = o.value("variables").toObject();
+            for(auto it = vars.begin(); it != vars.end(); ++it)
+                c.variables.insert(it.key(), it.value().toString());
+            if (!c.name.isEmpty())
+                list.append(c);
+        }
+    }
+
+    void save() const {
+        QJsonArray array;
+        for(const auto& c: list) {
+            QJsonObject vars;
+            for(auto it = c.variables.begin(); it != c.variables.end(); ++it)
+                vars.insert(it.key(), it.value());
+            array.append(QJsonObject{
+                { "name", c.name },
+                { "outputDir", c.outputDir },
+                { "selected", c.selected },
+                { "ramDisk", c.ramDisk },
+                { "variables", vars }
+            });
+        }
+        QFile f(filePath());
+        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+            qDebug() << "can not write" << f.fileName() << f.errorString();
+            return;
+        }
+        f.write(QJsonDocument(QJsonObject{
+            { "outputVariable", outputVariable },
+            { "plainRamDisk", plainRamDisk },
+            { "configurations", array }
+        }).toJson());
+    }
+
+    static QStringList ramBases() {
+        QStringList list;
+        if (QFileInfo(SHM_PATH).isWritable())
+            list.append(SHM_PATH);
+        auto runtime = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        if (!runtime.isEmpty())
+            list.append(runtime);
+        return list;
+    }
+
+    static bool ownerAlive(const QString& root) {
+        QFile f(QDir(root).absoluteFilePath(OWNER_FILE));
+        if (!f.open(QFile::ReadOnly))
+            return false;
+        auto pid = f.readAll().trimmed().toLongLong();
+        if (pid <= 0)
+            return false;
+#ifdef Q_OS_UNIX
+        return ::kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#else
+        return true;
+#endif
+    }
+
+    // Trees left behind by an instance that crashed or was killed
+    static void sweepStaleRamRoots() {
+        for(const auto& base: ramBases()) {
+            const auto entries = QDir(base).entryInfoList({ QString("%1*").arg(RAM_ROOT_PREFIX) }, QDir::Dirs | QDir::NoDotAndDotDot);
+            for(const auto& info: entries)
+                if (info.isWritable() && !ownerAlive(info.absoluteFilePath()))
+                    QDir(info.absoluteFilePath()).removeRecursively();
+        }
+    }
+};
+
+BuildConfigurations::BuildConfigurations(ProjectManager *proj, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->proj = proj;
+    QtConcurrent::run(&Priv_t::sweepStaleRamRoots);
+    connect(proj, &ProjectManager::projectOpened, this, [this]() {
+        priv->load();
+        emit changed();
+    });
+    connect(proj, &ProjectManager::projectClosed, this, [this]() {
+        priv->list.clear();
+        priv->plainRamDisk = false;
+        // Canceled makes stop asynchronously, see removeRetiredRamRoots
+        if (!priv->ramRoot.isEmpty())
+            priv->retiredRamRoots.append(priv->ramRoot);
+        priv->ramRoot.clear();
+        emit changed();
+    });
+}
+
+BuildConfigurations::~BuildConfigurations()
+{
+    removeRetiredRamRoots();
+    if (!priv->ramRoot.isEmpty())
+        QDir(priv->ramRoot).removeRecursively();
+    delete priv;
+}
+
+QList<BuildConfigurations::Configuration> BuildConfigurations::configurations() const
+{
+    return priv->list;
+}
+
+QList<BuildConfigurations::Configuration> BuildConfigurations::selected() const
+{
+    QList<Configuration> list;
+    for(const auto& c: priv->list)
+        if (c.selected)
+            list.append(c);
+    return list;
+}
+
+BuildConfigurations::Configuration BuildConfigurations::configuration(const QString &name) const
+{
+    for(const auto& c: priv->list)
+        if (c.name == name)
+            return c;
+    return Configuration();
+}
+
+QString BuildConfigurations::outputVariable() const
+{
+    return priv->outputVariable;
+}
+
+QString BuildConfigurations::outputPath(const BuildConfigurations::Configuration &c) const
+{
+    if (c.outputDir.isEmpty())
+        return QString();
+    return QDir::cleanPath(QDir(priv->proj->projectPath()).absoluteFilePath(c.outputDir));
+}
+
+QString BuildConfigurations::treePath(const BuildConfigurations::Configuration &c) const
+{
+    if (!c.ramDisk)
+        return outputPath(c);
+    auto root = ramRoot();
+    return root.isEmpty()? outputPath(c) : QDir(root).absoluteFilePath(c.name.isEmpty()? "default" : c.name);
+}
+
+QStringList BuildConfigurations::makeArguments(const BuildConfigurations::Configuration &c) const
+{
+    QStringList args;
+    for(auto it = c.variables.begin(); it != c.variables.end(); ++it)
+        args.append(QString("%1=%2").arg(it.key(), it.value()));
+    auto out = treePath(c);
+    if (!out.isEmpty() && !priv->outputVariable.isEmpty())
+        args.append(QString("%1=%2").arg(priv->outputVariable, out));
+    return args;
+}
+
+bool BuildConfigurations::plainRamDisk() const
+{
+    return priv->plainRamDisk && !priv->outputVariable.isEmpty();
+}
+
+BuildConfigurations::Configuration BuildConfigurations::plainConfiguration() const
+{
+    Configuration c;
+    c.outputDir = priv->proj->makeVariable(priv->outputVariable);
+    if (c.outputDir.isEmpty() || c.outputDir.contains('$'))
+        c.outputDir = DEFAULT_OUTPUT_DIR;
+    c.ramDisk = plainRamDisk();
+    return c;
+}
+
+QString BuildConfigurations::ramRoot() const
+{
+    if (!priv->ramRoot.isEmpty())
+        return priv->ramRoot;
+    auto base = QFileInfo(SHM_PATH).isWritable()?
+                QString(SHM_PATH) : QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (base.isEmpty())
+        return QString();
+    // Two projects with the same directory name must not share a tree
+    auto projectPath = priv->proj->projectPath();
+    auto hash = QCryptographicHash::hash(projectPath.toUtf8(), QCryptographicHash::Sha1).toHex().left(PATH_HASH_CHARS);
+    auto path = QDir(base).absoluteFilePath(QString("%1%2-%3").arg(RAM_ROOT_PREFIX).arg(priv->proj->projectName(), QString(hash)));
+    if (!QDir().mkpath(path))
+        return QString();
+    QFile owner(QDir(path).absoluteFilePath(OWNER_FILE));
+    if (owner.open(QFile::WriteOnly | QFile::Truncate))
+        owner.write(QByteArray::number(QCoreApplication::applicationPid()));
+    priv->ramRoot = path;
+    return path;
+}
+
+void BuildConfigurations::removeRetiredRamRoots()
+{
+    for(const auto& root: priv->retiredRamRoots)
+        // The same project opened again builds into it
+        if (root != priv->ramRoot)
+            QDir(root).removeRecursively();
+    priv->retiredRamRoots.clear();
+}
+
+int BuildConfigurations::syncArtifacts(const QString &tree, const QString &destination)
+{
+    int copied = 0;
+    QDirIterator it(tree, ARTIFACT_PATTERNS, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto from = it.next();
+        auto to = QDir(destination).absoluteFilePath(QDir(tree).relativeFilePath(from));
+        auto target = QFileInfo(to);
+        // Relinking rewrites all of them, an unchanged one is left alone
+        if (target.exists() && target.size() == it.fileInfo().size() && target.lastModified() >= it.fileInfo().lastModified())
+            continue;
+        QDir().mkpath(target.absolutePath());
+        auto tmp = to + ".part";
+        QFile::remove(tmp);
+        if (!QFile::copy(from, tmp))
+            continue;
+        QFile::remove(to);
+        if (QFile::rename(tmp, to))
+            copied++;
+    }
+    return copied;
+}
+
+void BuildConfigurations::setConfigurations(const QList<BuildConfigurations::Configuration> &list, const QString &outputVariable, bool plainRamDisk)
+{
+    priv->list = list;
+    priv->outputVariable = outputVariable;
+    priv->plainRamDisk = plainRamDisk;
+    priv->save();
+    emit changed();
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDCONFIGURATIONS_H
+#define BUILDCONFIGURATIONS_H
+
+#include <QHash>
+#include <QObject>
+
+class ProjectManager;
+
+class BuildConfigurations : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildConfigurations)
+public:
+    struct Configuration {
+        QString name;
+        QString outputDir;
+        QHash<QString, QString> variables;
+        bool selected{ false };
+        // Object files go to a tmpfs tree, only the artifacts are copied back
+        bool ramDisk{ false };
+    };
+
+    explicit BuildConfigurations(ProjectManager *proj, QObject *parent = nullptr);
+    virtual ~BuildConfigurations() override;
+
+    QList<Configuration> configurations() const;
+    QList<Configuration> selected() const;
+    Configuration configuration(const QString& name) const;
+    // Make variable that receives the output directory of a configuration
+    QString outputVariable() const;
+    QString outputPath(const Configuration& c) const;
+    // Where make writes the tree of c, under ramRoot() for RAM backed ones
+    QString treePath(const Configuration& c) const;
+    // Command line assignments that build c into its own tree
+    QStringList makeArguments(const Configuration& c) const;
+
+    // Builds without configuration go to RAM too, into the Makefile default output directory
+    bool plainRamDisk() const;
+    Configuration plainConfiguration() const;
+    // Per project directory on /dev/shm (or the runtime directory). Stale ones are swept at startup
+    QString ramRoot() const;
+    // Frees the roots of closed projects, only once no make nor artifact copy uses them
+    void removeRetiredRamRoots();
+    // Copies the final artifacts (.elf, .bin, .hex, .map) of a RAM tree back, returns how many
+    static int syncArtifacts(const QString& tree, const QString& destination);
+
+signals:
+    void changed();
+
+public slots:
+    void setConfigurations(const QList<Configuration>& list, const QString& outputVariable, bool plainRamDisk);
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDCONFIGURATIONS_H
@@ -0,0 +1,193 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildconfigurations.h"
+#include "buildconfigurationsdialog.h"
+
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSet>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+#include <QtDebug>
+
+namespace {
+
+enum Column { NameColumn, OutputColumn, RamColumn, VariablesColumn, COLUMN_COUNT };
+
+QString variablesToText(const QHash<QString, QString>& vars)
+{
+    QStringList list;
+    for(auto it = vars.begin(); it != vars.end(); ++it)
+        list.append(QString("%1=%2").arg(it.key(), it.value()));
+    list.sort();
+    return list.join(' ');
+}
+
+QHash<QString, QString> variablesFromText(const QString& text)
+{
+    QHash<QString, QString> vars;
+    for(const auto& a: text.split(' ', QString::SkipEmptyParts)) {
+        auto eq = a.indexOf('=');
+        if (eq > 0)
+            vars.insert(a.left(eq), a.mid(eq + 1));
+    }
+    return vars;
+}
+
+}
+
+class BuildConfigurationsDialog::Priv_t
+{
+public:
+    BuildConfigurations *configs{ nullptr };
+    QTableWidget *table{ nullptr };
+    QLineEdit *outputVariable{ nullptr };
+    QCheckBox *plainRamDisk{ nullptr };
+
+    void addRow(const BuildConfigurations::Configuration& c) {
+        auto row = table->rowCount();
+        table->insertRow(row);
+        auto name = new QTableWidgetItem(c.name);
+        name->setFlags(name->flags() | Qt::ItemIsUserCheckable);
+        name->setCheckState(c.selected? Qt::Checked : Qt::Unchecked);
+        table->setItem(row, NameColumn, name);
+        table->setItem(row, OutputColumn, new QTableWidgetItem(c.outputDir));
+        auto ram = new QTableWidgetItem;
+        ram->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable);
+        ram->setCheckState(c.ramDisk? Qt::Checked : Qt::Unchecked);
+        table->setItem(row, RamColumn, ram);
+        table->setItem(row, VariablesColumn, new QTableWidgetItem(variablesToText(c.variables)));
+    }
+
+    QString text(int row, int column) const {
+        auto item = table->item(row, column);
+        return item? item->text().trimmed() : QString();
+    }
+};
+
+BuildConfigurationsDialog::BuildConfigurationsDialog(BuildConfigurations *configs, QWidget *parent) :
+    QDialog(parent),
+    priv(new Priv_t)
+{
+    priv->configs = configs;
+    setWindowTitle(tr("Build Configurations"));
+
+    priv->outputVariable = new QLineEdit(configs->outputVariable(), this);
+    priv->outputVariable->setToolTip(tr("Make variable that receives the output directory of each configuration"));
+    auto form = new QFormLayout;
+    form->addRow(tr("Output directory variable:"), priv->outputVariable);
+    priv->plainRamDisk = new QCheckBox(tr("Build in RAM when no configuration is selected"), this);
+    priv->plainRamDisk->setChecked(configs->plainRamDisk());
+    priv->plainRamDisk->setToolTip(tr("Object files go to a tmpfs directory removed on project close, "
+                                      ".elf/.bin/.hex/.map files are copied back after each good build"));
+    form->addRow(priv->plainRamDisk);
+
+    priv->table = new QTableWidget(0, COLUMN_COUNT, this);
+    priv->table->setHorizontalHeaderLabels({ tr("Name"), tr("Output directory"), tr("In RAM"), tr("Variables") });
+    priv->table->horizontalHeader()->setStretchLastSection(true);
+    priv->table->verticalHeader()->hide();
+    priv->table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    priv->table->setToolTip(tr("Checked configurations are built concurrently, variables are NAME=value separated by spaces"));
+    for(const auto& c: configs->configurations())
+        priv->addRow(c);
+
+    auto add = new QPushButton(tr("Add"), this);
+    auto remove = new QPushButton(tr("Remove"), this);
+    connect(add, &QPushButton::clicked, [this]() {
+        BuildConfigurations::Configuration c;
+        c.name = tr("config%1").arg(priv->table->rowCount() + 1);
+        c.outputDir = QString("build/%1").arg(c.name);
+        c.selected = true;
+        priv->addRow(c);
+        priv->table->editItem(priv->table->item(priv->table->rowCount() - 1, NameColumn));
+    });
+    connect(remove, &QPushButton::clicked, [this]() {
+        auto row = priv->table->currentRow();
+        if (row >= 0)
+            priv->table->removeRow(row);
+    });
+    auto buttons = new QHBoxLayout;
+    buttons->addWidget(add);
+    buttons->addWidget(remove);
+    buttons->addStretch();
+
+    auto box = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(box, &QDialogButtonBox::accepted, this, &BuildConfigurationsDialog::accept);
+    connect(box, &QDialogButtonBox::rejected, this, &BuildConfigurationsDialog::reject);
+
+    auto layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(priv->table);
+    layout->addLayout(buttons);
+    layout->addWidget(box);
+    constexpr auto DEFAULT_WIDTH = 640;
+    constexpr auto DEFAULT_HEIGHT = 320;
+    resize(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+}
+
+BuildConfigurationsDialog::~BuildConfigurationsDialog()
+{
+    delete priv;
+}
+
+void BuildConfigurationsDialog::accept()
+{
+    QList<BuildConfigurations::Configuration> list;
+    QSet<QString> names;
+    QSet<QString> outputs;
+    for(int row = 0; row < priv->table->rowCount(); row++) {
+        BuildConfigurations::Configuration c;
+        c.name = priv->text(row, NameColumn);
+        if (c.name.isEmpty())
+            continue;
+        c.outputDir = priv->text(row, OutputColumn);
+        c.variables = variablesFromText(priv->text(row, VariablesColumn));
+        c.selected = priv->table->item(row, NameColumn)->checkState() == Qt::Checked;
+        c.ramDisk = priv->table->item(row, RamColumn)->checkState() == Qt::Checked;
+        if (names.contains(c.name)) {
+            QMessageBox::warning(this, windowTitle(), tr("Configuration %1 is defined twice").arg(c.name));
+            return;
+        }
+        // Concurrent builds writing the same tree would corrupt each other
+        if (!c.outputDir.isEmpty() && outputs.contains(c.outputDir)) {
+            QMessageBox::warning(this, windowTitle(), tr("Output directory %1 is used twice").arg(c.outputDir));
+            return;
+        }
+        names.insert(c.name);
+        outputs.insert(c.outputDir);
+        list.append(c);
+    }
+    auto outputVariable = priv->outputVariable->text().trimmed();
+    auto anyRam = priv->plainRamDisk->isChecked();
+    for(const auto& c: list)
+        anyRam = anyRam || c.ramDisk;
+    if (anyRam && outputVariable.isEmpty()) {
+        QMessageBox::warning(this, windowTitle(), tr("Building in RAM needs the output directory variable"));
+        return;
+    }
+    priv->configs->setConfigurations(list, outputVariable, priv->plainRamDisk->isChecked());
+    QDialog::accept();
+}
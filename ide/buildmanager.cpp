@@ -17,42 +17,603 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "buildconfigurations.h"
 #include "buildmanager.h"
+#include "buildprofiler.h"
+#include "buildstamps.h"
+#include "buildtimes.h"
+#include "childprocess.h"
+#include "compilecache.h"
+#include "icodemodelprovider.h"
+#include "jobserver.h"
 #include "processmanager.h"
+#include "projectfilewatcher.h"
 #include "projectmanager.h"
+#include "textmessagebrocker.h"
 
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileInfo>
+#include <QSet>
+#include <QStandardItemModel>
+#include <QtConcurrent>
 
 #include <QThread>
 #include <QtDebug>
 
 const QString BuildManager::PROCESS_NAME = "makeBuild";
+const QString BuildManager::COMPILE_FILE_PROCESS = "compileFile";
+
+static constexpr auto CANCEL_TIMEOUT = 300;
+static constexpr auto MSEC_PER_SEC = 1000.0;
 
 static int getOptimalNumberOfJobs()
 {
     return QThread::idealThreadCount();
 }
 
+static QString statusText(BuildManager::JobStatus status)
+{
+    switch (status) {
+    case BuildManager::JobStatus::Queued: return BuildManager::tr("Queued");
+    case BuildManager::JobStatus::Running: return BuildManager::tr("Running");
+    case BuildManager::JobStatus::Succeeded: return BuildManager::tr("Succeeded");
+    case BuildManager::JobStatus::Failed: return BuildManager::tr("Failed");
+    case BuildManager::JobStatus::Canceled: return BuildManager::tr("Canceled");
+    case BuildManager::JobStatus::UpToDate: return BuildManager::tr("Up to date");
+    }
+    return QString();
+}
+
+struct BuildManager::Job {
+    QString target;
+    QString configuration;
+    // Output directory, empty for the tree of the plain make invocation
+    QString tree;
+    QStringList overrides;
+    // Set for RAM backed trees, artifacts are copied there after a good build
+    QString artifactsDir;
+    QSet<QString> closure;
+    BuildManager::JobStatus status{ BuildManager::JobStatus::Queued };
+    QString processName;
+    QString profileLog;
+    QString cacheLog;
+    bool canceled{ false };
+    qint64 startedAt{ 0 };
+    QElapsedTimer timer;
+    QStandardItem *statusItem{ nullptr };
+    QStandardItem *timeItem{ nullptr };
+
+    bool isActive() const {
+        return status == BuildManager::JobStatus::Queued || status == BuildManager::JobStatus::Running;
+    }
+};
+
+class BuildManager::Priv_t
+{
+public:
+    ProjectManager *proj{ nullptr };
+    ProcessManager *pman{ nullptr };
+    QStandardItemModel *model{ nullptr };
+    QList<Job*> jobs;
+    QStringList processSlots;
+    BuildProfiler *profiler{ nullptr };
+    BuildStamps *stamps{ nullptr };
+    BuildTimes *times{ nullptr };
+    BuildConfigurations *configs{ nullptr };
+    // Artifact copies still reading a RAM tree
+    QSet<QFutureWatcher<int>*> syncs;
+    QString compilingFile;
+    QString requestedFile;
+    QElapsedTimer compileTimer;
+
+    ~Priv_t() { qDeleteAll(jobs); }
+
+    // Everything make could touch while building target, by walking the parsed rule graph
+    QSet<QString> closureOf(const QString& target) const {
+        QSet<QString> closure;
+        QStringList pending{ target };
+        while (!pending.isEmpty()) {
+            auto t = pending.takeLast();
+            if (t.isEmpty() || closure.contains(t))
+                continue;
+            closure.insert(t);
+            pending.append(proj->dependenciesForTarget(t));
+        }
+        return closure;
+    }
+
+    bool closureBusy(const Job *job) const {
+        for(auto j: jobs)
+            if (j->isActive() && j->tree == job->tree && j->closure.intersects(job->closure))
+                return true;
+        return false;
+    }
+
+    Job *jobForProcess(const QString& name) const {
+        for(auto j: jobs)
+            if (j->status == JobStatus::Running && j->processName == name)
+                return j;
+        return nullptr;
+    }
+
+    void setStatus(Job *job, JobStatus status) {
+        job->status = status;
+        job->statusItem->setText(statusText(status));
+        if (status == JobStatus::Running) {
+            job->timer.start();
+        } else if (job->timer.isValid()) {
+            job->timeItem->setText(BuildManager::tr("%1 s").arg(job->timer.elapsed() / MSEC_PER_SEC, 0, 'f', 1));
+        }
+    }
+
+    // Puts the launcher in front of the compilers, a CC/CXX of the configuration wins over the makefile one
+    QStringList wrappedCompilers(const QStringList& overrides) const {
+        auto wrapper = BuildProfiler::wrapperPath();
+        if (wrapper.contains(' '))
+            wrapper = QString("'%1'").arg(wrapper);
+        QStringList result;
+        QHash<QString, QString> configured;
+        // A raw CC/CXX given after the wrapped one would replace it, so it is folded in
+        for(const auto& o: overrides) {
+            auto name = o.section('=', 0, 0);
+            if (name == "CC" || name == "CXX")
+                configured.insert(name, o.section('=', 1));
+            else
+                result.append(o);
+        }
+        const QList<QPair<QString, QString>> compilers{ { "CC", "cc" }, { "CXX", "g++" } };
+        for(const auto& c: compilers) {
+            auto value = configured.contains(c.first)? configured.value(c.first) : proj->makeVariable(c.first);
+            result.append(QString("%1=%2 %3").arg(c.first, wrapper, value.isEmpty()? c.second : value));
+        }
+        return result;
+    }
+
+    // A make still waiting for its token has nothing to interrupt
+    bool withdraw(Job *job) {
+        return JobServer::instance().cancel(pman->processFor(job->processName));
+    }
+
+    void pruneFinished() {
+        for(int i = jobs.size() - 1; i >= 0; i--) {
+            if (!jobs.at(i)->isActive()) {
+                model->removeRow(i);
+                delete jobs.takeAt(i);
+            }
+        }
+    }
+};
+
 BuildManager::BuildManager(ProjectManager *_proj, ProcessManager *_pman, QObject *parent) :
     QObject(parent),
-    proj(_proj),
-    pman(_pman)
+    priv(new Priv_t)
 {
-    pman->setErrorHandler(PROCESS_NAME, [](QProcess *proc, QProcess::ProcessError err) {
-        // TODO Implement this (maybe unnecesary?)
+    priv->proj = _proj;
+    priv->pman = _pman;
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({ tr("Target"), tr("Configuration"), tr("Status"), tr("Time") });
+    priv->profiler = new BuildProfiler(this);
+    priv->stamps = new BuildStamps(priv->proj, this);
+    connect(priv->stamps, &BuildStamps::inputsChanged, this, &BuildManager::inputsChanged);
+    priv->times = new BuildTimes(priv->proj, this);
+    connect(priv->times, &BuildTimes::progressChanged, this, [this]() {
+        auto p = priv->times->progress();
+        emit progressChanged(p.percent, p.etaMs);
+    });
+    priv->configs = new BuildConfigurations(priv->proj, this);
+    auto excludeOutputTrees = [this]() {
+        QStringList trees{ priv->configs->outputPath(priv->configs->plainConfiguration()) };
+        for(const auto& c: priv->configs->configurations())
+            trees.append(priv->configs->outputPath(c));
+        trees.removeAll(QString());
+        priv->proj->fileWatcher()->setExcludedPaths(trees);
+    };
+    connect(priv->configs, &BuildConfigurations::changed, this, excludeOutputTrees);
+    connect(priv->proj, &ProjectManager::discoverFinished, this, excludeOutputTrees);
+    connect(priv->proj, &ProjectManager::projectClosed, this, [this]() { priv->proj->fileWatcher()->setExcludedPaths({}); });
+    connect(priv->proj, &ProjectManager::projectClosed, this, &BuildManager::cancelAll);
+    connect(priv->proj, &ProjectManager::projectClosed, this, &BuildManager::releaseRamTrees);
+
+    priv->pman->setTerminationHandler(COMPILE_FILE_PROCESS, [this](QProcess *proc, int code, QProcess::ExitStatus status) {
         Q_UNUSED(proc)
-        Q_UNUSED(err)
+        auto color = code == 0 && status == QProcess::NormalExit? "green" : "red";
+        TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+            tr(R"(<font color="%1">%2 compiled in %3 ms, exit code %4</font><br>)")
+                .arg(color, QFileInfo(priv->compilingFile).fileName())
+                .arg(priv->compileTimer.elapsed()).arg(code));
+        emit fileCompiled(priv->compilingFile, code);
+    });
+    // A restart only runs once the previous compile is gone, its result keeps the old name
+    priv->pman->setStartupHandler(COMPILE_FILE_PROCESS, [this](QProcess *proc) {
+        Q_UNUSED(proc)
+        priv->compilingFile = priv->requestedFile;
+        priv->compileTimer.start();
+    });
+    priv->pman->setErrorHandler(COMPILE_FILE_PROCESS, [](QProcess *proc, QProcess::ProcessError err) {
+        if (err == QProcess::FailedToStart)
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+                tr(R"(<font color="red">Can not run %1: %2</font><br>)").arg(proc->program(), proc->errorString()));
+    });
+}
+
+BuildManager::~BuildManager()
+{
+    // The configurations remove the RAM trees when deleted right after this
+    for(auto watcher: priv->syncs)
+        watcher->waitForFinished();
+    delete priv;
+}
+
+QAbstractItemModel *BuildManager::jobsModel() const
+{
+    return priv->model;
+}
+
+BuildProfiler *BuildManager::profiler() const
+{
+    return priv->profiler;
+}
+
+BuildConfigurations *BuildManager::configurations() const
+{
+    return priv->configs;
+}
+
+bool BuildManager::isBuilding() const
+{
+    for(auto j: priv->jobs)
+        if (j->isActive())
+            return true;
+    return false;
+}
+
+QStringList BuildManager::runningTargets() const
+{
+    QStringList list;
+    for(auto j: priv->jobs)
+        if (j->status == JobStatus::Running)
+            list.append(j->target);
+    return list;
+}
+
+QStringList BuildManager::inputsOf(const QString &target) const
+{
+    return priv->stamps->inputs(target, priv->closureOf(target));
+}
+
+bool BuildManager::inputsRecorded(const QString &target) const
+{
+    return priv->stamps->hasRecordedInputs(target);
+}
+
+void BuildManager::startBuild(const QString &target, bool force)
+{
+    if (!isBuilding())
+        priv->pruneFinished();
+    const auto selected = priv->configs->selected();
+    if (selected.isEmpty())
+        enqueue(target, QString(), force);
+    for(const auto& c: selected)
+        enqueue(target, c.name, force);
+    schedule();
+}
+
+void BuildManager::enqueue(const QString &target, const QString &configuration, bool force)
+{
+    for(auto j: priv->jobs)
+        if (j->target == target && j->configuration == configuration && j->status == JobStatus::Queued)
+            return; // Already waiting, a second run would do nothing new
+
+    auto job = new Job;
+    job->target = target;
+    job->configuration = configuration;
+    auto c = configuration.isEmpty()? priv->configs->plainConfiguration() : priv->configs->configuration(configuration);
+    if (!configuration.isEmpty() || c.ramDisk) {
+        job->tree = priv->configs->treePath(c);
+        job->overrides = priv->configs->makeArguments(c);
+        if (c.ramDisk) {
+            auto out = priv->configs->outputPath(c);
+            job->artifactsDir = out.isEmpty()? priv->proj->projectPath() : out;
+        }
+    }
+    job->closure = priv->closureOf(target);
+    // Stamps describe the plain on-disk tree, and another active job may still rewrite part of this closure
+    auto upToDate = !force && configuration.isEmpty() && job->artifactsDir.isEmpty() && !priv->closureBusy(job) &&
+            priv->stamps->isUpToDate(target);
+    job->statusItem = new QStandardItem;
+    job->timeItem = new QStandardItem;
+    auto targetItem = new QStandardItem(target);
+    auto configItem = new QStandardItem(configuration);
+    for(auto item: { targetItem, configItem, job->statusItem, job->timeItem })
+        item->setEditable(false);
+    priv->model->appendRow({ targetItem, configItem, job->statusItem, job->timeItem });
+    priv->jobs.append(job);
+    if (upToDate) {
+        priv->setStatus(job, JobStatus::UpToDate);
+        TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+            tr(R"(<font color="green">%1 is up to date, nothing changed since the last build (Shift+click to run make anyway)</font><br>)")
+                .arg(target));
+        emit buildTerminated(target, 0, tr("Up to date"));
+    } else {
+        priv->setStatus(job, JobStatus::Queued);
+    }
+}
+
+void BuildManager::cancelBuild(const QString &target)
+{
+    for(int i = 0; i < priv->jobs.size(); i++)
+        if (priv->jobs.at(i)->target == target)
+            cancelJob(i);
+}
+
+void BuildManager::cancelJob(int index)
+{
+    auto j = priv->jobs.value(index);
+    if (!j)
+        return;
+    if (j->status == JobStatus::Queued) {
+        priv->setStatus(j, JobStatus::Canceled);
+        schedule();
+    } else if (j->status == JobStatus::Running) {
+        j->canceled = true;
+        if (priv->withdraw(j))
+            jobFinished(j->processName, -1, QProcess::CrashExit, tr("Canceled"));
+        else
+            priv->pman->terminate(j->processName, CANCEL_TIMEOUT);
+    }
+}
+
+void BuildManager::cancelAll()
+{
+    for(auto j: priv->jobs)
+        if (j->status == JobStatus::Queued)
+            priv->setStatus(j, JobStatus::Canceled);
+    for(auto j: priv->jobs) {
+        if (j->status == JobStatus::Running) {
+            j->canceled = true;
+            if (priv->withdraw(j))
+                jobFinished(j->processName, -1, QProcess::CrashExit, tr("Canceled"));
+            else
+                priv->pman->terminate(j->processName, CANCEL_TIMEOUT);
+        }
+    }
+}
+
+void BuildManager::schedule()
+{
+    // Closures only conflict inside one output tree, configurations build side by side
+    QHash<QString, QSet<QString>> busy;
+    for(auto j: priv->jobs)
+        if (j->status == JobStatus::Running)
+            busy[j->tree].unite(j->closure);
+
+    for(auto j: priv->jobs) {
+        if (j->status != JobStatus::Queued)
+            continue;
+        // Earlier queued jobs also claim their closure so overlapping targets keep request order
+        auto& treeBusy = busy[j->tree];
+        auto canRun = !treeBusy.intersects(j->closure);
+        treeBusy.unite(j->closure);
+        if (canRun)
+            launch(j);
+    }
+
+    // Indexers and checkers wait so the build gets the whole machine
+    auto building = isBuilding();
+    ChildProcess::setBackgroundPaused(building);
+    JobServer::instance().setBackgroundHeld(building);
+    if (!building) {
+        releaseRamTrees();
+        emit queueFinished();
+    }
+}
+
+void BuildManager::releaseRamTrees()
+{
+    if (!isBuilding() && priv->syncs.isEmpty())
+        priv->configs->removeRetiredRamRoots();
+}
+
+QString BuildManager::freeProcessSlot()
+{
+    for(const auto& name: priv->processSlots)
+        if (!priv->pman->isRunning(name) && !priv->jobForProcess(name))
+            return name;
+
+    auto name = priv->processSlots.isEmpty()?
+                PROCESS_NAME : QString("%1-%2").arg(PROCESS_NAME).arg(priv->processSlots.size());
+    priv->processSlots.append(name);
+    priv->pman->setPriority(name, ChildProcess::Priority::Build);
+    priv->pman->setErrorHandler(name, [this, name](QProcess *proc, QProcess::ProcessError err) {
+        // finished() is never emitted when make can not be started
+        if (err == QProcess::FailedToStart)
+            jobFinished(name, -1, QProcess::CrashExit, proc->errorString());
     });
-    pman->setTerminationHandler(PROCESS_NAME, [this](QProcess *proc, int code, QProcess::ExitStatus status) {
-        emit buildTerminated(code, status == QProcess::NormalExit? tr("Exit normal") : proc->errorString());
+    priv->pman->setTerminationHandler(name, [this, name](QProcess *proc, int code, QProcess::ExitStatus status) {
+        jobFinished(name, code, status, status == QProcess::NormalExit? tr("Exit normal") : proc->errorString());
+    });
+    emit jobProcessCreated(name);
+    return name;
+}
+
+void BuildManager::launch(Job *job)
+{
+    auto &jobServer = JobServer::instance();
+    auto params = QStringList{ "-f", priv->proj->projectFile(), job->target };
+    auto nJobs = jobServer.jobs();
+    // An explicit -j would make this make ignore the shared pool
+    if (!jobServer.isAvailable()) {
+        auto &c = AppConfig::instance();
+        auto total = c.numberOfJobsOptimal()? getOptimalNumberOfJobs() : c.numberOfJobs();
+        // Without a pool the limit is split between the makes running side by side
+        auto running = 1;
+        for(auto j: priv->jobs)
+            if (j->status == JobStatus::Running)
+                running++;
+        nJobs = qMax(1, total / running);
+        params = QStringList{ "-j", QString("%1").arg(nJobs) } + params;
+    }
+    auto env = jobServer.makeEnvironment();
+    auto &config = AppConfig::instance();
+    auto haveWrapper = QFileInfo(BuildProfiler::wrapperPath()).isExecutable();
+    auto logFor = [this, job](const QString& kind) {
+        auto dir = AppConfig::ensureExist(QDir(AppConfig::instance().workspacePath()).absoluteFilePath(kind));
+        auto suffix = job->configuration.isEmpty()? QString() : "-" + job->configuration;
+        auto path = QDir(dir).absoluteFilePath(QString("%1-%2%3.log").arg(priv->proj->projectName(), job->target, suffix));
+        QFile::remove(path);
+        return path;
+    };
+    // Slots keep their environment between jobs, so every key is always set
+    if (haveWrapper && config.buildProfiling())
+        job->profileLog = logFor("build-profiles");
+    if (haveWrapper && config.buildCache()) {
+        job->cacheLog = logFor("compile-cache-logs");
+        env.insert("EIDE_CCACHE_DIR", CompileCache::cacheDir());
+    } else {
+        env.insert("EIDE_CCACHE_DIR", QString());
+    }
+    env.insert("EIDE_PROFILE_LOG", job->profileLog);
+    env.insert("EIDE_CCACHE_LOG", job->cacheLog);
+    if (!job->profileLog.isEmpty() || !job->cacheLog.isEmpty())
+        params.append(priv->wrappedCompilers(job->overrides));
+    else
+        params.append(job->overrides);
+    if (!job->tree.isEmpty())
+        QDir().mkpath(job->tree);
+    job->processName = freeProcessSlot();
+    job->startedAt = QDateTime::currentMSecsSinceEpoch();
+    priv->setStatus(job, JobStatus::Running);
+    emit jobLaunched(job->processName, job->configuration);
+    auto timesKey = job->configuration.isEmpty()? job->target : QString("%1@%2").arg(job->target, job->configuration);
+    priv->times->begin(job->processName, timesKey, params, nJobs);
+    // The token covers the implicit job of make, the rest comes from the pool
+    priv->pman->startWithToken(job->processName, "make", params, env, priv->proj->projectPath());
+    emit buildStarted(job->target);
+}
+
+void BuildManager::jobFinished(const QString &processName, int code, QProcess::ExitStatus status, const QString &error)
+{
+    auto job = priv->jobForProcess(processName);
+    if (!job)
+        return; // The slot was borrowed by some other tool
+    if (job->canceled)
+        priv->setStatus(job, JobStatus::Canceled);
+    else
+        priv->setStatus(job, code == 0 && status == QProcess::NormalExit? JobStatus::Succeeded : JobStatus::Failed);
+    // Stamps only describe the plain on-disk tree, the RAM one is gone after closing the project
+    if (job->configuration.isEmpty()) {
+        if (job->status == JobStatus::Succeeded && job->artifactsDir.isEmpty())
+            priv->stamps->markBuilt(job->target, job->startedAt);
+        else
+            priv->stamps->invalidate(job->target);
+    }
+    if (job->status == JobStatus::Succeeded && !job->artifactsDir.isEmpty())
+        syncArtifacts(job);
+    priv->times->end(processName, job->status == JobStatus::Succeeded, job->profileLog);
+    reportUsage(job);
+    if (!job->profileLog.isEmpty())
+        priv->profiler->load(job->profileLog);
+    if (!job->cacheLog.isEmpty())
+        reportCache(job->cacheLog);
+    emit buildTerminated(job->target, code, error);
+    schedule();
+}
+
+void BuildManager::noteCompileStarted(const QString &processName, const QString &file)
+{
+    priv->times->compileSeen(processName, file);
+}
+
+void BuildManager::reportUsage(const Job *job)
+{
+    auto proc = qobject_cast<ChildProcess*>(priv->pman->processFor(job->processName));
+    if (!proc || !proc->usage().startedAt.isValid())
+        return; // make never started
+    const auto& u = proc->usage();
+    auto label = job->configuration.isEmpty()? job->target : QString("%1 [%2]").arg(job->target, job->configuration);
+    auto wall = u.wallMs / MSEC_PER_SEC;
+    QString text;
+    if (u.hasResources()) {
+        constexpr auto USEC_PER_SEC = 1000000.0;
+        constexpr auto KB_PER_MB = 1024;
+        auto cpu = (u.userUs + u.sysUs) / USEC_PER_SEC;
+        // make waits for every compiler, so the CPU covers the whole build up to the last sample
+        text = tr("Resources for %1: %2 s wall, ~%3 s user + ~%4 s system CPU (~%5x parallelism), make peak RSS ~%6 MB (sampled, approximate)")
+                .arg(label)
+                .arg(wall, 0, 'f', 1)
+                .arg(u.userUs / USEC_PER_SEC, 0, 'f', 1)
+                .arg(u.sysUs / USEC_PER_SEC, 0, 'f', 1)
+                .arg(wall > 0? cpu / wall : 0.0, 0, 'f', 1)
+                .arg(u.maxRssKb / KB_PER_MB);
+    } else {
+        text = tr("Resources for %1: %2 s wall, CPU and memory not measured").arg(label).arg(wall, 0, 'f', 1);
+    }
+    TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+        QString(R"(<font color="gray">%1</font><br>)").arg(text.toHtmlEscaped()));
+}
+
+void BuildManager::syncArtifacts(const Job *job)
+{
+    auto tree = job->tree;
+    auto destination = job->artifactsDir;
+    auto watcher = new QFutureWatcher<int>(this);
+    priv->syncs.insert(watcher);
+    connect(watcher, &QFutureWatcher<int>::finished, this, [this, watcher, destination]() {
+        TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+            tr(R"(<font color="blue">%1 artifacts copied from the RAM build tree to %2</font><br>)")
+                .arg(watcher->result()).arg(destination.toHtmlEscaped()));
+        priv->syncs.remove(watcher);
+        watcher->deleteLater();
+        releaseRamTrees();
+    });
+    watcher->setFuture(QtConcurrent::run(BuildConfigurations::syncArtifacts, tree, destination));
+}
+
+void BuildManager::reportCache(const QString &cacheLog)
+{
+    auto stats = CompileCache::readStats(cacheLog);
+    auto cacheable = stats.hits + stats.misses;
+    auto dir = CompileCache::cacheDir();
+    constexpr auto BYTES_PER_MB = 1024 * 1024;
+    auto maxBytes = qint64(AppConfig::instance().buildCacheSize()) * BYTES_PER_MB;
+    auto watcher = new QFutureWatcher<qint64>(this);
+    connect(watcher, &QFutureWatcher<qint64>::finished, [watcher, stats, cacheable]() {
+        constexpr auto PERCENT = 100;
+        TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+            tr(R"(<font color="blue">Compile cache: %1 hits, %2 misses, %3 not cacheable (%4% hit rate), %5 MB used</font><br>)")
+                .arg(stats.hits).arg(stats.misses).arg(stats.skipped)
+                .arg(cacheable > 0? stats.hits * PERCENT / cacheable : 0)
+                .arg(watcher->result() / BYTES_PER_MB));
+        watcher->deleteLater();
     });
+    // LRU trimming walks the whole store, keep it away from the GUI thread
+    watcher->setFuture(QtConcurrent::run(CompileCache::trim, dir, maxBytes));
 }
 
-void BuildManager::startBuild(const QString &target)
+void BuildManager::compileFile(const QString &path, bool syntaxOnly)
 {
-    auto &c = AppConfig::instance();
-    auto nJobs = c.numberOfJobsOptimal()? getOptimalNumberOfJobs() : c.numberOfJobs();
-    auto params = QStringList{ "-j", QString("%1").arg(nJobs), "-f", proj->projectFile(), target };
-    pman->start(PROCESS_NAME, "make", params, {}, proj->projectPath());
-    emit buildStarted(target);
+    auto model = priv->proj->codeModel();
+    auto command = model? model->compileCommandFor(path) : ICodeModelProvider::CompileCommand();
+    if (command.isEmpty()) {
+        TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+            tr(R"(<font color="red">No compile command known for %1, it must be part of a make target</font><br>)")
+                .arg(QFileInfo(path).fileName()));
+        if (model)
+            model->startIndexingFile(path);
+        return;
+    }
+    constexpr auto RESTART_TIMEOUT = 300;
+    if (priv->pman->isRunning(COMPILE_FILE_PROCESS))
+        priv->pman->terminate(COMPILE_FILE_PROCESS, RESTART_TIMEOUT);
+    auto args = command.arguments;
+    if (syntaxOnly)
+        args << "-fsyntax-only";
+    else
+        args << "-c" << "-o" << QProcess::nullDevice();
+    emit jobProcessCreated(COMPILE_FILE_PROCESS);
+    priv->requestedFile = path;
+    priv->pman->start(COMPILE_FILE_PROCESS, command.program, args, {}, command.workingDirectory);
 }
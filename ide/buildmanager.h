@@ -20,7 +20,13 @@
 #define BUILDMANAGER_H
 
 #include <QObject>
+#include <QProcess>
 
+class QAbstractItemModel;
+
+class BuildConfigurations;
+class BuildProfiler;
+class BuildStamps;
 class ProcessManager;
 class ProjectManager;
 
@@ -30,19 +36,60 @@ class BuildManager : public QObject
     Q_DISABLE_COPY(BuildManager)
 public:
     static const QString PROCESS_NAME;
+    static const QString COMPILE_FILE_PROCESS;
+
+    enum class JobStatus { Queued, Running, Succeeded, Failed, Canceled, UpToDate };
 
     explicit BuildManager(ProjectManager *_proj, ProcessManager *_pman, QObject *parent = nullptr);
+    virtual ~BuildManager() override;
+
+    QAbstractItemModel *jobsModel() const;
+    BuildProfiler *profiler() const;
+    BuildConfigurations *configurations() const;
+    bool isBuilding() const;
+    QStringList runningTargets() const;
+    // Files make checked for target on its last plain build, a guess from the discover graph before that
+    QStringList inputsOf(const QString& target) const;
+    bool inputsRecorded(const QString& target) const;
 
 signals:
     void buildStarted(const QString& target);
-    void buildTerminated(int code, const QString& error);
+    void buildTerminated(const QString& target, int code, const QString& error);
+    void jobProcessCreated(const QString& processName);
+    void jobLaunched(const QString& processName, const QString& configuration);
+    void queueFinished();
+    void fileCompiled(const QString& path, int code);
+    // Estimated from the durations of past builds, -1 when unknown
+    void progressChanged(int percent, qint64 etaMs);
+    // The inputs of target were read back from make after a successful build
+    void inputsChanged(const QString& target);
 
 public slots:
-    void startBuild(const QString& target);
+    // One job per selected configuration. Skips make when no input changed since the last good build, unless forced
+    void startBuild(const QString& target, bool force = false);
+    void cancelBuild(const QString& target);
+    void cancelJob(int index);
+    void cancelAll();
+    // Runs only the compiler invocation make would use for this file
+    void compileFile(const QString& path, bool syntaxOnly = false);
+    // Fed with the compiler lines of make output to advance the progress estimate
+    void noteCompileStarted(const QString& processName, const QString& file);
 
 private:
-    ProjectManager *proj;
-    ProcessManager *pman;
+    struct Job;
+    class Priv_t;
+    Priv_t *priv;
+
+    void enqueue(const QString& target, const QString& configuration, bool force);
+    void schedule();
+    QString freeProcessSlot();
+    void launch(Job *job);
+    void jobFinished(const QString& processName, int code, QProcess::ExitStatus status, const QString& error);
+    void reportUsage(const Job *job);
+    void syncArtifacts(const Job *job);
+    // Removes the RAM trees of closed projects once no job nor copy uses them
+    void releaseRamTrees();
+    void reportCache(const QString& cacheLog);
 };
 
 #endif // BUILDMANAGER_H
@@ -0,0 +1,407 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildoutputparser.h"
+#include "buildtimes.h"
+
+#include <QDir>
+#include <QHash>
+#include <QRegularExpression>
+#include <QStandardItemModel>
+#include <QThread>
+#include <QTimer>
+
+#include <functional>
+
+#include <QtDebug>
+
+// A single batch per interval keeps the GUI responsive under make -j32 floods
+static constexpr auto FLUSH_INTERVAL_MS = 50;
+
+namespace {
+
+using Diagnostic = BuildOutputParser::Diagnostic;
+using Severity = BuildOutputParser::Diagnostic::Severity;
+
+const QRegularExpression DIAGNOSTIC_RE{
+    R"(^(.+?):(\d+):(?:(\d+):)?\s+(fatal error|error|warning|note):\s+(.*)$)" };
+const QRegularExpression LINKER_RE{
+    R"(^(.+?):(\d+):\s+((?:undefined reference to|multiple definition of) .*)$)" };
+const QRegularExpression MAKE_ERROR_RE{
+    R"(^g?make(?:\[\d+\])?: \*\*\* (.*)$)" };
+
+Severity severityFromText(const QString& text)
+{
+    if (text == "note")
+        return Severity::Note;
+    if (text == "warning")
+        return Severity::Warning;
+    return Severity::Error;
+}
+
+QString severityColor(Severity s)
+{
+    switch (s) {
+    case Severity::Note: return "blue";
+    case Severity::Warning: return "darkorange";
+    case Severity::Error: return "red";
+    }
+    return "black";
+}
+
+// Concurrent makes interleave their output, so each process keeps its own context
+struct SourceState {
+    QString origin;
+    QStringList directoryStack;
+    QHash<QString, QString> partialLines;
+    // Notes belong to the last diagnostic of their own make, not to the last one overall
+    int lastDiagnostic{ -1 };
+};
+
+// Lives in the parser thread, only touched from queued invocations
+struct ParserState {
+    QObject *context{ nullptr };
+    QString basePath;
+    QHash<QString, SourceState> sources;
+    QString html;
+    QList<Diagnostic> diagnostics;
+    bool flushScheduled{ false };
+    int generation{ 0 };
+    int nextId{ 0 };
+    std::function<void (int, const QString&, const QList<Diagnostic>&)> deliver;
+    std::function<void (int, const QString&, const QString&)> compiling;
+
+    QString resolve(const SourceState& state, const QString& file) const {
+        if (QDir::isAbsolutePath(file))
+            return QDir::cleanPath(file);
+        auto dir = state.directoryStack.isEmpty()? basePath : state.directoryStack.last();
+        return QDir::cleanPath(QDir(dir).absoluteFilePath(file));
+    }
+
+    void appendHtml(const QString& origin, const QString& line, const QString& color = QString(), const Diagnostic *d = nullptr) {
+        auto escaped = line.toHtmlEscaped().replace(' ', "&nbsp;");
+        if (d && !d->file.isEmpty())
+            escaped = QString(R"(<a href="file:%1#%2#%3">%4</a>)")
+                    .arg(d->file.toHtmlEscaped()).arg(d->line).arg(d->column).arg(escaped);
+        if (!color.isEmpty())
+            escaped = QString(R"(<font color="%1">%2</font>)").arg(color, escaped);
+        if (!origin.isEmpty())
+            escaped.prepend(QString(R"(<font color="gray">[%1]</font>&nbsp;)").arg(origin.toHtmlEscaped()));
+        html.append(escaped).append("<br>");
+    }
+
+    void addDiagnostic(SourceState& state, Diagnostic& d) {
+        d.id = nextId++;
+        state.lastDiagnostic = d.id;
+        diagnostics.append(d);
+    }
+
+    void addNote(const SourceState& state, Diagnostic& d) {
+        d.parent = state.lastDiagnostic;
+        for(int i = diagnostics.size() - 1; d.parent >= 0 && i >= 0; i--) {
+            if (diagnostics.at(i).id == d.parent) {
+                diagnostics[i].notes.append(Diagnostic::Note{ d.file, d.line, d.column, d.message });
+                return;
+            }
+        }
+        // The parent went out in an earlier batch, or there is none
+        diagnostics.append(d);
+    }
+
+    void parseLine(const QString& process, SourceState& state, QString line) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        const auto& origin = state.origin;
+        auto m = DIAGNOSTIC_RE.match(line);
+        if (m.hasMatch()) {
+            Diagnostic d;
+            d.file = resolve(state, m.captured(1));
+            d.line = m.captured(2).toInt();
+            d.column = m.captured(3).isEmpty()? 1 : m.captured(3).toInt();
+            d.severity = severityFromText(m.captured(4));
+            d.message = m.captured(5);
+            d.origin = origin;
+            appendHtml(origin, line, severityColor(d.severity), &d);
+            if (d.severity == Severity::Note)
+                addNote(state, d);
+            else
+                addDiagnostic(state, d);
+            return;
+        }
+        m = LINKER_RE.match(line);
+        if (m.hasMatch()) {
+            Diagnostic d;
+            d.file = resolve(state, m.captured(1));
+            d.line = m.captured(2).toInt();
+            d.column = 1;
+            d.message = m.captured(3);
+            d.origin = origin;
+            appendHtml(origin, line, severityColor(d.severity), &d);
+            addDiagnostic(state, d);
+            return;
+        }
+        m = MAKE_ERROR_RE.match(line);
+        if (m.hasMatch()) {
+            Diagnostic d;
+            d.message = m.captured(1);
+            d.origin = origin;
+            appendHtml(origin, line, severityColor(d.severity));
+            addDiagnostic(state, d);
+            return;
+        }
+        if (!BuildTimes::followDirectory(line, &state.directoryStack)) {
+            auto source = BuildTimes::compiledSource(line);
+            if (!source.isEmpty())
+                compiling(generation, process, resolve(state, source));
+        }
+        appendHtml(origin, line);
+    }
+
+    void scheduleFlush() {
+        if (flushScheduled)
+            return;
+        flushScheduled = true;
+        QTimer::singleShot(FLUSH_INTERVAL_MS, context, [this]() { flush(); });
+    }
+
+    void flush() {
+        flushScheduled = false;
+        if (html.isEmpty() && diagnostics.isEmpty())
+            return;
+        deliver(generation, html, diagnostics);
+        html.clear();
+        diagnostics.clear();
+    }
+
+    // Sources are named processName:channel, both channels share the process context
+    static QString processOf(const QString& source) {
+        return source.left(source.lastIndexOf(':'));
+    }
+
+    void feed(const QString& source, const QString& text) {
+        auto process = processOf(source);
+        auto& state = sources[process];
+        auto& partial = state.partialLines[source];
+        partial.append(text);
+        int start = 0;
+        int end;
+        while ((end = partial.indexOf('\n', start)) != -1) {
+            parseLine(process, state, partial.mid(start, end - start));
+            start = end + 1;
+        }
+        partial.remove(0, start);
+        scheduleFlush();
+    }
+
+    void finish(const QString& source) {
+        auto process = processOf(source);
+        auto it = sources.find(process);
+        if (it != sources.end()) {
+            auto partial = it->partialLines.take(source);
+            if (!partial.isEmpty())
+                parseLine(process, *it, partial);
+            // Drop the context once every channel of this process is done
+            if (it->partialLines.isEmpty())
+                sources.erase(it);
+        }
+        flush();
+    }
+
+    void reset(int newGeneration) {
+        generation = newGeneration;
+        nextId = 0;
+        for(auto& state: sources) {
+            state.partialLines.clear();
+            state.directoryStack.clear();
+            state.lastDiagnostic = -1;
+        }
+        html.clear();
+        diagnostics.clear();
+    }
+};
+
+QList<QStandardItem*> makeRow(const QString& message, const QString& location, const QString& origin,
+                              const QString& file, int line, int column)
+{
+    auto messageItem = new QStandardItem(message);
+    auto locationItem = new QStandardItem(location);
+    auto originItem = new QStandardItem(origin);
+    for(auto item: { messageItem, locationItem, originItem }) {
+        item->setEditable(false);
+        item->setToolTip(message);
+        item->setData(file, BuildOutputParser::FILE_ROLE);
+        item->setData(line, BuildOutputParser::LINE_ROLE);
+        item->setData(column, BuildOutputParser::COLUMN_ROLE);
+    }
+    return { messageItem, locationItem, originItem };
+}
+
+}
+
+class BuildOutputParser::Priv_t
+{
+public:
+    QThread thread;
+    QObject *worker{ nullptr };
+    ParserState state;
+    QStandardItemModel *model{ nullptr };
+    DiagnosticList diagnostics;
+    // Diagnostic id to its row, rows and the diagnostics list grow together
+    QHash<int, int> rows;
+    QString basePath;
+    int generation{ 0 };
+    int errors{ 0 };
+    int warnings{ 0 };
+
+    QString location(const QString& file, int line, int column) const {
+        if (file.isEmpty())
+            return QString();
+        auto shown = basePath.isEmpty()? file : QDir(basePath).relativeFilePath(file);
+        return QString("%1:%2:%3").arg(shown).arg(line).arg(column);
+    }
+
+    void appendNotes(QStandardItem *parent, const QList<Diagnostic::Note>& notes, const QString& origin) {
+        for(const auto& n: notes)
+            parent->appendRow(makeRow(n.message, location(n.file, n.line, n.column), origin, n.file, n.line, n.column));
+    }
+
+    void append(const DiagnosticList& list) {
+        for(const auto& d: list) {
+            auto parentRow = d.severity == Severity::Note? rows.value(d.parent, -1) : -1;
+            if (parentRow >= 0) {
+                // The note continues a diagnostic flushed in a previous batch
+                diagnostics[parentRow].notes.append(Diagnostic::Note{ d.file, d.line, d.column, d.message });
+                auto parent = model->item(parentRow);
+                appendNotes(parent, { Diagnostic::Note{ d.file, d.line, d.column, d.message } }, d.origin);
+                appendNotes(parent, d.notes, d.origin);
+                continue;
+            }
+            auto row = makeRow(d.message, location(d.file, d.line, d.column), d.origin, d.file, d.line, d.column);
+            row.first()->setForeground(QColor(severityColor(d.severity)));
+            appendNotes(row.first(), d.notes, d.origin);
+            model->appendRow(row);
+            diagnostics.append(d);
+            if (d.id >= 0)
+                rows.insert(d.id, diagnostics.size() - 1);
+            if (d.severity == Severity::Error)
+                errors++;
+            else if (d.severity == Severity::Warning)
+                warnings++;
+        }
+    }
+};
+
+BuildOutputParser::BuildOutputParser(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({ tr("Message"), tr("Location"), tr("Configuration") });
+
+    priv->worker = new QObject;
+    priv->worker->moveToThread(&priv->thread);
+    connect(&priv->thread, &QThread::finished, priv->worker, &QObject::deleteLater);
+    priv->state.context = priv->worker;
+    priv->state.deliver = [this](int generation, const QString& html, const DiagnosticList& list) {
+        QMetaObject::invokeMethod(this, [this, generation, html, list]() {
+            if (generation != priv->generation)
+                return;
+            if (!html.isEmpty())
+                emit htmlReady(html);
+            if (!list.isEmpty()) {
+                priv->append(list);
+                emit diagnosticsChanged();
+            }
+        }, Qt::QueuedConnection);
+    };
+    priv->state.compiling = [this](int generation, const QString& process, const QString& file) {
+        QMetaObject::invokeMethod(this, [this, generation, process, file]() {
+            if (generation == priv->generation)
+                emit compileStarted(process, file);
+        }, Qt::QueuedConnection);
+    };
+    priv->thread.setObjectName("BuildOutputParser");
+    priv->thread.start();
+}
+
+BuildOutputParser::~BuildOutputParser()
+{
+    priv->thread.quit();
+    priv->thread.wait();
+    delete priv;
+}
+
+QStandardItemModel *BuildOutputParser::model() const
+{
+    return priv->model;
+}
+
+BuildOutputParser::DiagnosticList BuildOutputParser::diagnostics() const
+{
+    return priv->diagnostics;
+}
+
+int BuildOutputParser::errorCount() const
+{
+    return priv->errors;
+}
+
+int BuildOutputParser::warningCount() const
+{
+    return priv->warnings;
+}
+
+void BuildOutputParser::setBasePath(const QString &path)
+{
+    priv->basePath = path;
+    auto state = &priv->state;
+    QMetaObject::invokeMethod(priv->worker, [state, path]() { state->basePath = path; }, Qt::QueuedConnection);
+}
+
+void BuildOutputParser::setOrigin(const QString &processName, const QString &origin)
+{
+    auto state = &priv->state;
+    QMetaObject::invokeMethod(priv->worker, [state, processName, origin]() {
+        state->sources[processName].origin = origin;
+    }, Qt::QueuedConnection);
+}
+
+void BuildOutputParser::feed(const QString &source, const QString &text)
+{
+    auto state = &priv->state;
+    QMetaObject::invokeMethod(priv->worker, [state, source, text]() { state->feed(source, text); }, Qt::QueuedConnection);
+}
+
+void BuildOutputParser::finish(const QString &source)
+{
+    auto state = &priv->state;
+    QMetaObject::invokeMethod(priv->worker, [state, source]() { state->finish(source); }, Qt::QueuedConnection);
+}
+
+void BuildOutputParser::clear()
+{
+    auto generation = ++priv->generation;
+    priv->diagnostics.clear();
+    priv->rows.clear();
+    priv->errors = 0;
+    priv->warnings = 0;
+    priv->model->removeRows(0, priv->model->rowCount());
+    auto state = &priv->state;
+    QMetaObject::invokeMethod(priv->worker, [state, generation]() { state->reset(generation); }, Qt::QueuedConnection);
+    emit diagnosticsChanged();
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDOUTPUTPARSER_H
+#define BUILDOUTPUTPARSER_H
+
+#include <QObject>
+#include <QList>
+
+class QStandardItemModel;
+
+class BuildOutputParser : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildOutputParser)
+public:
+    struct Diagnostic {
+        enum class Severity { Note, Warning, Error };
+        struct Note {
+            QString file;
+            int line;
+            int column;
+            QString message;
+        };
+        QString file;
+        int line{ 0 };
+        int column{ 0 };
+        Severity severity{ Severity::Error };
+        QString message;
+        // Build configuration that produced it, empty for plain builds
+        QString origin;
+        QList<Note> notes;
+        // Order in the current build, a note delivered alone names the diagnostic of its own process
+        int id{ -1 };
+        int parent{ -1 };
+    };
+    using DiagnosticList = QList<Diagnostic>;
+
+    static constexpr auto FILE_ROLE = Qt::UserRole + 1;
+    static constexpr auto LINE_ROLE = Qt::UserRole + 2;
+    static constexpr auto COLUMN_ROLE = Qt::UserRole + 3;
+
+    explicit BuildOutputParser(QObject *parent = nullptr);
+    virtual ~BuildOutputParser() override;
+
+    QStandardItemModel *model() const;
+    DiagnosticList diagnostics() const;
+    int errorCount() const;
+    int warningCount() const;
+
+signals:
+    void htmlReady(const QString& html);
+    void diagnosticsChanged();
+    // A compiler command line of that process went past, ahead of its html batch
+    void compileStarted(const QString& processName, const QString& file);
+
+public slots:
+    void setBasePath(const QString& path);
+    // Tags the output of a process, console lines get the tag as prefix
+    void setOrigin(const QString& processName, const QString& origin);
+    void feed(const QString& source, const QString& text);
+    void finish(const QString& source);
+    void clear();
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDOUTPUTPARSER_H
@@ -0,0 +1,183 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildprofiler.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardItemModel>
+
+#include <algorithm>
+
+#include <QtDebug>
+
+static constexpr auto US_PER_SEC = 1000000.0;
+static constexpr auto KB_PER_MB = 1024.0;
+
+static double rounded(double v)
+{
+    constexpr auto DECIMALS = 100.0;
+    return qRound(v * DECIMALS) / DECIMALS;
+}
+
+class BuildProfiler::Priv_t
+{
+public:
+    QStandardItemModel *model{ nullptr };
+    EntryList entries;
+};
+
+BuildProfiler::BuildProfiler(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->model = new QStandardItemModel(this);
+    clear();
+}
+
+BuildProfiler::~BuildProfiler()
+{
+    delete priv;
+}
+
+QString BuildProfiler::wrapperPath()
+{
+    return QDir(QCoreApplication::applicationDirPath()).absoluteFilePath("ccwrap");
+}
+
+BuildProfiler::EntryList BuildProfiler::readLog(const QString &logPath)
+{
+    EntryList list;
+    QFile f(logPath);
+    if (!f.open(QFile::ReadOnly))
+        return list;
+    while (!f.atEnd()) {
+        auto o = QJsonDocument::fromJson(f.readLine()).object();
+        if (o.isEmpty())
+            continue;
+        Entry e;
+        auto cwd = QDir(o.value("cwd").toString());
+        e.file = QDir::cleanPath(cwd.absoluteFilePath(o.value("file").toString()));
+        e.output = QDir::cleanPath(cwd.absoluteFilePath(o.value("output").toString()));
+        e.link = o.value("kind").toString() == "link";
+        e.start = qint64(o.value("start").toDouble());
+        e.end = qint64(o.value("end").toDouble());
+        e.userUs = qint64(o.value("user").toDouble());
+        e.sysUs = qint64(o.value("sys").toDouble());
+        e.maxRssKb = qint64(o.value("rss").toDouble());
+        e.exitCode = o.value("exit").toInt();
+        list.append(e);
+    }
+    return list;
+}
+
+bool BuildProfiler::writeChromeTrace(const EntryList &entries, const QString &tracePath)
+{
+    auto sorted = entries;
+    std::sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) { return a.start < b.start; });
+    auto origin = sorted.isEmpty()? 0 : sorted.first().start;
+    // Greedy lanes so concurrent compiles show as parallel rows like make -j runs them
+    QList<qint64> laneEnds;
+    QJsonArray events;
+    for(const auto& e: sorted) {
+        int lane = 0;
+        while (lane < laneEnds.size() && laneEnds.at(lane) > e.start)
+            lane++;
+        if (lane == laneEnds.size())
+            laneEnds.append(e.end);
+        else
+            laneEnds[lane] = e.end;
+        events.append(QJsonObject{
+            { "name", QFileInfo(e.file).fileName() },
+            { "cat", e.link? "link" : "compile" },
+            { "ph", "X" },
+            { "ts", e.start - origin },
+            { "dur", e.end - e.start },
+            { "pid", 1 },
+            { "tid", lane },
+            { "args", QJsonObject{
+                  { "file", e.file },
+                  { "cpu_ms", (e.userUs + e.sysUs) / 1000 },
+                  { "max_rss_kb", e.maxRssKb },
+                  { "exit", e.exitCode },
+              } },
+        });
+    }
+    QFile f(tracePath);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    f.write(QJsonDocument(QJsonObject{
+        { "traceEvents", events },
+        { "displayTimeUnit", "ms" },
+    }).toJson(QJsonDocument::Compact));
+    return true;
+}
+
+QStandardItemModel *BuildProfiler::model() const
+{
+    return priv->model;
+}
+
+BuildProfiler::EntryList BuildProfiler::entries() const
+{
+    return priv->entries;
+}
+
+void BuildProfiler::load(const QString &logPath)
+{
+    clear();
+    priv->entries = readLog(logPath);
+    if (priv->entries.isEmpty())
+        return;
+    for(const auto& e: priv->entries) {
+        auto fileItem = new QStandardItem(QFileInfo(e.file).fileName());
+        fileItem->setToolTip(e.file);
+        fileItem->setData(e.file, FILE_ROLE);
+        auto kindItem = new QStandardItem(e.link? tr("link") : tr("compile"));
+        auto wallItem = new QStandardItem;
+        wallItem->setData(rounded((e.end - e.start) / US_PER_SEC), Qt::DisplayRole);
+        auto cpuItem = new QStandardItem;
+        cpuItem->setData(rounded((e.userUs + e.sysUs) / US_PER_SEC), Qt::DisplayRole);
+        auto rssItem = new QStandardItem;
+        rssItem->setData(rounded(e.maxRssKb / KB_PER_MB), Qt::DisplayRole);
+        QList<QStandardItem*> row{ fileItem, kindItem, wallItem, cpuItem, rssItem };
+        for(auto item: row) {
+            item->setEditable(false);
+            if (e.exitCode != 0)
+                item->setForeground(Qt::red);
+        }
+        priv->model->appendRow(row);
+    }
+    priv->model->sort(2, Qt::DescendingOrder);
+    auto tracePath = QFileInfo(logPath).absoluteDir().absoluteFilePath(
+                QFileInfo(logPath).completeBaseName() + ".trace.json");
+    if (writeChromeTrace(priv->entries, tracePath))
+        emit profileReady(tracePath);
+}
+
+void BuildProfiler::clear()
+{
+    priv->entries.clear();
+    priv->model->clear();
+    priv->model->setHorizontalHeaderLabels({ tr("File"), tr("Kind"), tr("Wall (s)"), tr("CPU (s)"), tr("Peak RSS (MB)") });
+}
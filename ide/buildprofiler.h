@@ -0,0 +1,70 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDPROFILER_H
+#define BUILDPROFILER_H
+
+#include <QList>
+#include <QObject>
+
+class QStandardItemModel;
+
+class BuildProfiler : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildProfiler)
+public:
+    struct Entry {
+        QString file;
+        QString output;
+        bool link{ false };
+        qint64 start{ 0 };
+        qint64 end{ 0 };
+        qint64 userUs{ 0 };
+        qint64 sysUs{ 0 };
+        qint64 maxRssKb{ 0 };
+        int exitCode{ 0 };
+    };
+    using EntryList = QList<Entry>;
+
+    static constexpr auto FILE_ROLE = Qt::UserRole + 1;
+
+    explicit BuildProfiler(QObject *parent = nullptr);
+    virtual ~BuildProfiler() override;
+
+    static QString wrapperPath();
+    static EntryList readLog(const QString& logPath);
+    static bool writeChromeTrace(const EntryList& entries, const QString& tracePath);
+
+    QStandardItemModel *model() const;
+    EntryList entries() const;
+
+signals:
+    void profileReady(const QString& tracePath);
+
+public slots:
+    // Loads the wrapper log of a finished build and writes its trace next to it
+    void load(const QString& logPath);
+    void clear();
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDPROFILER_H
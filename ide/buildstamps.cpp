@@ -0,0 +1,333 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "buildstamps.h"
+#include "childprocess.h"
+#include "jobserver.h"
+#include "projectfilewatcher.h"
+#include "projectmanager.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+
+#include <QtDebug>
+
+namespace {
+
+struct Stamp {
+    qint64 time{ 0 };
+    QStringList outputs;
+    // Leaves of the graph make walked for this target, empty until the post build dump is read
+    QStringList inputs;
+};
+
+struct FileRule {
+    QStringList prerequisites;
+    bool recipe{ false };
+};
+
+const QRegularExpression RULE_RE{ R"(^([^#\s%][^%=]*?)::?(?:\s+([^#=]*?))?\s*$)" };
+
+// Files section of make -p, after make resolved pattern rules and read the included .d files
+QHash<QString, FileRule> parseDatabase(const QByteArray& data)
+{
+    QHash<QString, FileRule> rules;
+    QString current;
+    auto inFiles = false;
+    auto notTarget = false;
+    for(const auto& raw: data.split('\n')) {
+        auto line = QString::fromLocal8Bit(raw);
+        if (line.startsWith("# Files")) {
+            inFiles = true;
+            continue;
+        }
+        if (!inFiles)
+            continue;
+        if (line.startsWith("# files hash-table stats") || line.startsWith("# VPATH"))
+            break;
+        if (line.trimmed().isEmpty()) {
+            current.clear();
+            notTarget = false;
+        } else if (line.startsWith("# Not a target:")) {
+            notTarget = true;
+        } else if (line.startsWith('\t') || line.startsWith("#  recipe to execute")) {
+            if (!current.isEmpty())
+                rules[current].recipe = true;
+        } else if (!line.startsWith('#') && !notTarget) {
+            auto m = RULE_RE.match(line);
+            if (!m.hasMatch())
+                continue;
+            current = m.captured(1);
+            // Order-only prerequisites never make a target out of date
+            auto deps = m.captured(2).section('|', 0, 0).split(' ', QString::SkipEmptyParts);
+            rules[current].prerequisites.append(deps);
+        }
+    }
+    return rules;
+}
+
+// Compiler written dependencies of an object, also when the makefile does not include them
+QStringList dependencyFileOf(const QString& object)
+{
+    QFileInfo info(object);
+    if (info.suffix() != "o" && info.suffix() != "obj")
+        return {};
+    QFile f(info.dir().absoluteFilePath(info.completeBaseName() + ".d"));
+    if (!f.open(QFile::ReadOnly))
+        return {};
+    auto text = QString::fromLocal8Bit(f.readAll()).replace("\\\n", " ");
+    QStringList deps;
+    for(const auto& line: text.split('\n')) {
+        auto colon = line.indexOf(": ");
+        if (colon > 0)
+            deps += line.mid(colon + 2).split(' ', QString::SkipEmptyParts);
+    }
+    return deps;
+}
+
+// False when some output has no known prerequisites, make must decide about those
+bool collectFiles(const QHash<QString, FileRule>& rules, const QString& target, const QString& base,
+                  QStringList *inputs, QStringList *outputs)
+{
+    const auto phony = rules.value(".PHONY").prerequisites;
+    QSet<QString> seen;
+    QStringList queue{ target };
+    while (!queue.isEmpty()) {
+        auto name = queue.takeFirst();
+        if (seen.contains(name))
+            continue;
+        seen.insert(name);
+        auto path = QDir::cleanPath(QDir(base).absoluteFilePath(name));
+        auto it = rules.constFind(name);
+        if (it == rules.constEnd() || (!it->recipe && it->prerequisites.isEmpty())) {
+            inputs->append(path);
+            continue;
+        }
+        auto deps = it->prerequisites;
+        if (!phony.contains(name)) {
+            // FORCE style and generated files without prerequisites are remade every time
+            if (deps.isEmpty())
+                return false;
+            outputs->append(path);
+            deps += dependencyFileOf(path);
+        }
+        queue += deps;
+    }
+    return true;
+}
+
+}
+
+class BuildStamps::Priv_t
+{
+public:
+    BuildStamps *q{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QHash<QString, Stamp> stamps;
+    // Targets whose inputs were stat-ed once this session, the watcher covers them afterwards
+    QSet<QString> verified;
+    QHash<QString, qint64> touched;
+
+    QString stampFile() const {
+        auto dir = AppConfig::ensureExist(QDir(AppConfig::instance().workspacePath()).absoluteFilePath("build-stamps"));
+        return QDir(dir).absoluteFilePath(QString("%1.json").arg(proj->projectName()));
+    }
+
+    QString absolute(const QString& name) const {
+        return QDir::cleanPath(QDir(proj->projectPath()).absoluteFilePath(name));
+    }
+
+    // The discover database misses header and pattern rule prerequisites, only a watch set guess
+    QStringList closureInputs(const QSet<QString>& closure) const {
+        QStringList inputs;
+        for(const auto& name: closure) {
+            auto deps = proj->dependenciesForTarget(name);
+            deps.removeAll(QString());
+            if (deps.isEmpty())
+                inputs.append(absolute(name));
+        }
+        inputs.append(proj->projectFile());
+        return inputs;
+    }
+
+    // Asks make itself what the target depends on now that the .d files of this build exist
+    void refresh(const QString& target, qint64 time) {
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(proj->projectPath())
+                .setenv({ { "LC_ALL", "C" } })
+                .makeDeleteLater();
+        p.setStandardErrorFile(QProcess::nullDevice());
+        p.onFinished([this, target, time](QProcess *make, int code) {
+            auto it = stamps.find(target);
+            if (it == stamps.end() || it->time != time)
+                return; // Rebuilt or invalidated meanwhile
+            QStringList inputs;
+            QStringList outputs;
+            if (code != 0 || make->exitStatus() != QProcess::NormalExit ||
+                    !collectFiles(parseDatabase(make->readAllStandardOutput()), target, proj->projectPath(), &inputs, &outputs))
+                return;
+            inputs.append(proj->projectFile());
+            inputs.removeDuplicates();
+            it->inputs = inputs;
+            it->outputs.clear();
+            for(const auto& path: outputs)
+                if (QFileInfo::exists(path))
+                    it->outputs.append(path);
+            // New inputs were never stat-ed against this stamp
+            verified.remove(target);
+            save();
+            emit q->inputsChanged(target);
+        });
+        JobServer::instance().startWithToken(&p, "make", { "-p", "-n", "-f", proj->projectFile(), target });
+    }
+
+    void load() {
+        stamps.clear();
+        verified.clear();
+        touched.clear();
+        QFile f(stampFile());
+        if (!f.open(QFile::ReadOnly))
+            return;
+        auto root = QJsonDocument::fromJson(f.readAll()).object();
+        if (root.value("project").toString() != proj->projectPath())
+            return; // Another project with the same directory name
+        const auto targets = root.value("targets").toObject();
+        for(auto it = targets.begin(); it != targets.end(); ++it) {
+            auto o = it.value().toObject();
+            Stamp s;
+            s.time = qint64(o.value("time").toDouble());
+            for(const auto& v: o.value("outputs").toArray())
+                s.outputs.append(v.toString());
+            for(const auto& v: o.value("inputs").toArray())
+                s.inputs.append(v.toString());
+            stamps.insert(it.key(), s);
+        }
+    }
+
+    void save() const {
+        QJsonObject targets;
+        for(auto it = stamps.begin(); it != stamps.end(); ++it)
+            targets.insert(it.key(), QJsonObject{
+                { "time", double(it->time) },
+                { "outputs", QJsonArray::fromStringList(it->outputs) },
+                { "inputs", QJsonArray::fromStringList(it->inputs) }
+            });
+        QFile f(stampFile());
+        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+            qDebug() << "can not write" << f.fileName() << f.errorString();
+            return;
+        }
+        f.write(QJsonDocument(QJsonObject{
+            { "project", proj->projectPath() },
+            { "targets", targets }
+        }).toJson(QJsonDocument::Compact));
+    }
+};
+
+BuildStamps::BuildStamps(ProjectManager *proj, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+    priv->proj = proj;
+    auto watcher = proj->fileWatcher();
+    auto touch = [this](const QString& path) { priv->touched.insert(path, QDateTime::currentMSecsSinceEpoch()); };
+    connect(watcher, &ProjectFileWatcher::fileChanged, this, touch);
+    connect(watcher, &ProjectFileWatcher::fileRemoved, this, touch);
+    connect(proj, &ProjectManager::projectOpened, this, [this]() { priv->load(); });
+    connect(proj, &ProjectManager::projectClosed, this, [this]() {
+        priv->stamps.clear();
+        priv->verified.clear();
+        priv->touched.clear();
+    });
+}
+
+BuildStamps::~BuildStamps()
+{
+    delete priv;
+}
+
+bool BuildStamps::isUpToDate(const QString &target)
+{
+    auto it = priv->stamps.constFind(target);
+    // Without the graph make used last time a changed header could go unnoticed
+    if (it == priv->stamps.constEnd() || it->inputs.isEmpty())
+        return false;
+    auto watcher = priv->proj->fileWatcher();
+    if (watcher->isScanning() || !watcher->isComplete() || watcher->hasPendingChanges())
+        return false;
+
+    auto root = watcher->rootPath() + '/';
+    auto verify = !priv->verified.contains(target);
+    for(const auto& path: it->inputs) {
+        if (priv->touched.value(path) >= it->time)
+            return false;
+        // Files outside the project (toolchain headers) are never watched
+        if (verify || !path.startsWith(root)) {
+            QFileInfo info(path);
+            // A missing prerequisite is a FORCE style rule or an error, make must decide
+            if (!info.exists() || info.lastModified().toMSecsSinceEpoch() >= it->time)
+                return false;
+        }
+    }
+    for(const auto& path: it->outputs)
+        if ((verify || priv->touched.contains(path)) && !QFileInfo::exists(path))
+            return false;
+    priv->verified.insert(target);
+    return true;
+}
+
+QStringList BuildStamps::inputs(const QString &target, const QSet<QString> &closure) const
+{
+    auto it = priv->stamps.constFind(target);
+    if (it != priv->stamps.constEnd() && !it->inputs.isEmpty())
+        return it->inputs;
+    return priv->closureInputs(closure);
+}
+
+bool BuildStamps::hasRecordedInputs(const QString &target) const
+{
+    auto it = priv->stamps.constFind(target);
+    return it != priv->stamps.constEnd() && !it->inputs.isEmpty();
+}
+
+void BuildStamps::markBuilt(const QString &target, qint64 startedAt)
+{
+    Stamp s;
+    s.time = startedAt;
+    priv->stamps.insert(target, s);
+    priv->verified.remove(target);
+    priv->save();
+    priv->refresh(target, startedAt);
+}
+
+void BuildStamps::invalidate(const QString &target)
+{
+    priv->verified.remove(target);
+    if (priv->stamps.remove(target) > 0)
+        priv->save();
+}
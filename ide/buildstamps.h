@@ -0,0 +1,52 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDSTAMPS_H
+#define BUILDSTAMPS_H
+
+#include <QObject>
+#include <QSet>
+
+class ProjectManager;
+
+class BuildStamps : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildStamps)
+public:
+    explicit BuildStamps(ProjectManager *proj, QObject *parent = nullptr);
+    virtual ~BuildStamps() override;
+
+    // True when target built fine before and no file make checked for it changed since
+    bool isUpToDate(const QString& target);
+    // Also reads back from make the files the target really depends on, see inputsChanged()
+    void markBuilt(const QString& target, qint64 startedAt);
+    void invalidate(const QString& target);
+    // Absolute paths of the target inputs, the discover closure guess until a build recorded them
+    QStringList inputs(const QString& target, const QSet<QString>& closure) const;
+    bool hasRecordedInputs(const QString& target) const;
+
+signals:
+    void inputsChanged(const QString& target);
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDSTAMPS_H
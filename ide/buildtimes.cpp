@@ -0,0 +1,395 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "buildprofiler.h"
+#include "buildtimes.h"
+#include "childprocess.h"
+#include "jobserver.h"
+#include "projectfilewatcher.h"
+#include "projectmanager.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTimer>
+
+#include <QtDebug>
+
+static constexpr auto DEFAULT_FILE_MS = 1000;
+// Weight of the newest sample against the remembered duration
+static constexpr auto SAMPLE_WEIGHT = 0.5;
+static constexpr auto TICK_MS = 1000;
+static constexpr auto PERCENT = 100;
+// The link step after the last compile line is not covered by file weights
+static constexpr auto MAX_RUNNING_PERCENT = 99;
+// Saving several files in a row asks for one dry run
+static constexpr auto PLAN_REFRESH_DELAY_MS = 2000;
+
+namespace {
+
+const QRegularExpression COMPILE_FLAG_RE{ R"((^|\s)-c(\s|$))" };
+const QRegularExpression SPACES_RE{ R"(\s+)" };
+const QRegularExpression MAKE_DIRECTORY_RE{
+    R"(^g?make(?:\[\d+\])?: (Entering|Leaving) directory [`'"](.*)['"]$)" };
+const QStringList SOURCE_SUFFIXES{ "c", "cc", "cp", "cpp", "cxx", "c++", "C", "s", "S", "sx", "m", "mm" };
+const QStringList OPTIONS_WITH_VALUE{ "-o", "-MF", "-MT", "-MQ", "-include", "-x" };
+
+struct Run {
+    QString key;
+    int parallelism{ 1 };
+    QElapsedTimer elapsed;
+    bool expectedKnown{ false };
+    QSet<QString> expected;
+    QSet<QString> seen;
+    QHash<QString, qint64> samples;
+    QString lastFile;
+    qint64 lastSeenMs{ 0 };
+};
+
+// What the next build of a target would compile, learned by a dry run outside of the build
+struct Plan {
+    QStringList makeArgs;
+    bool known{ false };
+    QSet<QString> expected;
+    QPointer<ChildProcess> dryRun;
+};
+
+QString resolve(const QStringList& dirs, const QString& base, const QString& file)
+{
+    auto dir = dirs.isEmpty()? base : dirs.last();
+    return QDir::cleanPath(QDir(dir).absoluteFilePath(file));
+}
+
+qint64 blend(qint64 old, qint64 sample)
+{
+    return old < 0? sample : old + qint64(SAMPLE_WEIGHT * (sample - old));
+}
+
+}
+
+class BuildTimes::Priv_t
+{
+public:
+    BuildTimes *q{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QHash<QString, qint64> targets;
+    QHash<QString, qint64> files;
+    QHash<QString, Run> runs;
+    QHash<QString, Plan> plans;
+    QTimer ticker;
+    QTimer planTimer;
+
+    QString dataFile() const {
+        auto dir = AppConfig::ensureExist(QDir(AppConfig::instance().workspacePath()).absoluteFilePath("build-times"));
+        return QDir(dir).absoluteFilePath(QString("%1.json").arg(proj->projectName()));
+    }
+
+    void load() {
+        targets.clear();
+        files.clear();
+        QFile f(dataFile());
+        if (!f.open(QFile::ReadOnly))
+            return;
+        auto root = QJsonDocument::fromJson(f.readAll()).object();
+        if (root.value("project").toString() != proj->projectPath())
+            return; // Another project with the same directory name
+        const auto t = root.value("targets").toObject();
+        for(auto it = t.begin(); it != t.end(); ++it)
+            targets.insert(it.key(), qint64(it.value().toDouble()));
+        const auto s = root.value("files").toObject();
+        for(auto it = s.begin(); it != s.end(); ++it)
+            files.insert(it.key(), qint64(it.value().toDouble()));
+    }
+
+    void save() const {
+        QJsonObject t;
+        for(auto it = targets.begin(); it != targets.end(); ++it)
+            t.insert(it.key(), double(it.value()));
+        QJsonObject s;
+        for(auto it = files.begin(); it != files.end(); ++it)
+            s.insert(it.key(), double(it.value()));
+        QFile f(dataFile());
+        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+            qDebug() << "can not write" << f.fileName() << f.errorString();
+            return;
+        }
+        f.write(QJsonDocument(QJsonObject{
+            { "project", proj->projectPath() },
+            { "targets", t },
+            { "files", s }
+        }).toJson(QJsonDocument::Compact));
+    }
+
+    // Files never compiled before weigh as much as the known ones around them
+    qint64 meanWeight(const QSet<QString>& set) const {
+        qint64 sum = 0;
+        int count = 0;
+        for(const auto& f: set) {
+            auto w = files.value(f, -1);
+            if (w >= 0) {
+                sum += w;
+                count++;
+            }
+        }
+        if (count == 0) {
+            for(auto w: files) {
+                sum += w;
+                count++;
+            }
+        }
+        return count > 0? qMax(sum / count, qint64(1)) : DEFAULT_FILE_MS;
+    }
+
+    void dropDryRun(Plan& plan) {
+        if (!plan.dryRun)
+            return;
+        // Still waiting for a job token, dropping it takes it off the queue
+        if (plan.dryRun->state() == QProcess::NotRunning)
+            plan.dryRun->deleteLater();
+        else
+            plan.dryRun->stop();
+        plan.dryRun.clear();
+    }
+
+    void refreshPlan(const QString& key) {
+        auto& plan = plans[key];
+        dropDryRun(plan);
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(proj->projectPath())
+                .makeDeleteLater();
+        p.setStandardErrorFile(QProcess::nullDevice());
+        p.onFinished([this, key](QProcess *make, int) {
+            auto it = plans.find(key);
+            if (it == plans.end() || it->dryRun.data() != make || make->exitStatus() != QProcess::NormalExit)
+                return;
+            it->expected = parseDryRun(QString::fromLocal8Bit(make->readAllStandardOutput()));
+            it->known = true;
+        });
+        plan.dryRun = &p;
+        // -w prints every directory change, compile lines are relative to those.
+        // Held while a build runs, so it never competes with one
+        JobServer::instance().startWithToken(&p, "make", QStringList{ "-n", "-w" } + plan.makeArgs);
+    }
+
+    QSet<QString> parseDryRun(const QString& text) const {
+        QSet<QString> set;
+        QStringList dirs;
+        for(auto line: text.split('\n')) {
+            if (line.endsWith('\r'))
+                line.chop(1);
+            if (followDirectory(line, &dirs))
+                continue;
+            auto source = compiledSource(line);
+            if (!source.isEmpty())
+                set.insert(resolve(dirs, proj->projectPath(), source));
+        }
+        return set;
+    }
+};
+
+BuildTimes::BuildTimes(ProjectManager *proj, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+    priv->proj = proj;
+    priv->ticker.setInterval(TICK_MS);
+    priv->planTimer.setInterval(PLAN_REFRESH_DELAY_MS);
+    priv->planTimer.setSingleShot(true);
+    connect(&priv->planTimer, &QTimer::timeout, this, [this]() {
+        for(const auto& key: priv->plans.keys())
+            priv->refreshPlan(key);
+    });
+    auto changed = [this]() {
+        if (priv->plans.isEmpty())
+            return;
+        // A dry run already going may have read the old contents
+        for(auto& plan: priv->plans) {
+            plan.known = false;
+            priv->dropDryRun(plan);
+        }
+        priv->planTimer.start();
+    };
+    connect(proj->fileWatcher(), &ProjectFileWatcher::fileChanged, this, changed);
+    connect(proj->fileWatcher(), &ProjectFileWatcher::fileRemoved, this, changed);
+    // The ETA moves even when make prints nothing
+    connect(&priv->ticker, &QTimer::timeout, this, &BuildTimes::progressChanged);
+    connect(proj, &ProjectManager::projectOpened, this, [this]() { priv->load(); });
+    connect(proj, &ProjectManager::projectClosed, this, [this]() {
+        priv->runs.clear();
+        for(auto& plan: priv->plans)
+            priv->dropDryRun(plan);
+        priv->plans.clear();
+        priv->planTimer.stop();
+        priv->targets.clear();
+        priv->files.clear();
+        priv->ticker.stop();
+    });
+}
+
+BuildTimes::~BuildTimes()
+{
+    delete priv;
+}
+
+QString BuildTimes::compiledSource(const QString &line)
+{
+    if (!COMPILE_FLAG_RE.match(line).hasMatch())
+        return QString();
+    const auto tokens = line.split(SPACES_RE, QString::SkipEmptyParts);
+    for(int i = 0; i < tokens.size(); i++) {
+        auto t = tokens.at(i);
+        if (t.size() > 1 && (t.startsWith('"') || t.startsWith('\'')) && t.endsWith(t.at(0)))
+            t = t.mid(1, t.size() - 2);
+        if (OPTIONS_WITH_VALUE.contains(t)) {
+            i++;
+            continue;
+        }
+        if (!t.startsWith('-') && SOURCE_SUFFIXES.contains(QFileInfo(t).suffix()))
+            return t;
+    }
+    return QString();
+}
+
+bool BuildTimes::followDirectory(const QString &line, QStringList *dirs)
+{
+    auto m = MAKE_DIRECTORY_RE.match(line);
+    if (!m.hasMatch())
+        return false;
+    if (m.captured(1) == "Entering")
+        dirs->append(m.captured(2));
+    else if (!dirs->isEmpty())
+        dirs->removeLast();
+    return true;
+}
+
+void BuildTimes::begin(const QString &processName, const QString &key, const QStringList &makeArgs, int parallelism)
+{
+    Run run;
+    run.key = key;
+    run.parallelism = qMax(parallelism, 1);
+    run.elapsed.start();
+    // A second make walking the tree would slow the build down, the plan from the last refresh is used instead
+    auto& plan = priv->plans[key];
+    if (plan.makeArgs != makeArgs) {
+        plan.makeArgs = makeArgs;
+        plan.known = false;
+    }
+    run.expectedKnown = plan.known;
+    run.expected = plan.expected;
+    priv->runs.insert(processName, run);
+    priv->ticker.start();
+    emit progressChanged();
+}
+
+void BuildTimes::compileSeen(const QString &processName, const QString &file)
+{
+    auto it = priv->runs.find(processName);
+    if (it == priv->runs.end() || it->seen.contains(file))
+        return;
+    auto now = it->elapsed.elapsed();
+    // Lines come out as jobs finish, so a gap is roughly one job duration over the job count.
+    // The first burst fills every job slot at once and says nothing
+    if (!it->lastFile.isEmpty() && it->seen.size() > it->parallelism)
+        it->samples.insert(it->lastFile, (now - it->lastSeenMs) * it->parallelism);
+    it->lastFile = file;
+    it->lastSeenMs = now;
+    it->seen.insert(file);
+    emit progressChanged();
+}
+
+void BuildTimes::end(const QString &processName, bool succeeded, const QString &profileLog)
+{
+    auto it = priv->runs.find(processName);
+    if (it == priv->runs.end())
+        return;
+    auto run = *it;
+    priv->runs.erase(it);
+    // Starts once the build queue drains, ready for the next build of the same target.
+    // Without watched files (headless) nothing would keep the plan current
+    if (!priv->proj->fileWatcher()->rootPath().isEmpty())
+        priv->refreshPlan(run.key);
+    if (succeeded) {
+        priv->targets.insert(run.key, blend(priv->targets.value(run.key, -1), run.elapsed.elapsed()));
+        if (!profileLog.isEmpty()) {
+            constexpr auto USEC_PER_MSEC = 1000;
+            for(const auto& e: BuildProfiler::readLog(profileLog))
+                if (!e.link && e.exitCode == 0)
+                    priv->files.insert(e.file, blend(priv->files.value(e.file, -1), (e.end - e.start) / USEC_PER_MSEC));
+        } else {
+            for(auto s = run.samples.begin(); s != run.samples.end(); ++s)
+                priv->files.insert(s.key(), blend(priv->files.value(s.key(), -1), s.value()));
+        }
+        priv->save();
+    }
+    if (priv->runs.isEmpty())
+        priv->ticker.stop();
+    emit progressChanged();
+}
+
+BuildTimes::Progress BuildTimes::progress() const
+{
+    Progress p;
+    double fractions = 0.0;
+    int estimated = 0;
+    for(const auto& run: priv->runs) {
+        auto elapsed = run.elapsed.elapsed();
+        auto history = priv->targets.value(run.key, -1);
+        auto fraction = -1.0;
+        qint64 remaining = -1;
+        if (run.expectedKnown && !run.expected.isEmpty()) {
+            auto all = run.expected;
+            all.unite(run.seen);
+            auto fallback = priv->meanWeight(all);
+            double total = 0.0;
+            double done = 0.0;
+            for(const auto& f: all) {
+                auto w = priv->files.value(f, fallback);
+                total += w;
+                if (run.seen.contains(f))
+                    done += w;
+            }
+            fraction = done / total;
+            if (done > 0.0)
+                remaining = qint64((total - done) * elapsed / done);
+            else if (history > 0)
+                remaining = qMax(history - elapsed, qint64(0));
+        } else if (history > 0) {
+            // Nothing to compile, or make prints no compiler lines: time is the only hint
+            fraction = qMin(double(elapsed) / history, 1.0);
+            remaining = qMax(history - elapsed, qint64(0));
+        }
+        if (fraction < 0.0)
+            continue;
+        fractions += fraction;
+        estimated++;
+        p.etaMs = qMax(p.etaMs, remaining);
+    }
+    if (estimated > 0)
+        p.percent = qMin(int(fractions / estimated * PERCENT), MAX_RUNNING_PERCENT);
+    return p;
+}
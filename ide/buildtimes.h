@@ -0,0 +1,63 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDTIMES_H
+#define BUILDTIMES_H
+
+#include <QObject>
+#include <QStringList>
+
+class ProjectManager;
+
+class BuildTimes : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildTimes)
+public:
+    struct Progress {
+        // -1 while there is nothing to estimate from
+        int percent{ -1 };
+        qint64 etaMs{ -1 };
+    };
+
+    explicit BuildTimes(ProjectManager *proj, QObject *parent = nullptr);
+    virtual ~BuildTimes() override;
+
+    // Source file a compiler command line works on, empty for any other line
+    static QString compiledSource(const QString& line);
+    // Follows the directory changes make -w prints, true when the line was one of them
+    static bool followDirectory(const QString& line, QStringList *dirs);
+
+    // Which sources this build will compile comes from a background dry run with the same arguments,
+    // refreshed after each build of that target and whenever project files change
+    void begin(const QString& processName, const QString& key, const QStringList& makeArgs, int parallelism);
+    void compileSeen(const QString& processName, const QString& file);
+    // Durations of a successful build are kept, the profile log gives exact per file times
+    void end(const QString& processName, bool succeeded, const QString& profileLog = QString());
+
+    Progress progress() const;
+
+signals:
+    void progressChanged();
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDTIMES_H
@@ -0,0 +1,156 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildmanager.h"
+#include "buildwatcher.h"
+#include "projectfilewatcher.h"
+#include "projectmanager.h"
+#include "textmessagebrocker.h"
+
+#include <QDir>
+#include <QSet>
+#include <QTimer>
+
+#include <QtDebug>
+
+// On top of the file watcher coalescing, short enough to answer a save within a second
+static constexpr auto DEBOUNCE_MS = 150;
+
+class BuildWatcher::Priv_t
+{
+public:
+    BuildManager *builder{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QString target;
+    QSet<QString> inputs;
+    QStringList changed;
+    QStringList pendingNames;
+    bool rediscovering{ false };
+    QTimer debounce;
+
+    void refresh() {
+        inputs.clear();
+        if (!target.isEmpty())
+            inputs = builder->inputsOf(target).toSet();
+    }
+
+    QString shortName(const QString& path) const {
+        return QDir(proj->projectPath()).relativeFilePath(path);
+    }
+};
+
+BuildWatcher::BuildWatcher(BuildManager *builder, ProjectManager *proj, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->builder = builder;
+    priv->proj = proj;
+    priv->debounce.setSingleShot(true);
+    priv->debounce.setInterval(DEBOUNCE_MS);
+
+    auto onChange = [this](const QString& path) {
+        if (priv->target.isEmpty() || !priv->inputs.contains(path))
+            return;
+        if (!priv->changed.contains(path))
+            priv->changed.append(path);
+        priv->debounce.start();
+    };
+    connect(proj->fileWatcher(), &ProjectFileWatcher::fileChanged, this, onChange);
+    connect(proj->fileWatcher(), &ProjectFileWatcher::fileRemoved, this, onChange);
+    connect(proj, &ProjectManager::projectClosed, this, [this]() { setTarget(QString()); });
+    // Headers and pattern rule sources only show up once make told what it checked
+    connect(builder, &BuildManager::inputsChanged, this, [this](const QString& target) {
+        if (target == priv->target)
+            priv->refresh();
+    });
+    connect(proj, &ProjectManager::discoverFinished, this, [this](bool ok) {
+        if (ok)
+            priv->refresh();
+        if (priv->rediscovering) {
+            priv->rediscovering = false;
+            rebuild();
+        }
+    });
+
+    connect(&priv->debounce, &QTimer::timeout, this, [this]() {
+        for(const auto& path: priv->changed)
+            if (!priv->pendingNames.contains(priv->shortName(path)))
+                priv->pendingNames.append(priv->shortName(path));
+        auto makefileChanged = priv->changed.contains(priv->proj->projectFile());
+        priv->changed.clear();
+        if (priv->rediscovering)
+            return; // Built once the new rule graph is known
+        if (makefileChanged) {
+            // The running build follows the old rules, the rebuild must follow the new graph
+            priv->rediscovering = true;
+            if (priv->builder->runningTargets().contains(priv->target))
+                priv->builder->cancelBuild(priv->target);
+            priv->proj->rediscover();
+            return;
+        }
+        rebuild();
+    });
+}
+
+void BuildWatcher::rebuild()
+{
+    auto names = priv->pendingNames;
+    priv->pendingNames.clear();
+    if (priv->target.isEmpty())
+        return;
+    emit triggered(priv->target);
+    // The running build works on stale sources, restarting gets feedback sooner than waiting
+    auto restart = priv->builder->runningTargets().contains(priv->target);
+    TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG,
+        tr(R"(<font color="blue">%1 changed, %2 %3</font><br>)")
+            .arg(names.join(", ").toHtmlEscaped(),
+                 restart? tr("restarting build of") : tr("building"),
+                 priv->target.toHtmlEscaped()));
+    if (restart)
+        priv->builder->cancelBuild(priv->target);
+    priv->builder->startBuild(priv->target);
+}
+
+BuildWatcher::~BuildWatcher()
+{
+    delete priv;
+}
+
+QString BuildWatcher::target() const
+{
+    return priv->target;
+}
+
+void BuildWatcher::setTarget(const QString &target)
+{
+    if (target == priv->target)
+        return;
+    priv->target = target;
+    priv->changed.clear();
+    priv->pendingNames.clear();
+    priv->rediscovering = false;
+    priv->debounce.stop();
+    priv->refresh();
+    if (!target.isEmpty()) {
+        auto text = priv->builder->inputsRecorded(target)?
+                    tr(R"(<font color="blue">Watching %1: saving any of its %2 input files rebuilds it</font><br>)") :
+                    tr(R"(<font color="blue">Watching %1: %2 input files known so far, headers are added after its next successful build</font><br>)");
+        TextMessageBrocker::instance().publish(TextMessages::STDOUT_LOG, text.arg(target.toHtmlEscaped()).arg(priv->inputs.size()));
+    }
+    emit targetChanged(target);
+}
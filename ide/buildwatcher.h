@@ -0,0 +1,53 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILDWATCHER_H
+#define BUILDWATCHER_H
+
+#include <QObject>
+
+class BuildManager;
+class ProjectManager;
+
+class BuildWatcher : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(BuildWatcher)
+public:
+    explicit BuildWatcher(BuildManager *builder, ProjectManager *proj, QObject *parent = nullptr);
+    virtual ~BuildWatcher() override;
+
+    QString target() const;
+
+signals:
+    void targetChanged(const QString& target);
+    // Emitted right before the rebuild is handed to the build manager
+    void triggered(const QString& target);
+
+public slots:
+    // Rebuilds target whenever one of its inputs changes on disk, empty stops watching
+    void setTarget(const QString& target);
+
+private:
+    void rebuild();
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // BUILDWATCHER_H
@@ -18,21 +18,244 @@
  */
 #include "childprocess.h"
 
-QProcess *ChildProcess::safeStop(QProcess *p, int timeoutMilis)
-{
-    p->blockSignals(true);
-    if (p->state() == QProcess::Running) {
-        p->terminate();
-        p->waitForFinished(timeoutMilis);
-        if (p->state() == QProcess::Running) {
-            p->kill();
-            p->waitForFinished(timeoutMilis);
+#include "processhistory.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <csignal>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+#include <QtDebug>
+
+static constexpr auto BACKGROUND_NICE = 10;
+static constexpr auto USAGE_SAMPLE_MS = 500;
+
+#ifdef Q_OS_LINUX
+// From linux/ioprio.h, not always installed with the libc headers
+static constexpr auto IOPRIO_WHO_PROCESS = 1;
+static constexpr auto IOPRIO_CLASS_IDLE = 3;
+static constexpr auto IOPRIO_CLASS_SHIFT = 13;
+#endif
+
+static bool backgroundPaused = false;
+
+static QSet<ChildProcess*>& runningBackground()
+{
+    static QSet<ChildProcess*> set;
+    return set;
+}
+
+static QSet<ChildProcess*>& runningChildren()
+{
+    static QSet<ChildProcess*> set;
+    return set;
+}
+
+// QProcess reaps before finished() and the IDE may have reaped other children meanwhile, so
+// wait4 style totals can not be attributed. Each process is sampled from /proc while alive instead
+static void readUsage(qint64 pid, ChildProcess::Usage *usage)
+{
+#ifdef Q_OS_LINUX
+    QFile stat(QString("/proc/%1/stat").arg(pid));
+    if (stat.open(QFile::ReadOnly)) {
+        // Fields after the parenthesized command: state is [0], utime [11], stime [12], cutime [13], cstime [14]
+        auto data = stat.readAll();
+        auto fields = data.mid(data.lastIndexOf(')') + 2).split(' ');
+        if (fields.size() > 14) {
+            constexpr qint64 USEC_PER_SEC = 1000000;
+            static const auto ticks = qint64(::sysconf(_SC_CLK_TCK));
+            usage->userUs = (fields.at(11).toLongLong() + fields.at(13).toLongLong()) * USEC_PER_SEC / ticks;
+            usage->sysUs = (fields.at(12).toLongLong() + fields.at(14).toLongLong()) * USEC_PER_SEC / ticks;
         }
     }
-    p->blockSignals(false);
-    return p;
+    QFile status(QString("/proc/%1/status").arg(pid));
+    if (status.open(QFile::ReadOnly)) {
+        for(const auto& line: status.readAll().split('\n'))
+            if (line.startsWith("VmHWM:"))
+                usage->maxRssKb = qMax(usage->maxRssKb, line.mid(6).trimmed().split(' ').value(0).toLongLong());
+    }
+#else
+    Q_UNUSED(pid)
+    Q_UNUSED(usage)
+#endif
+}
+
+static QTimer *usageSampler()
+{
+    static QTimer *timer = nullptr;
+    if (!timer) {
+        timer = new QTimer(QCoreApplication::instance());
+        timer->setInterval(USAGE_SAMPLE_MS);
+        QObject::connect(timer, &QTimer::timeout, []() {
+            for(auto p: runningChildren())
+                p->sampleUsage();
+        });
+    }
+    return timer;
+}
+
+// Every child leads its own group, so this reaches make and the compilers it spawned
+static void signalGroup(qint64 pid, int sig)
+{
+#ifdef Q_OS_UNIX
+    if (pid <= 0)
+        return;
+    // The child may not have run setpgid yet
+    if (::kill(-pid_t(pid), sig) < 0 && errno == ESRCH)
+        ::kill(pid_t(pid), sig);
+#else
+    Q_UNUSED(pid)
+    Q_UNUSED(sig)
+#endif
+}
+
+void ChildProcess::setBackgroundPaused(bool paused)
+{
+    if (paused == backgroundPaused)
+        return;
+    backgroundPaused = paused;
+#ifdef Q_OS_UNIX
+    for(auto p: runningBackground())
+        if (!paused || !p->tokenHeld)
+            signalGroup(p->processId(), paused? SIGSTOP : SIGCONT);
+#endif
+}
+
+bool ChildProcess::isBackgroundPaused()
+{
+    return backgroundPaused;
+}
+
+ChildProcess::ChildProcess(QObject *parent): QProcess(parent)
+{
+    connect(this, &QProcess::stateChanged, [this](ProcessState state) {
+        if (state == Starting) {
+            current = Usage{};
+            current.program = program();
+            current.arguments = arguments();
+            current.name = objectName().isEmpty()? QFileInfo(current.program).fileName() : objectName();
+            current.startedAt = QDateTime::currentDateTime();
+            wallTimer.start();
+        } else if (state == Running) {
+            runningChildren().insert(this);
+            usageSampler()->start();
+            if (priority == Priority::Background) {
+                runningBackground().insert(this);
+#ifdef Q_OS_UNIX
+                if (backgroundPaused && !tokenHeld)
+                    signalGroup(processId(), SIGSTOP);
+#endif
+            }
+        } else if (state == NotRunning) {
+            runningBackground().remove(this);
+            runningChildren().remove(this);
+            if (runningChildren().isEmpty())
+                usageSampler()->stop();
+        }
+    });
+    connect(this, &QProcess::errorOccurred, [this](ProcessError err) {
+        if (err == FailedToStart) {
+            current = Usage{};
+            lastUsage = Usage{};
+        }
+    });
+    // Connected first so finished handlers elsewhere already see usage()
+    connect(this, QOverload<int, ExitStatus>::of(&QProcess::finished), this, &ChildProcess::finishUsage);
+    connect(this, QOverload<int, ExitStatus>::of(&QProcess::finished), [this]() {
+        if (stopGroup == 0)
+            return;
+#ifdef Q_OS_UNIX
+        // Sweep grandchildren that ignored the interrupt
+        ::kill(-pid_t(stopGroup), SIGKILL);
+#endif
+        stopGroup = 0;
+        killTimer->stop();
+        emit stopped();
+    });
 }
 
 ChildProcess::~ChildProcess() {
-    safeStop(this);
+    runningBackground().remove(this);
+    runningChildren().remove(this);
+    if (state() != NotRunning) {
+        // QProcess reaps the leader, the group must not outlive its owner either
+        blockSignals(true);
+#ifdef Q_OS_UNIX
+        signalGroup(processId(), SIGKILL);
+#endif
+        kill();
+    }
+}
+
+void ChildProcess::sampleUsage()
+{
+    readUsage(processId(), &current);
+}
+
+void ChildProcess::finishUsage(int exitCode, ExitStatus status)
+{
+    current.wallMs = wallTimer.isValid()? wallTimer.elapsed() : 0;
+    current.exitCode = exitCode;
+    current.crashed = status == CrashExit;
+    lastUsage = current;
+    current = Usage{};
+    wallTimer.invalidate();
+    ProcessHistory::instance().record(lastUsage);
+}
+
+void ChildProcess::stop(int killTimeoutMilis)
+{
+    if (state() == NotRunning) {
+        QTimer::singleShot(0, this, &ChildProcess::stopped);
+        return;
+    }
+    if (stopGroup != 0)
+        return;
+    stopGroup = processId();
+    if (!killTimer) {
+        killTimer = new QTimer(this);
+        killTimer->setSingleShot(true);
+        connect(killTimer, &QTimer::timeout, [this]() {
+#ifdef Q_OS_UNIX
+            signalGroup(stopGroup, SIGKILL);
+#endif
+            kill();
+        });
+    }
+#ifdef Q_OS_UNIX
+    // A paused process would never see the interrupt
+    signalGroup(stopGroup, SIGCONT);
+    signalGroup(stopGroup, SIGINT);
+#else
+    terminate();
+#endif
+    killTimer->start(killTimeoutMilis);
+}
+
+void ChildProcess::setupChildProcess()
+{
+    // Runs in the forked child right before exec, only async-signal-safe calls here
+#ifdef Q_OS_UNIX
+    ::setpgid(0, 0);
+#endif
+    if (priority != Priority::Background)
+        return;
+#ifdef Q_OS_UNIX
+    ::setpriority(PRIO_PROCESS, 0, BACKGROUND_NICE);
+#endif
+#ifdef Q_OS_LINUX
+    ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
 }
@@ -19,18 +19,60 @@
 #ifndef CHILDPROCESS_H
 #define CHILDPROCESS_H
 
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QProcess>
 
+class QTimer;
+
 class ChildProcess : public QProcess
 {
     Q_OBJECT
 public:
+    enum class Priority { Interactive, Build, Background };
+
+    struct Usage {
+        QString name;
+        QString program;
+        QStringList arguments;
+        QDateTime startedAt;
+        qint64 wallMs{ 0 };
+        // Sampled while running, so the last interval is missing. Stay at -1 when never sampled
+        qint64 userUs{ -1 };
+        qint64 sysUs{ -1 };
+        qint64 maxRssKb{ -1 };
+        int exitCode{ 0 };
+        bool crashed{ false };
+
+        bool hasResources() const { return userUs >= 0; }
+    };
+
     static ChildProcess& create(QObject *parent = nullptr) { return *new ChildProcess(parent); }
 
-    static QProcess *safeStop(QProcess *p, int timeoutMilis = 100);
+    // Stops (SIGSTOP) every running background process not holding a jobserver token until unpaused
+    static void setBackgroundPaused(bool paused);
+    static bool isBackgroundPaused();
+
+    explicit ChildProcess(QObject *parent = nullptr);
+    virtual ~ChildProcess() override;
 
-    explicit ChildProcess(QObject *parent = nullptr): QProcess(parent) {}
-    virtual ~ChildProcess();
+    Priority priorityClass() const { return priority; }
+    // Resources of the last finished run, children waited by the program included
+    const Usage& usage() const { return lastUsage; }
+
+    bool isStopping() const { return stopGroup != 0; }
+    // A stopped token holder would starve the build of that token, so it keeps running
+    void setHoldsToken(bool held) { tokenHeld = held; }
+    // CPU of the process and the children it waited for, peak RSS of the process itself
+    void sampleUsage();
+
+    // Interrupts the whole process group, kills it after the timeout and emits stopped(), never blocks
+    void stop(int killTimeoutMilis = 3000);
+
+    ChildProcess& setPriority(Priority p) {
+        priority = p;
+        return *this;
+    }
 
     ChildProcess& changeCWD(const QString& path) {
         setWorkingDirectory(path);
@@ -95,8 +137,23 @@ public:
     }
 
 signals:
+    void stopped();
 
 public slots:
+
+protected:
+    void setupChildProcess() override;
+
+private:
+    Priority priority{ Priority::Interactive };
+    QTimer *killTimer{ nullptr };
+    qint64 stopGroup{ 0 };
+    bool tokenHeld{ false };
+    Usage current;
+    Usage lastUsage;
+    QElapsedTimer wallTimer;
+
+    void finishUsage(int exitCode, ExitStatus status);
 };
 
 #endif // CHILDPROCESS_H
@@ -19,14 +19,23 @@
 #include "appconfig.h"
 #include "childprocess.h"
 #include "clangautocompletionprovider.h"
+#include "jobserver.h"
+#include "preprocessorevaluator.h"
 #include "projectmanager.h"
 #include "textmessagebrocker.h"
+#include "wordindex.h"
 
+#include <QCache>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QPointer>
 #include <QProcess>
 #include <QRegularExpressionMatch>
+#include <QSet>
 #include <QTimer>
 
 #include <QtConcurrent>
@@ -79,29 +88,9 @@ static QStringList cmdLineTokenizer(const QString& line)
     return tokens;
 }
 
-static const QRegularExpression EOL(R"([\r\n])");
-
-static void parseCompilerInfo(const QString& text, QStringList *incs, QStringList *defs)
+static void parseCompilerInfo(const QString& text, QStringList *incs, PreprocessorEvaluator::MacroTable *defs)
 {
-#if 0
-    QRegularExpression definesRe(R"(^\#define (\S+) (.*?)$)", QRegularExpression::MultilineOption);
-    auto it = definesRe.globalMatch(text);
-    while (it.hasNext()) {
-        QRegularExpressionMatch m = it.next();
-#if 1
-        QString define = m.captured(0);
-        defs->append(define);
-#else
-        QString symbol = m.captured(1).remove(EOL);
-        QString value = m.captured(2).remove(EOL);
-        if (value.contains(QRegularExpression("[ \\t]")))
-            value = value.prepend('"').append('"');
-        defs->append(QString("%1=%2").arg(symbol).arg(value));
-#endif
-    }
-#else
-    Q_UNUSED(defs)
-#endif
+    *defs = PreprocessorEvaluator::parseDefines(text);
     bool onIncludes = false;
     for(const QString& line: text.split('\n')) {
         if (!onIncludes) {
@@ -112,22 +101,131 @@ static void parseCompilerInfo(const QString& text, QStringList *incs, QStringLis
             if (line.startsWith("End of search list"))
                 onIncludes = false;
             else {
-                QString ipath = line.trimmed();
+                QString ipath = "-I" + line.trimmed();
                 if (!incs->contains(ipath))
-                    incs->append("-I" + ipath);
+                    incs->append(ipath);
+            }
+        }
+    }
+}
+
+static void appendUnique(QStringList *list, const QStringList& items)
+{
+    for(const auto& e: items)
+        if (!list->contains(e))
+            list->append(e);
+}
+
+// Exact when an argument resolves to the file itself, otherwise the first line only lends its flags
+static QRegularExpressionMatch findCompileLine(const QRegularExpression& re, const QString& text, const QString& path,
+                                               const QString& workingDir, bool *exact)
+{
+    auto wanted = QDir::cleanPath(path);
+    QRegularExpressionMatch first;
+    auto it = re.globalMatch(text);
+    while (it.hasNext()) {
+        auto m = it.next();
+        if (!first.hasMatch())
+            first = m;
+        for(const auto& arg: cmdLineTokenizer(m.captured(3))) {
+            if (!arg.startsWith('-') && QDir::cleanPath(QDir(workingDir).absoluteFilePath(arg)) == wanted) {
+                *exact = true;
+                return m;
             }
         }
     }
+    *exact = false;
+    return first;
+}
+
+static ICodeModelProvider::DiagnosticList parseDiagnostics(const QString& text)
+{
+    using Severity = ICodeModelProvider::Diagnostic::Severity;
+    static const QRegularExpression re(R"(^<stdin>:(\d+):(\d+): (fatal error|error|warning|note): (.*?)$)",
+                                       QRegularExpression::MultilineOption);
+    ICodeModelProvider::DiagnosticList list;
+    auto it = re.globalMatch(text);
+    while (it.hasNext()) {
+        auto m = it.next();
+        ICodeModelProvider::Diagnostic d;
+        d.line = m.captured(1).toInt();
+        d.column = m.captured(2).toInt();
+        auto kind = m.captured(3);
+        d.severity = kind.endsWith("error")? Severity::Error : kind == "warning"? Severity::Warning : Severity::Note;
+        d.message = m.captured(4).trimmed();
+        list.append(d);
+    }
+    return list;
 }
 
+static const QStringList KEYWORD_KINDS = { "typedef", "struct", "union", "enum", "class", "macro" };
+
+static const QStringList CXX_SOURCE_SUFFIXES = { "cpp", "hpp", "cc", "hh", "cxx", "hxx", "c++", "h++" };
+
+static constexpr auto DIAGNOSTICS_CACHE_SIZE = 64;
+static constexpr auto INACTIVE_REGIONS_CACHE_SIZE = 64;
+
 class ClangAutocompletionProvider::Priv_t
 {
 public:
+    struct CompileInfo {
+        QString language;
+        QStringList flags;
+        PreprocessorEvaluator::MacroTable macros;
+        QByteArray macrosHash;
+        ICodeModelProvider::CompileCommand command;
+    };
+
     ProjectManager *project{ nullptr };
     QHash<QString, ICodeModelProvider::FileReferenceList> nameMap;
+    QByteArray keywords;
+    int indexGeneration{ 0 };
     QStringList includes;
     QStringList defines;
+    QHash<QString, CompileInfo> compileInfo;
+    QHash<QString, QPointer<QProcess>> diagnosticsRunning;
+    QCache<QByteArray, ICodeModelProvider::DiagnosticList> diagnosticsCache{ DIAGNOSTICS_CACHE_SIZE };
+    QSet<QString> indexing;
+    QHash<QString, std::function<void ()>> pendingRegions;
+    QHash<QString, int> regionsGeneration;
+    QCache<QByteArray, ICodeModelProvider::LineRangeList> regionsCache{ INACTIVE_REGIONS_CACHE_SIZE };
+
+    // Editors drop their keyword highlight on a new generation, also when the index was emptied
+    void publishIndex() {
+        indexGeneration++;
+        TextMessageBrocker::instance().publish(TextMessages::SYMBOL_INDEX_UPDATED, QString::number(indexGeneration));
+    }
     QByteArray buffer;
+
+    QStringList flagsFor(const QString& path) const {
+        auto it = compileInfo.find(QFileInfo(path).absoluteFilePath());
+        return it != compileInfo.end()? it->flags : defines + includes;
+    }
+
+    QString languageFor(const QString& path) const {
+        auto it = compileInfo.find(QFileInfo(path).absoluteFilePath());
+        if (it != compileInfo.end())
+            return it->language;
+        return CXX_SOURCE_SUFFIXES.contains(QFileInfo(path).suffix())? "c++" : "c";
+    }
+
+    void indexingDone(const QString& absolutePath) {
+        indexing.remove(absolutePath);
+        auto pending = pendingRegions.take(absolutePath);
+        if (pending)
+            pending();
+    }
+
+    static QByteArray hashOf(const PreprocessorEvaluator::MacroTable& macros) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        auto names = macros.keys();
+        names.sort();
+        for(const auto& name: names) {
+            const auto& m = macros[name];
+            hash.addData(QString("%1%2 %3\n").arg(name, m.functionLike? "()" : "", m.value).toUtf8());
+        }
+        return hash.result();
+    }
 };
 
 ClangAutocompletionProvider::ClangAutocompletionProvider(ProjectManager *proj, QObject *parent):
@@ -144,15 +242,24 @@ ClangAutocompletionProvider::~ClangAutocompletionProvider()
 void ClangAutocompletionProvider::startIndexingProject(const QString &path)
 {
     priv->nameMap.clear();
+    priv->keywords.clear();
+    priv->publishIndex();
+    auto generation = priv->indexGeneration;
     auto& p = ChildProcess::create(this)
+    .setPriority(ChildProcess::Priority::Background)
     .changeCWD(path)
-    .onError([this](QProcess *ctags, QProcess::ProcessError) {
+    .onError([this](QProcess *ctags, QProcess::ProcessError err) {
         constexpr auto TIMEOUT = 5000;
         priv->project->showMessageTimed(tr("ctags error: %1").arg(ctags->errorString()), TIMEOUT);
+        if (err == QProcess::FailedToStart)
+            emit projectIndexFinished(false, 0);
     })
-    .onFinished([this](QProcess *ctags, int exitStatus) {
-        qDebug() << "ctags end with" << exitStatus;
-        QtConcurrent::run([ctags, this]() {
+    .onFinished([this, generation](QProcess *ctags, int exitCode) {
+        qDebug() << "ctags end with" << exitCode;
+        // Whatever a failed or killed ctags printed is still indexed, the caller learns it is partial
+        auto ok = exitCode == 0 && ctags->exitStatus() == QProcess::NormalExit;
+        QtConcurrent::run([ctags, this, generation, ok]() {
+            QSet<QString> typeNames;
             ctags->setReadChannel(QProcess::StandardOutput);
             while(ctags->bytesAvailable() > 0) {
                 auto line = ctags->readLine();
@@ -160,6 +267,8 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path)
                 if (!entry.isEmpty()) {
                     auto name = entry.value("name").toString();
                     auto text = entry.value("text").toString();
+                    if (KEYWORD_KINDS.contains(entry.value("type").toString()))
+                        typeNames.insert(name);
                     ICodeModelProvider::FileReference r = {
                         entry.value("path").toString(),
                         entry.value("line").toInt(), 0,
@@ -170,12 +279,25 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path)
                 if (!priv->project->isProjectOpen())
                     break;
             }
+            // Built once per index generation, editors share this same buffer
+            auto names = typeNames.values();
+            names.sort();
+            auto keywords = names.join(' ').toUtf8();
+            auto symbols = priv->nameMap.size();
+            QMetaObject::invokeMethod(this, [this, keywords, symbols, generation, ok]() {
+                // A newer indexing run already cleared the keywords, these are stale
+                if (generation != priv->indexGeneration)
+                    return;
+                priv->keywords = keywords;
+                priv->publishIndex();
+                emit projectIndexFinished(ok, symbols);
+            }, Qt::QueuedConnection);
             priv->project->showMessageTimed(tr("Index finished"));
             ctags->deleteLater();
         });
         priv->project->showMessage(tr("ctags end, processing..."));
     });
-    p.start("universal-ctags", {
+    JobServer::instance().startWithToken(&p, "universal-ctags", {
                  "--map-R=-.s",
                  "-n", "-R", "-e",
                  "--all-kinds=*",
@@ -190,30 +312,44 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path)
 
 void ClangAutocompletionProvider::startIndexingFile(const QString &path)
 {
-    Q_UNUSED(path)
-    auto targets = priv->project->targetsOfDependency(path);
+    auto absolutePath = QFileInfo(path).absoluteFilePath();
+    auto relativePath = QDir(priv->project->projectPath()).relativeFilePath(absolutePath);
+    auto targets = priv->project->targetsOfDependency(relativePath);
+    if (targets.isEmpty())
+        targets = priv->project->targetsOfDependency(path);
+    priv->indexing.insert(absolutePath);
     auto& p = ChildProcess::create(this)
+            .setPriority(ChildProcess::Priority::Background)
             .makeDeleteLater()
             .changeCWD(priv->project->projectPath())
-            .onFinished([this](QProcess *make, int exitCode)
+            .onError([this, absolutePath](QProcess *make, QProcess::ProcessError err) {
+        Q_UNUSED(make)
+        Q_UNUSED(err)
+        priv->indexingDone(absolutePath);
+    }).onFinished([this, absolutePath](QProcess *make, int exitCode)
     {
         qDebug() << "make discover exit with" << exitCode;
         QString out = make->readAllStandardOutput();
         QRegularExpression re(R"((\S+[g]*(cc|\+\+))\S*\s+(.*?$))", QRegularExpression::MultilineOption);
-        QRegularExpressionMatch m = re.match(out);
+        bool exact;
+        QRegularExpressionMatch m = findCompileLine(re, out, absolutePath, make->workingDirectory(), &exact);
         if (m.hasMatch()) {
             QString compiler = m.captured(1);
             QString compiler_type = m.captured(2);
             QString parameters = m.captured(3);
             qDebug() << "CC:" << compiler << ", type " << compiler_type;
             QStringList parameterList = cmdLineTokenizer(parameters);
+            Priv_t::CompileInfo info;
+            info.language = compiler_type == "++"? "c++" : "c";
             QList<int> toRemove;
             int idx = 0;
             for(const QString& arg: parameterList) {
                 if (arg.startsWith("-I"))
-                    priv->includes.append(arg);
-                else if (arg.startsWith("-D"))
-                    priv->defines.append(arg);
+                    info.flags.append(arg);
+                else if (arg.startsWith("-D") || arg.startsWith("-U"))
+                    info.flags.append(arg);
+                else if (arg.startsWith("-std="))
+                    info.flags.append(arg);
                 else if (QRegularExpression(R"(^-(?:MMD|MM|MG|MP|MD|M)$)").match(arg).hasMatch())
                     toRemove << idx;
                 else if (QRegularExpression(R"(^-(?:MQ|MT|MF)$)").match(arg).hasMatch())
@@ -224,36 +360,60 @@ void ClangAutocompletionProvider::startIndexingFile(const QString &path)
                     toRemove << idx << (idx + 1);
                 idx++;
             }
+            appendUnique(&priv->includes, info.flags.filter(QRegularExpression("^-I")));
+            appendUnique(&priv->defines, info.flags.filter(QRegularExpression("^-D")));
             std::sort(toRemove.begin(), toRemove.end(),
                   [](int a, int b) -> bool { return a > b; });
             for(const auto& i: toRemove)
                 parameterList.removeAt(i);
+            // Headers borrow flags from some unit but must never run that unit's compile
+            if (exact)
+                info.command = { compiler, parameterList, make->workingDirectory() };
             parameterList.append("-dM");
             parameterList.append("-E");
             parameterList.append("-v");
             qDebug() << parameterList;
             auto& p = ChildProcess::create(this)
+                    .setPriority(ChildProcess::Priority::Background)
                     .changeCWD(make->workingDirectory())
                     .mergeStdOutAndErr()
                     .makeDeleteLater()
-                    .onFinished([this](QProcess *cc, int) {
+                    .onFinished([this, absolutePath, info](QProcess *cc, int) {
                 QString out = cc->readAll();
-                parseCompilerInfo(out, &priv->includes, &priv->defines);
-                qDebug() << "Includes:" << priv->includes;
-                qDebug() << "Defines:" << priv->defines;
-            }).onError([](QProcess *cc, QProcess::ProcessError err) {
+                QStringList systemIncludes;
+                auto fileInfo = info;
+                parseCompilerInfo(out, &systemIncludes, &fileInfo.macros);
+                fileInfo.macrosHash = Priv_t::hashOf(fileInfo.macros);
+                appendUnique(&fileInfo.flags, systemIncludes);
+                appendUnique(&priv->includes, systemIncludes);
+                priv->compileInfo.insert(absolutePath, fileInfo);
+                priv->indexingDone(absolutePath);
+                qDebug() << "Flags for" << absolutePath << ":" << fileInfo.flags;
+            }).onError([this, absolutePath](QProcess *cc, QProcess::ProcessError err) {
                 Q_UNUSED(err)
                 qDebug() << "CC ERROR: " << cc->program() << cc->arguments() << "\n"
                          << "\t" << cc->errorString();
+                priv->indexingDone(absolutePath);
             });
-            p.start(compiler, parameterList);
+            JobServer::instance().startWithToken(&p, compiler, parameterList);
             priv->project->deleteOnCloseProject(&p);
-        }
+        } else
+            priv->indexingDone(absolutePath);
     });
     p.start("make", QStringList{ "-B", "-n" } + targets);
     priv->project->deleteOnCloseProject(&p);
 }
 
+int ClangAutocompletionProvider::indexGeneration() const
+{
+    return priv->indexGeneration;
+}
+
+QByteArray ClangAutocompletionProvider::keywordList() const
+{
+    return priv->keywords;
+}
+
 void ClangAutocompletionProvider::referenceOf(const QString &entity, ICodeModelProvider::FindReferenceCallback_t cb)
 {
     cb(priv->nameMap.value(entity));
@@ -294,12 +454,117 @@ void ClangAutocompletionProvider::completionAt(const ICodeModelProvider::FileRef
         cb(list);
     });
     p.start("clang", QStringList{
-                 "-x", "c", "-fcolor-diagnostics", "-fsyntax-only",
+                 "-x", priv->languageFor(ref.path), "-fcolor-diagnostics", "-fsyntax-only",
                  "-Xclang", "-code-completion-macros",
                  "-Xclang", "-code-completion-patterns",
                  "-Xclang", "-code-completion-brief-comments",
                  "-Xclang", QString("-code-completion-at=-:%1:%2").arg(ref.line + 1).arg(ref.column + 1),
                  "-"
-             } + priv->defines + priv->includes);
+             } + priv->flagsFor(ref.path));
+    priv->project->deleteOnCloseProject(&p);
+}
+
+void ClangAutocompletionProvider::diagnosticsFor(const QString &path, const QString &unsaved, ICodeModelProvider::DiagnosticsCallback_t cb)
+{
+    cancelDiagnostics(path);
+    auto content = unsaved.toLocal8Bit();
+    auto args = QStringList{
+        "-x", priv->languageFor(path), "-fsyntax-only",
+        "-fno-color-diagnostics", "-fno-caret-diagnostics",
+        "-I", QFileInfo(path).absolutePath(),
+        "-"
+    } + priv->flagsFor(path);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(path.toUtf8());
+    hash.addData(args.join('\n').toUtf8());
+    hash.addData(content);
+    auto key = hash.result();
+    auto cached = priv->diagnosticsCache.object(key);
+    if (cached) {
+        cb(*cached);
+        return;
+    }
+
+    auto& p = ChildProcess::create(this)
+            .setPriority(ChildProcess::Priority::Background)
+            .makeDeleteLater()
+            .mergeStdOutAndErr()
+            .changeCWD(priv->project->projectPath())
+            .onStarted([content](QProcess *clang) {
+        clang->write(content);
+        clang->closeWriteChannel();
+    }).onError([](QProcess *clang, QProcess::ProcessError err) {
+        qDebug() << "clang diagnostics error:" << clang->errorString() << err;
+    }).onFinished([this, path, key, cb](QProcess *clang, int exitStatus) {
+        Q_UNUSED(exitStatus)
+        // Superseded by a newer request or cancelled by an edit
+        if (priv->diagnosticsRunning.value(path) != clang)
+            return;
+        priv->diagnosticsRunning.remove(path);
+        auto list = parseDiagnostics(clang->readAll());
+        priv->diagnosticsCache.insert(key, new DiagnosticList(list));
+        cb(list);
+    });
+    priv->diagnosticsRunning.insert(path, &p);
+    JobServer::instance().startWithToken(&p, "clang", args);
     priv->project->deleteOnCloseProject(&p);
 }
+
+void ClangAutocompletionProvider::cancelDiagnostics(const QString &path)
+{
+    auto p = priv->diagnosticsRunning.take(path);
+    if (p && p->state() == QProcess::NotRunning)
+        p->deleteLater(); // Still waiting for a job token
+    else if (p)
+        p->kill();
+    auto absolutePath = QFileInfo(path).absoluteFilePath();
+    priv->pendingRegions.remove(absolutePath);
+    priv->regionsGeneration[absolutePath]++;
+}
+
+void ClangAutocompletionProvider::inactiveRegionsFor(const QString &path, const QString &unsaved, InactiveRegionsCallback_t cb)
+{
+    auto absolutePath = QFileInfo(path).absoluteFilePath();
+    auto it = priv->compileInfo.constFind(absolutePath);
+    if (it == priv->compileInfo.constEnd()) {
+        // Without the compiler defines every branch is as good as any other
+        if (priv->indexing.contains(absolutePath))
+            priv->pendingRegions.insert(absolutePath, [this, path, unsaved, cb]() { inactiveRegionsFor(path, unsaved, cb); });
+        else
+            cb({});
+        return;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(absolutePath.toUtf8());
+    hash.addData(it->macrosHash);
+    hash.addData(unsaved.toUtf8());
+    auto key = hash.result();
+    auto cached = priv->regionsCache.object(key);
+    if (cached) {
+        cb(*cached);
+        return;
+    }
+
+    auto generation = ++priv->regionsGeneration[absolutePath];
+    auto watcher = new QFutureWatcher<LineRangeList>(this);
+    connect(watcher, &QFutureWatcher<LineRangeList>::finished, [this, watcher, absolutePath, generation, key, cb]() {
+        watcher->deleteLater();
+        auto list = watcher->result();
+        priv->regionsCache.insert(key, new LineRangeList(list));
+        if (priv->regionsGeneration.value(absolutePath) == generation)
+            cb(list);
+    });
+    watcher->setFuture(QtConcurrent::run(PreprocessorEvaluator::inactiveLines, unsaved, it->macros));
+}
+
+QStringList ClangAutocompletionProvider::wordCompletions(const QString &prefix, const QString &path)
+{
+    return priv->project->wordIndex()->completions(prefix, path);
+}
+
+ICodeModelProvider::CompileCommand ClangAutocompletionProvider::compileCommandFor(const QString &path) const
+{
+    return priv->compileInfo.value(QFileInfo(path).absoluteFilePath()).command;
+}
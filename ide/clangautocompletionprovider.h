@@ -33,9 +33,19 @@ public:
 
     void startIndexingProject(const QString& path) override;
     void startIndexingFile(const QString& path) override;
+    int indexGeneration() const override;
+    QByteArray keywordList() const override;
 
     void referenceOf(const QString& entity, FindReferenceCallback_t cb) override;
     void completionAt(const FileReference& ref, const QString& unsaved, CompletionCallback_t cb) override;
+    void diagnosticsFor(const QString& path, const QString& unsaved, DiagnosticsCallback_t cb) override;
+    void cancelDiagnostics(const QString& path) override;
+    void inactiveRegionsFor(const QString& path, const QString& unsaved, InactiveRegionsCallback_t cb) override;
+    QStringList wordCompletions(const QString& prefix, const QString& path) override;
+    CompileCommand compileCommandFor(const QString& path) const override;
+
+signals:
+    void projectIndexFinished(bool ok, int symbols);
 
 private:
     class Priv_t;
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "compilecache.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QHash>
+
+#include <algorithm>
+
+#include <QtDebug>
+
+// Leftovers of a launcher killed between copy and rename
+static constexpr auto STALE_TMP_SECS = 3600;
+
+QString CompileCache::cacheDir()
+{
+    return AppConfig::ensureExist(QDir(AppConfig::instance().workspacePath()).absoluteFilePath("compile-cache"));
+}
+
+CompileCache::Stats CompileCache::readStats(const QString &logPath)
+{
+    Stats stats;
+    QFile f(logPath);
+    if (!f.open(QFile::ReadOnly))
+        return stats;
+    while (!f.atEnd()) {
+        auto line = f.readLine().trimmed();
+        if (line == "hit")
+            stats.hits++;
+        else if (line == "miss")
+            stats.misses++;
+        else if (line == "skip")
+            stats.skipped++;
+    }
+    return stats;
+}
+
+qint64 CompileCache::trim(const QString &dir, qint64 maxBytes)
+{
+    struct Entry {
+        QStringList files;
+        qint64 size{ 0 };
+        QDateTime used;
+    };
+    QHash<QString, Entry> entries;
+    qint64 total = 0;
+    auto now = QDateTime::currentDateTime();
+    QDirIterator it(dir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto path = it.next();
+        auto info = it.fileInfo();
+        if (info.suffix() == "tmp") {
+            if (info.lastModified().secsTo(now) > STALE_TMP_SECS)
+                QFile::remove(path);
+            continue;
+        }
+        auto& e = entries[info.completeBaseName()];
+        e.files.append(path);
+        e.size += info.size();
+        // Hits touch the entry, its newest file tells when it was last used
+        e.used = qMax(e.used, info.lastModified());
+        total += info.size();
+    }
+    if (total <= maxBytes)
+        return total;
+
+    auto list = entries.values();
+    std::sort(list.begin(), list.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for(const auto& e: list) {
+        if (total <= maxBytes)
+            break;
+        for(const auto& f: e.files)
+            QFile::remove(f);
+        total -= e.size;
+    }
+    return total;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+
+#include <QString>
+
+class CompileCache
+{
+public:
+    struct Stats {
+        int hits{ 0 };
+        int misses{ 0 };
+        int skipped{ 0 };
+    };
+
+    static QString cacheDir();
+    static Stats readStats(const QString& logPath);
+    // Drops least recently used entries until the cache fits, returns the final size in bytes.
+    // An entry is every file sharing a base name, any store laid out that way can be trimmed
+    static qint64 trim(const QString& dir, qint64 maxBytes);
+
+private:
+    CompileCache() = delete;
+};
+
+#endif // COMPILECACHE_H
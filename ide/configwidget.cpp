@@ -175,6 +175,11 @@ void ConfigWidget::save()
     conf.setLanguage(ui->languageList->currentText());
     conf.setNumberOfJobs(ui->numberOfJobs->value());
     conf.setNumberOfJobsOptimal(ui->numberOfJobsOptimal->isChecked());
+    conf.setBuildProfiling(ui->buildProfiling->isChecked());
+    conf.setBuildCache(ui->buildCache->isChecked());
+    conf.setBuildCacheSize(ui->buildCacheSize->value());
+    conf.setStaticAnalysis(ui->staticAnalysis->isChecked());
+    conf.setStaticAnalysisJobs(ui->staticAnalysisJobs->value());
     conf.save();
 }
 
@@ -220,4 +225,9 @@ void ConfigWidget::load()
     ui->languageList->setCurrentText(conf.language());
     ui->numberOfJobs->setValue(conf.numberOfJobs());
     ui->numberOfJobsOptimal->setChecked(conf.numberOfJobsOptimal());
+    ui->buildProfiling->setChecked(conf.buildProfiling());
+    ui->buildCache->setChecked(conf.buildCache());
+    ui->buildCacheSize->setValue(conf.buildCacheSize());
+    ui->staticAnalysis->setChecked(conf.staticAnalysis());
+    ui->staticAnalysisJobs->setValue(conf.staticAnalysisJobs());
 }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "buildoutputparser.h"
 #include "consoleinterceptor.h"
 #include "processmanager.h"
 
@@ -46,7 +47,7 @@ ConsoleInterceptor::ConsoleInterceptor(QTextBrowser *textBrowser, ProcessManager
     bstop->setToolTip(tr("Stop Current Process"));
     connect(bstop, &QToolButton::clicked, [pman, pname]() {
         constexpr auto TIMEOUT = 300;
-        pman->terminate(pname, true, TIMEOUT);
+        pman->terminate(pname, TIMEOUT);
     });
     connect(pman->processFor(pname), &QProcess::stateChanged,
             [bstop](QProcess::ProcessState state) { bstop->setEnabled(state == QProcess::Running); });
@@ -63,12 +64,7 @@ ConsoleInterceptor::ConsoleInterceptor(QTextBrowser *textBrowser, ProcessManager
     });
 
 
-    pman->setStderrInterceptor(pname, [this](QProcess *p, const QString& text) {
-        appendToConsole(QProcess::StandardError, p, text);
-    });
-    pman->setStdoutInterceptor(pname, [this](QProcess *p, const QString& text) {
-        appendToConsole(QProcess::StandardError, p, text);
-    });
+    attach(pman, pname);
 }
 
 ConsoleInterceptor::~ConsoleInterceptor() = default;
@@ -99,8 +95,40 @@ void ConsoleInterceptor::writeHtmlTo(QTextBrowser *browser, const QString &html)
     browser->verticalScrollBar()->setValue(browser->verticalScrollBar()->maximum());
 }
 
+void ConsoleInterceptor::attach(ProcessManager *pman, const QString &pname)
+{
+    if (attachedProcesses.contains(pname))
+        return;
+    attachedProcesses.insert(pname);
+    pman->setStderrInterceptor(pname, [this](QProcess *p, const QString& text) {
+        appendToConsole(QProcess::StandardError, p, text);
+    });
+    pman->setStdoutInterceptor(pname, [this](QProcess *p, const QString& text) {
+        appendToConsole(QProcess::StandardOutput, p, text);
+    });
+    connect(pman->processFor(pname), QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), [this, pname]() {
+        if (outputParser) {
+            outputParser->finish(QString("%1:%2").arg(pname).arg(QProcess::StandardOutput));
+            outputParser->finish(QString("%1:%2").arg(pname).arg(QProcess::StandardError));
+        }
+    });
+}
+
+void ConsoleInterceptor::setOutputParser(BuildOutputParser *parser)
+{
+    if (outputParser)
+        disconnect(outputParser, &BuildOutputParser::htmlReady, this, &ConsoleInterceptor::writeHtml);
+    outputParser = parser;
+    if (outputParser)
+        connect(outputParser, &BuildOutputParser::htmlReady, this, &ConsoleInterceptor::writeHtml);
+}
+
 void ConsoleInterceptor::appendToConsole(QProcess::ProcessChannel s, QProcess *p, const QString &text)
 {
+    if (outputParser) {
+        outputParser->feed(QString("%1:%2").arg(p->objectName()).arg(s), text);
+        return;
+    }
     const auto& filters = s == QProcess::StandardError? stderrFilters : stdoutFilters;
     QString processedText{ text };
     for(const auto& c: filters)
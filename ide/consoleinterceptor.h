@@ -21,12 +21,14 @@
 
 #include <QObject>
 #include <QProcess>
+#include <QSet>
 
 #include <functional>
 
 class QTextBrowser;
 class QProcess;
 
+class BuildOutputParser;
 class ProcessManager;
 
 using ConsoleInterceptorFilter = std::function<QString& (QProcess *p, QString& s)>;
@@ -45,6 +47,12 @@ public:
     void addStdOutFilter(const ConsoleInterceptorFilter& f) { stdoutFilters.append(f); }
     void addStdErrFilter(const ConsoleInterceptorFilter& f) { stderrFilters.append(f); }
 
+    // Route the output of another process to this console
+    void attach(ProcessManager *pman, const QString& pname);
+
+    // When set, raw output is line framed and rendered by the parser instead of the filters
+    void setOutputParser(BuildOutputParser *parser);
+
     void appendToConsole(QProcess::ProcessChannel s, QProcess *p, const QString& text);
 signals:
 
@@ -56,6 +64,8 @@ private:
     QTextBrowser *browser;
     QList<ConsoleInterceptorFilter> stdoutFilters;
     QList<ConsoleInterceptorFilter> stderrFilters;
+    BuildOutputParser *outputParser{ nullptr };
+    QSet<QString> attachedProcesses;
 };
 
 #endif // CONSOLEINTERCEPTOR_H
@@ -0,0 +1,318 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "childprocess.h"
+#include "coverageengine.h"
+#include "jobserver.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QtConcurrent>
+
+#include <limits>
+#include <memory>
+
+#include <QtDebug>
+
+static constexpr auto MAX_HITS = std::numeric_limits<quint32>::max() - 1;
+
+namespace {
+
+using LineTable = QHash<QString, QVector<quint32>>;
+using DataDirs = QHash<QString, QStringList>;
+
+const QRegularExpression GCOV_LINE_RE{ R"(^\s*([^:]+):\s*(\d+):(.*)$)" };
+
+void addHits(QVector<quint32> *lines, int line, double hits)
+{
+    if (line < 1)
+        return;
+    if (lines->size() < line)
+        lines->resize(line);
+    auto& slot = (*lines)[line - 1];
+    auto previous = slot == 0? 0.0 : double(slot - 1);
+    slot = quint32(qMin(previous + qMax(hits, 0.0), double(MAX_HITS))) + 1;
+}
+
+void mergeInto(LineTable *table, const LineTable& other)
+{
+    for(auto it = other.begin(); it != other.end(); ++it) {
+        auto& lines = (*table)[it.key()];
+        const auto& incoming = it.value();
+        for(int i = 0; i < incoming.size(); i++)
+            if (incoming.at(i) != 0)
+                addHits(&lines, i + 1, incoming.at(i) - 1);
+    }
+}
+
+DataDirs findDataDirs(const QString& root)
+{
+    DataDirs dirs;
+    QDirIterator it(root, { "*.gcda" }, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto path = it.next();
+        dirs[it.fileInfo().absolutePath()].append(path);
+    }
+    return dirs;
+}
+
+QString resolve(const QString& base, const QString& file)
+{
+    return QDir::cleanPath(QDir(base).absoluteFilePath(file));
+}
+
+// Sources outside the project are system and toolchain headers, nobody edits them here
+bool isInside(const QString& root, const QString& path)
+{
+    return path.startsWith(root + '/');
+}
+
+// gcov 9 and later, one JSON document per data file
+LineTable parseJson(const QByteArray& output, const QString& root)
+{
+    LineTable table;
+    for(const auto& chunk: output.split('\n')) {
+        auto doc = QJsonDocument::fromJson(chunk).object();
+        auto cwd = doc.value("current_working_directory").toString();
+        for(const auto& f: doc.value("files").toArray()) {
+            auto file = f.toObject();
+            auto path = resolve(cwd, file.value("file").toString());
+            if (!isInside(root, path))
+                continue;
+            auto& lines = table[path];
+            for(const auto& l: file.value("lines").toArray()) {
+                auto line = l.toObject();
+                addHits(&lines, line.value("line_number").toInt(), line.value("count").toDouble());
+            }
+        }
+    }
+    return table;
+}
+
+// Older gcov writes annotated sources, the recorded source path is taken relative to the project
+LineTable parseGcovFiles(const QString& dir, const QString& root)
+{
+    LineTable table;
+    QDirIterator it(dir, { "*.gcov" }, QDir::Files);
+    while (it.hasNext()) {
+        QFile f(it.next());
+        if (!f.open(QFile::ReadOnly))
+            continue;
+        QString source;
+        while (!f.atEnd()) {
+            auto m = GCOV_LINE_RE.match(QString::fromLocal8Bit(f.readLine()));
+            if (!m.hasMatch())
+                continue;
+            auto count = m.captured(1).trimmed();
+            auto line = m.captured(2).toInt();
+            if (line == 0) {
+                if (m.captured(3).startsWith("Source:")) {
+                    auto path = resolve(root, m.captured(3).mid(7));
+                    source = isInside(root, path)? path : QString();
+                }
+                continue;
+            }
+            if (source.isEmpty() || count == "-")
+                continue;
+            if (count.startsWith('#') || count.startsWith('='))
+                addHits(&table[source], line, 0);
+            else
+                addHits(&table[source], line, count.remove('*').toDouble());
+        }
+    }
+    return table;
+}
+
+}
+
+class CoverageEngine::Priv_t
+{
+public:
+    CoverageEngine *q{ nullptr };
+    LineTable table;
+    LineTable incoming;
+    QString root;
+    int pending{ 0 };
+    int generation{ 0 };
+    bool scanning{ false };
+
+    void ingest(const LineTable& part) {
+        mergeInto(&incoming, part);
+        if (--pending > 0)
+            return;
+        table = incoming;
+        incoming.clear();
+        emit q->coverageChanged();
+        emit q->collected(q->summary());
+    }
+
+    template<typename F>
+    void parseLater(F parser) {
+        auto watcher = new QFutureWatcher<LineTable>(q);
+        auto gen = generation;
+        QObject::connect(watcher, &QFutureWatcher<LineTable>::finished, q, [this, watcher, gen]() {
+            watcher->deleteLater();
+            if (gen == generation)
+                ingest(watcher->result());
+        });
+        watcher->setFuture(QtConcurrent::run(parser));
+    }
+
+    void runLegacy(const QString& dir, const QStringList& dataFiles) {
+        auto tmp = std::make_shared<QTemporaryDir>();
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Build)
+                .changeCWD(tmp->path())
+                .makeDeleteLater();
+        p.setStandardOutputFile(QProcess::nullDevice());
+        p.setStandardErrorFile(QProcess::nullDevice());
+        auto gen = generation;
+        auto base = root;
+        p.onFinished([this, gen, tmp, base](QProcess *, int) {
+            if (gen == generation)
+                parseLater([tmp, base]() { return parseGcovFiles(tmp->path(), base); });
+        }).onError([this, gen](QProcess *gcov, QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart || gen != generation)
+                return;
+            qDebug() << "can not run gcov" << gcov->errorString();
+            ingest({});
+        });
+        JobServer::instance().startWithToken(&p, "gcov", QStringList{ "-p", "-o", dir } + dataFiles);
+    }
+
+    void run(const QString& dir, const QStringList& dataFiles) {
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Build)
+                .changeCWD(dir)
+                .makeDeleteLater();
+        p.setStandardErrorFile(QProcess::nullDevice());
+        auto gen = generation;
+        auto base = root;
+        p.onFinished([this, gen, base, dir, dataFiles](QProcess *gcov, int code) {
+            if (gen != generation)
+                return;
+            auto output = gcov->readAllStandardOutput();
+            if (code == 0 && output.trimmed().startsWith('{'))
+                parseLater([output, base]() { return parseJson(output, base); });
+            else
+                runLegacy(dir, dataFiles);
+        }).onError([this, gen](QProcess *gcov, QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart || gen != generation)
+                return;
+            qDebug() << "can not run gcov" << gcov->errorString();
+            ingest({});
+        });
+        JobServer::instance().startWithToken(&p, "gcov", QStringList{ "--json-format", "--stdout", "-o", dir } + dataFiles);
+    }
+};
+
+CoverageEngine::CoverageEngine(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+}
+
+CoverageEngine::~CoverageEngine()
+{
+    delete priv;
+}
+
+CoverageEngine &CoverageEngine::instance()
+{
+    static CoverageEngine *singleton = nullptr;
+    if (!singleton)
+        singleton = new CoverageEngine(QCoreApplication::instance());
+    return *singleton;
+}
+
+QVector<quint32> CoverageEngine::lineTable(const QString &path) const
+{
+    return priv->table.value(path);
+}
+
+CoverageEngine::Summary CoverageEngine::summary() const
+{
+    Summary s;
+    s.files = priv->table.size();
+    for(const auto& lines: priv->table) {
+        for(auto hits: lines) {
+            if (hits == 0)
+                continue;
+            s.lines++;
+            if (hits > 1)
+                s.coveredLines++;
+        }
+    }
+    return s;
+}
+
+bool CoverageEngine::isCollecting() const
+{
+    return priv->scanning || priv->pending > 0;
+}
+
+void CoverageEngine::collect(const QString &root)
+{
+    if (root.isEmpty())
+        return;
+    priv->generation++;
+    priv->root = QDir::cleanPath(QFileInfo(root).absoluteFilePath());
+    priv->incoming.clear();
+    priv->pending = 0;
+    priv->scanning = true;
+    auto watcher = new QFutureWatcher<DataDirs>(this);
+    auto gen = priv->generation;
+    connect(watcher, &QFutureWatcher<DataDirs>::finished, this, [this, watcher, gen]() {
+        watcher->deleteLater();
+        if (gen != priv->generation)
+            return;
+        priv->scanning = false;
+        auto dirs = watcher->result();
+        if (dirs.isEmpty()) {
+            priv->pending = 1;
+            priv->ingest({});
+            return;
+        }
+        // One gcov per object directory, the jobserver spreads them over the cores
+        priv->pending = dirs.size();
+        for(auto it = dirs.begin(); it != dirs.end(); ++it)
+            priv->run(it.key(), it.value());
+    });
+    watcher->setFuture(QtConcurrent::run(findDataDirs, priv->root));
+}
+
+void CoverageEngine::clear()
+{
+    priv->generation++;
+    priv->scanning = false;
+    priv->pending = 0;
+    priv->incoming.clear();
+    priv->table.clear();
+    emit coverageChanged();
+}
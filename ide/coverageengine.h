@@ -0,0 +1,60 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef COVERAGEENGINE_H
+#define COVERAGEENGINE_H
+
+#include <QObject>
+#include <QVector>
+
+class CoverageEngine : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(CoverageEngine)
+public:
+    struct Summary {
+        int files{ 0 };
+        int lines{ 0 };
+        int coveredLines{ 0 };
+    };
+
+    static CoverageEngine &instance();
+    virtual ~CoverageEngine() override;
+
+    // Indexed by zero based line: 0 for lines without code, otherwise the execution count plus one
+    QVector<quint32> lineTable(const QString& path) const;
+    Summary summary() const;
+    bool isCollecting() const;
+
+signals:
+    void collected(const CoverageEngine::Summary& summary);
+    void coverageChanged();
+
+public slots:
+    // Runs gcov over every directory holding .gcda files below root
+    void collect(const QString& root);
+    void clear();
+
+private:
+    explicit CoverageEngine(QObject *parent = nullptr);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // COVERAGEENGINE_H
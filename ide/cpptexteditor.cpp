@@ -20,16 +20,21 @@
 #include "cpptexteditor.h"
 #include "filereferencesdialog.h"
 #include "icodemodelprovider.h"
+#include "sourceoutline.h"
+#include "staticanalyzer.h"
 #include "textmessagebrocker.h"
 
 #include <Qsci/qscilexercpp.h>
 #include <Qsci/qsciabstractapis.h>
 
+#include <QDir>
 #include <QMenu>
 
 #include <QMimeDatabase>
 #include <QRegularExpression>
 #include <QShortcut>
+#include <QStandardItemModel>
+#include <QTimer>
 #include <astyle.h>
 
 #include <QtDebug>
@@ -39,9 +44,20 @@ static const QStringList C_CXX_EXTENSIONS = { "c", "cpp", "h", "hpp", "cc", "hh"
 static const QStringList C_MIMETYPE = { "text/x-c++src", "text/x-c++hdr" };
 static const QStringList CXX_MIMETYPE = { "text/x-c", "text/x-csrc", "text/x-chdr" };
 
+static constexpr auto DIAGNOSTICS_DELAY_MS = 400;
+static constexpr auto DIAGNOSTICS_DWELL_MS = 500;
+static constexpr auto ERROR_INDICATOR = 8;
+static constexpr auto WARNING_INDICATOR = 9;
+static constexpr auto INACTIVE_INDICATOR = 10;
+static constexpr auto ANALYSIS_INDICATOR = 11;
+static constexpr auto OUTLINE_DELAY_MS = 600;
+// Secondary keywords, styled as "TYPE WORD" by the editor styles
+static constexpr auto SEMANTIC_KEYWORD_SET = 2;
+
 class MyQsciLexerCPP: public QsciLexerCPP {
 private:
-    QLatin1String keywordList;
+    mutable QByteArray keywordList;
+    mutable int keywordGeneration{ -1 };
 public:
     MyQsciLexerCPP(QObject *parent = nullptr, bool caseInsensitiveKeywords = false) :
         QsciLexerCPP(parent, caseInsensitiveKeywords)
@@ -53,24 +69,26 @@ public:
     void refreshProperties() override
     {
         QsciLexerCPP::refreshProperties();
+        // Only knows defines of this buffer, inactive code comes from the code model
         emit propertyChanged("lexer.cpp.track.preprocessor", "0");
     }
 
     const char *keywords(int set) const override
     {
-        //if (set == 5) {
-        //    updateKeywordList();
-        //    return keywordList.data();
-        //} else {
-        return QsciLexerCPP::keywords(set);
-        //}
+        if (set == SEMANTIC_KEYWORD_SET) {
+            updateKeywordList();
+            return keywordList.constData();
+        } else {
+            return QsciLexerCPP::keywords(set);
+        }
     }
 
 private:
     void updateKeywordList() const {
         auto c = qobject_cast<CodeTextEditor*>(editor());
-        if (c) {
-            // keywordList = c->keywordList();
+        if (c && c->codeModel() && c->codeModel()->indexGeneration() != keywordGeneration) {
+            keywordList = c->codeModel()->keywordList();
+            keywordGeneration = c->codeModel()->indexGeneration();
         }
     }
 };
@@ -81,16 +99,105 @@ CPPTextEditor::CPPTextEditor(QWidget *parent) : CodeTextEditor(parent)
     setAutoCompletionSource(AcsNone);
     connect(new QShortcut(QKeySequence("Ctrl+Return"), this), &QShortcut::activated, this, &CPPTextEditor::findReference);
     connect(new QShortcut(QKeySequence("Ctrl+i"), this), &QShortcut::activated, this, &CPPTextEditor::formatCode);
+
+    diagnosticsTimer = new QTimer(this);
+    diagnosticsTimer->setInterval(DIAGNOSTICS_DELAY_MS);
+    diagnosticsTimer->setSingleShot(true);
+    connect(diagnosticsTimer, &QTimer::timeout, this, &CPPTextEditor::requestDiagnostics);
+    connect(diagnosticsTimer, &QTimer::timeout, this, &CPPTextEditor::requestInactiveRegions);
+    connect(this, &QsciScintilla::textChanged, [this]() {
+        diagnosticsGeneration++;
+        if (codeModel())
+            codeModel()->cancelDiagnostics(path());
+        diagnosticsTimer->start();
+    });
+
+    SendScintilla(SCI_INDICSETSTYLE, ERROR_INDICATOR, INDIC_SQUIGGLE);
+    SendScintilla(SCI_INDICSETFORE, ERROR_INDICATOR, QColor(Qt::red));
+    SendScintilla(SCI_INDICSETSTYLE, WARNING_INDICATOR, INDIC_SQUIGGLE);
+    SendScintilla(SCI_INDICSETFORE, WARNING_INDICATOR, QColor(Qt::darkYellow));
+    SendScintilla(SCI_INDICSETSTYLE, INACTIVE_INDICATOR, INDIC_TEXTFORE);
+    SendScintilla(SCI_INDICSETFORE, INACTIVE_INDICATOR, QColor(Qt::gray));
+    SendScintilla(SCI_INDICSETSTYLE, ANALYSIS_INDICATOR, INDIC_DOTS);
+    SendScintilla(SCI_INDICSETFORE, ANALYSIS_INDICATOR, QColor(Qt::blue));
+    SendScintilla(SCI_SETMOUSEDWELLTIME, DIAGNOSTICS_DWELL_MS);
+    connect(this, &QsciScintillaBase::SCN_DWELLSTART, [this](int position, int x, int y) {
+        Q_UNUSED(x)
+        Q_UNUSED(y)
+        if (position < 0)
+            return;
+        for(auto indicator: { ERROR_INDICATOR, WARNING_INDICATOR }) {
+            auto value = SendScintilla(SCI_INDICATORVALUEAT, indicator, position);
+            if (value > 0 && value <= diagnosticMessages.size()) {
+                auto message = textAsBytes(diagnosticMessages.at(int(value) - 1));
+                SendScintilla(SCI_CALLTIPSHOW, static_cast<unsigned long>(position), message.constData());
+                return;
+            }
+        }
+        auto value = SendScintilla(SCI_INDICATORVALUEAT, ANALYSIS_INDICATOR, position);
+        if (value > 0 && value <= analysisMessages.size()) {
+            auto message = textAsBytes(analysisMessages.at(int(value) - 1));
+            SendScintilla(SCI_CALLTIPSHOW, static_cast<unsigned long>(position), message.constData());
+        }
+    });
+    connect(this, &QsciScintillaBase::SCN_DWELLEND, [this]() { SendScintilla(SCI_CALLTIPCANCEL); });
+    connect(&StaticAnalyzer::instance(), &StaticAnalyzer::resultsChanged, this, [this](const QString& file) {
+        if (file == QDir::cleanPath(path()))
+            showAnalysis();
+    });
+
+    TextMessageBrocker::instance().subscribe(this, TextMessages::SYMBOL_INDEX_UPDATED, [this](const QString& generation) {
+        Q_UNUSED(generation)
+        updateKeywords();
+    });
+
+    outline = new SourceOutline(this);
+    outlineTimer = new QTimer(this);
+    outlineTimer->setInterval(OUTLINE_DELAY_MS);
+    outlineTimer->setSingleShot(true);
+    connect(outlineTimer, &QTimer::timeout, this, &CPPTextEditor::requestOutline);
+    connect(this, &QsciScintillaBase::SCN_MODIFIED, [this](int position, int type, const char *text, int length, int linesAdded) {
+        Q_UNUSED(text)
+        Q_UNUSED(length)
+        if (!(type & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+            return;
+        // Accumulate the touched line range, in current line numbers
+        auto line = int(SendScintilla(SCI_LINEFROMPOSITION, static_cast<unsigned long>(position)));
+        auto last = line + qMax(0, linesAdded);
+        if (outlineDirtyFirst < 0) {
+            outlineDirtyFirst = line;
+            outlineDirtyLast = last;
+        } else {
+            if (line <= outlineDirtyLast)
+                outlineDirtyLast = qMax(line, outlineDirtyLast + linesAdded);
+            outlineDirtyFirst = qMin(outlineDirtyFirst, line);
+            outlineDirtyLast = qMax(outlineDirtyLast, last);
+        }
+        outlineLineDelta += linesAdded;
+        outlineTimer->start();
+    });
 }
 
 CPPTextEditor::~CPPTextEditor()
-= default;
+{
+    if (codeModel())
+        codeModel()->cancelDiagnostics(path());
+}
 
 bool CPPTextEditor::load(const QString &path)
 {
     if (codeModel())
         codeModel()->startIndexingFile(path);
-    return CodeTextEditor::load(path);
+    auto r = CodeTextEditor::load(path);
+    outlineFullParse = true;
+    requestOutline();
+    showAnalysis();
+    return r;
+}
+
+QAbstractItemModel *CPPTextEditor::outlineModel() const
+{
+    return outline->model();
 }
 
 class CPPEditorCreator: public IDocumentEditorCreator
@@ -219,6 +326,119 @@ void CPPTextEditor::triggerAutocompletion()
     }
 }
 
+void CPPTextEditor::requestDiagnostics()
+{
+    if (!codeModel() || path().isEmpty())
+        return;
+    auto generation = diagnosticsGeneration;
+    codeModel()->diagnosticsFor(path(), text(), [this, generation](const ICodeModelProvider::DiagnosticList& list) {
+        if (generation == diagnosticsGeneration)
+            showDiagnostics(list);
+    });
+}
+
+void CPPTextEditor::updateKeywords()
+{
+    auto cppLexer = lexer();
+    if (!cppLexer)
+        return;
+    auto list = cppLexer->keywords(SEMANTIC_KEYWORD_SET);
+    SendScintilla(SCI_SETKEYWORDS, SEMANTIC_KEYWORD_SET - 1, list? list : "");
+    recolor();
+}
+
+void CPPTextEditor::requestInactiveRegions()
+{
+    if (!codeModel() || path().isEmpty())
+        return;
+    auto generation = diagnosticsGeneration;
+    codeModel()->inactiveRegionsFor(path(), text(), [this, generation](const ICodeModelProvider::LineRangeList& list) {
+        if (generation == diagnosticsGeneration)
+            showInactiveRegions(list);
+    });
+}
+
+void CPPTextEditor::showInactiveRegions(const ICodeModelProvider::LineRangeList &list)
+{
+    SendScintilla(SCI_SETINDICATORCURRENT, INACTIVE_INDICATOR);
+    SendScintilla(SCI_INDICATORCLEARRANGE, 0, SendScintilla(SCI_GETLENGTH));
+    for(const auto& r: list) {
+        if (r.first < 0 || r.last >= lines())
+            continue;
+        auto start = SendScintilla(SCI_POSITIONFROMLINE, r.first);
+        auto end = SendScintilla(SCI_GETLINEENDPOSITION, r.last);
+        SendScintilla(SCI_INDICATORFILLRANGE, static_cast<unsigned long>(start), end - start);
+    }
+}
+
+void CPPTextEditor::requestOutline()
+{
+    if (outline->isBusy()) {
+        outlineTimer->start();
+        return;
+    }
+    if (outlineFullParse)
+        outline->parse(text());
+    else if (outlineDirtyFirst >= 0)
+        outline->reparse(text(), outlineDirtyFirst, outlineDirtyLast, outlineLineDelta);
+    outlineFullParse = false;
+    outlineDirtyFirst = -1;
+    outlineDirtyLast = -1;
+    outlineLineDelta = 0;
+}
+
+void CPPTextEditor::showDiagnostics(const ICodeModelProvider::DiagnosticList &list)
+{
+    using Severity = ICodeModelProvider::Diagnostic::Severity;
+    auto editorLength = SendScintilla(SCI_GETLENGTH);
+    for(auto indicator: { ERROR_INDICATOR, WARNING_INDICATOR }) {
+        SendScintilla(SCI_SETINDICATORCURRENT, indicator);
+        SendScintilla(SCI_INDICATORCLEARRANGE, 0, editorLength);
+    }
+    diagnosticMessages.clear();
+    for(const auto& d: list) {
+        if (d.severity == Severity::Note) {
+            if (!diagnosticMessages.isEmpty())
+                diagnosticMessages.last().append(QString("\n%1").arg(d.message));
+            continue;
+        }
+        auto line = d.line - 1;
+        if (line < 0 || line >= lines())
+            continue;
+        // clang columns are byte offsets, same as scintilla positions
+        auto lineStart = SendScintilla(SCI_POSITIONFROMLINE, line);
+        auto lineEnd = SendScintilla(SCI_GETLINEENDPOSITION, line);
+        auto start = qMin(lineStart + qMax(0, d.column - 1), lineEnd);
+        auto end = SendScintilla(SCI_WORDENDPOSITION, static_cast<unsigned long>(start), true);
+        if (end <= start) {
+            start = lineStart;
+            end = lineEnd;
+        }
+        diagnosticMessages.append(d.message);
+        SendScintilla(SCI_SETINDICATORCURRENT, d.severity == Severity::Error? ERROR_INDICATOR : WARNING_INDICATOR);
+        SendScintilla(SCI_SETINDICATORVALUE, diagnosticMessages.size());
+        SendScintilla(SCI_INDICATORFILLRANGE, static_cast<unsigned long>(start), end - start);
+    }
+}
+
+void CPPTextEditor::showAnalysis()
+{
+    SendScintilla(SCI_SETINDICATORCURRENT, ANALYSIS_INDICATOR);
+    SendScintilla(SCI_INDICATORCLEARRANGE, 0, SendScintilla(SCI_GETLENGTH));
+    analysisMessages.clear();
+    // Findings are from the saved file, unsaved edits may shift them a bit
+    for(const auto& d: StaticAnalyzer::instance().diagnostics(QDir::cleanPath(path()))) {
+        auto line = d.line - 1;
+        if (line < 0 || line >= lines())
+            continue;
+        analysisMessages.append(d.message);
+        SendScintilla(SCI_SETINDICATORVALUE, analysisMessages.size());
+        auto start = SendScintilla(SCI_POSITIONFROMLINE, line);
+        auto end = SendScintilla(SCI_GETLINEENDPOSITION, line);
+        SendScintilla(SCI_INDICATORFILLRANGE, static_cast<unsigned long>(start), end - start);
+    }
+}
+
 QsciLexer *CPPTextEditor::lexerFromFile(const QString &name)
 {
     Q_UNUSED(name);
@@ -20,8 +20,10 @@
 #define CPPTEXTEDITOR_H
 
 #include "codetexteditor.h"
+#include "icodemodelprovider.h"
 
-class ICodeModelProvider;
+class QTimer;
+class SourceOutline;
 
 class CPPTextEditor : public CodeTextEditor
 {
@@ -30,17 +32,39 @@ public:
     virtual ~CPPTextEditor() override;
 
     bool load(const QString &path) override;
+    QAbstractItemModel *outlineModel() const override;
 
     static IDocumentEditorCreator *creator();
 
 private slots:
     void findReference();
     void formatCode();
+    void requestDiagnostics();
+    void requestOutline();
+    void requestInactiveRegions();
 
 protected:
     QMenu *createContextualMenu() override;
     void triggerAutocompletion() override;
     QsciLexer *lexerFromFile(const QString &name) override;
+
+private:
+    void showDiagnostics(const ICodeModelProvider::DiagnosticList& list);
+    void showInactiveRegions(const ICodeModelProvider::LineRangeList& list);
+    void showAnalysis();
+    void updateKeywords();
+
+    QTimer *diagnosticsTimer;
+    QStringList diagnosticMessages;
+    QStringList analysisMessages;
+    int diagnosticsGeneration{ 0 };
+
+    SourceOutline *outline;
+    QTimer *outlineTimer;
+    int outlineDirtyFirst{ -1 };
+    int outlineDirtyLast{ -1 };
+    int outlineLineDelta{ 0 };
+    bool outlineFullParse{ true };
 };
 
 #endif // CPPTEXTEDITOR_H
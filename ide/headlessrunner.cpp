@@ -0,0 +1,145 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "buildmanager.h"
+#include "clangautocompletionprovider.h"
+#include "headlessrunner.h"
+#include "processmanager.h"
+#include "projectmanager.h"
+#include "textmessagebrocker.h"
+
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTimer>
+
+#include <cstdio>
+
+#include <QtDebug>
+
+namespace {
+
+void writeTo(FILE *f, const QString& text)
+{
+    auto data = text.toLocal8Bit();
+    std::fwrite(data.constData(), 1, size_t(data.size()), f);
+    std::fflush(f);
+}
+
+// Console messages are HTML for the GUI log
+QString plainText(QString html)
+{
+    static const QRegularExpression BREAK_RE{ "<br\\s*/?>" };
+    static const QRegularExpression TAG_RE{ "<[^>]*>" };
+    html.replace(BREAK_RE, "\n").remove(TAG_RE);
+    html.replace("&nbsp;", " ").replace("&lt;", "<").replace("&gt;", ">")
+            .replace("&quot;", "\"").replace("&amp;", "&");
+    if (!html.endsWith('\n'))
+        html.append('\n');
+    return html;
+}
+
+}
+
+class HeadlessRunner::Priv_t
+{
+public:
+    ProcessManager *pman{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QEventLoop loop;
+    int status{ 0 };
+    int pending{ 0 };
+
+    bool checkMakefile(const QString& makefile) const {
+        if (!QFileInfo(makefile).isFile()) {
+            writeTo(stderr, HeadlessRunner::tr("%1: no such makefile\n").arg(makefile));
+            return false;
+        }
+        return true;
+    }
+};
+
+HeadlessRunner::HeadlessRunner(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->pman = new ProcessManager(this);
+    priv->proj = new ProjectManager(nullptr, priv->pman, this);
+    auto &brocker = TextMessageBrocker::instance();
+    brocker.subscribe(this, TextMessages::STDOUT_LOG, [](const QString& msg) { writeTo(stdout, plainText(msg)); });
+    brocker.subscribe(this, TextMessages::STDERR_LOG, [](const QString& msg) { writeTo(stderr, plainText(msg)); });
+    brocker.subscribe(this, TextMessages::ACTION_LABEL, [](const QString& msg) {
+        if (!msg.isEmpty())
+            writeTo(stderr, msg + '\n');
+    });
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+    delete priv;
+}
+
+int HeadlessRunner::build(const QString &makefile, const QString &target)
+{
+    if (!priv->checkMakefile(makefile))
+        return 1;
+    auto builder = new BuildManager(priv->proj, priv->pman, this);
+    connect(builder, &BuildManager::jobProcessCreated, this, [this](const QString& name) {
+        priv->pman->setStdoutInterceptor(name, [](QProcess *, const QString& text) { writeTo(stdout, text); });
+        priv->pman->setStderrInterceptor(name, [](QProcess *, const QString& text) { writeTo(stderr, text); });
+    });
+    connect(builder, &BuildManager::buildTerminated, this, [this](const QString& t, int code, const QString& error) {
+        if (code != 0) {
+            writeTo(stderr, tr("%1: %2 (exit code %3)\n").arg(t, error).arg(code));
+            // Failing to start reports -1, still a failure for the caller
+            priv->status = qMax(priv->status, code > 0? code : 1);
+        }
+    });
+    connect(builder, &BuildManager::queueFinished, this, [this]() { priv->loop.exit(priv->status); });
+    // Make variables from the discover pick the same compilers as the GUI
+    connect(priv->proj, &ProjectManager::discoverFinished, builder, [builder, target]() {
+        builder->startBuild(target);
+    });
+    priv->proj->openProject(makefile);
+    return priv->loop.exec();
+}
+
+int HeadlessRunner::index(const QString &makefile)
+{
+    if (!priv->checkMakefile(makefile))
+        return 1;
+    auto provider = new ClangAutocompletionProvider(priv->proj, this);
+    priv->proj->setCodeModelProvider(provider);
+    priv->pending = 2;
+    auto done = [this](bool ok) {
+        if (!ok)
+            priv->status = 1;
+        if (--priv->pending == 0)
+            priv->loop.exit(priv->status);
+    };
+    connect(priv->proj, &ProjectManager::discoverFinished, this, done);
+    connect(provider, &ClangAutocompletionProvider::projectIndexFinished, this, [done](bool ok, int symbols) {
+        if (ok)
+            writeTo(stdout, tr("%1 symbols indexed\n").arg(symbols));
+        else
+            writeTo(stderr, tr("ctags failed, %1 symbols indexed\n").arg(symbols));
+        done(ok);
+    });
+    priv->proj->openProject(makefile);
+    return priv->loop.exec();
+}
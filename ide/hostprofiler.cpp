@@ -0,0 +1,444 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "childprocess.h"
+#include "hostprofiler.h"
+#include "processmanager.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QStandardItemModel>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <memory>
+
+#include <QtDebug>
+
+const QString HostProfiler::PROCESS_NAME = "hostProfile";
+
+// The long tail of tiny functions only hides the hot ones
+static constexpr auto MAX_HOTSPOTS = 500;
+static constexpr auto PERF_FREQUENCY = "999";
+
+namespace {
+
+using FunctionCost = HostProfiler::FunctionCost;
+using LineCosts = QHash<QString, QHash<int, double>>;
+
+struct ProfileResult {
+    LineCosts lines;
+    // Hottest first
+    QList<FunctionCost> functions;
+};
+
+const QRegularExpression COMPRESSED_RE{ R"(^\((\d+)\)\s*(.*)$)" };
+const QRegularExpression SRCLINE_RE{ R"(^(.+):(\d+)(?:\s.*)?$)" };
+const QRegularExpression SYMBOL_PREFIX_RE{ R"(^\[.\]\s*)" };
+const QRegularExpression SPACES_RE{ R"(\s+)" };
+
+QString resolve(const QString& base, const QString& file)
+{
+    if (file.isEmpty() || file.startsWith("??"))
+        return {};
+    return QDir::cleanPath(QDir(base).absoluteFilePath(file));
+}
+
+// Callgrind names a file or function once as "(id) name", later only as "(id)"
+QString uncompress(QHash<QString, QString> *names, const QString& value)
+{
+    auto m = COMPRESSED_RE.match(value);
+    if (!m.hasMatch())
+        return value;
+    if (!m.captured(2).isEmpty())
+        names->insert(m.captured(1), m.captured(2));
+    return names->value(m.captured(1));
+}
+
+ProfileResult normalize(LineCosts lines, const QHash<QString, FunctionCost>& functions, double total)
+{
+    ProfileResult r;
+    if (total <= 0)
+        return r;
+    for(auto& file: lines)
+        for(auto& cost: file)
+            cost /= total;
+    r.lines = lines;
+    for(auto f: functions) {
+        f.self /= total;
+        r.functions.append(f);
+    }
+    std::sort(r.functions.begin(), r.functions.end(), [](const FunctionCost& a, const FunctionCost& b) {
+        return a.self > b.self;
+    });
+    return r;
+}
+
+void account(LineCosts *lines, QHash<QString, FunctionCost> *functions,
+             const QString& function, const QString& file, int line, double cost, bool ownFile)
+{
+    if (!file.isEmpty() && line > 0)
+        (*lines)[file][line] += cost;
+    auto& f = (*functions)[function];
+    f.name = function;
+    f.self += cost;
+    // The lowest line seen in its own file is close enough to the definition
+    if (ownFile && !file.isEmpty() && line > 0 && (f.file.isEmpty() || (f.file == file && line < f.line))) {
+        f.file = file;
+        f.line = line;
+    }
+}
+
+ProfileResult parseCallgrind(const QString& path, const QString& base)
+{
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly | QFile::Text))
+        return {};
+    QHash<QString, QString> fileNames;
+    QHash<QString, QString> functionNames;
+    LineCosts lines;
+    QHash<QString, FunctionCost> functions;
+    QString fl, fi, fn;
+    int lineField = 0;
+    QVector<qint64> position(1, 0);
+    auto callCost = false;
+    double total = 0;
+    while (!f.atEnd()) {
+        auto line = QString::fromUtf8(f.readLine()).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        auto first = line.at(0);
+        if (first.isDigit() || first == '+' || first == '-' || first == '*') {
+            auto tokens = line.split(SPACES_RE, QString::SkipEmptyParts);
+            for(int i = 0; i < position.size() && i < tokens.size(); i++) {
+                const auto& t = tokens.at(i);
+                if (t.startsWith('+'))
+                    position[i] += t.mid(1).toLongLong(nullptr, 0);
+                else if (t.startsWith('-'))
+                    position[i] -= t.mid(1).toLongLong(nullptr, 0);
+                else if (t != "*")
+                    position[i] = t.toLongLong(nullptr, 0);
+            }
+            // The line after calls= holds the inclusive cost of the call, not own work
+            if (callCost) {
+                callCost = false;
+                continue;
+            }
+            auto cost = tokens.value(position.size()).toDouble();
+            if (cost <= 0)
+                continue;
+            total += cost;
+            account(&lines, &functions, fn, fi, int(position.at(lineField)), cost, fi == fl);
+            continue;
+        }
+        if (line.startsWith("positions:")) {
+            auto kinds = line.mid(10).split(SPACES_RE, QString::SkipEmptyParts);
+            lineField = qMax(0, kinds.indexOf("line"));
+            position.fill(0, qMax(1, kinds.size()));
+            continue;
+        }
+        auto eq = line.indexOf('=');
+        if (eq < 0)
+            continue;
+        auto key = line.left(eq);
+        auto value = line.mid(eq + 1);
+        if (key == "fl") {
+            fl = resolve(base, uncompress(&fileNames, value));
+            fi = fl;
+        } else if (key == "fi" || key == "fe") {
+            fi = resolve(base, uncompress(&fileNames, value));
+        } else if (key == "fn") {
+            fn = uncompress(&functionNames, value);
+            fi = fl;
+        } else if (key == "cfl" || key == "cfi") {
+            uncompress(&fileNames, value);
+        } else if (key == "cfn") {
+            uncompress(&functionNames, value);
+        } else if (key == "calls") {
+            callCost = true;
+        }
+    }
+    return normalize(lines, functions, total);
+}
+
+// perf report --stdio -t ';' with srcline,sym sort keys: "overhead;file:line;[.] symbol"
+ProfileResult parsePerfReport(const QByteArray& output, const QString& base)
+{
+    LineCosts lines;
+    QHash<QString, FunctionCost> functions;
+    double total = 0;
+    for(const auto& raw: output.split('\n')) {
+        auto line = QString::fromLocal8Bit(raw).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        auto fields = line.split(';');
+        if (fields.size() < 3)
+            continue;
+        auto share = fields.at(0).trimmed().remove('%').toDouble();
+        if (share <= 0)
+            continue;
+        total += share;
+        auto symbol = fields.mid(2).join(';').trimmed().remove(SYMBOL_PREFIX_RE);
+        auto m = SRCLINE_RE.match(fields.at(1).trimmed());
+        auto file = m.hasMatch()? resolve(base, m.captured(1)) : QString();
+        account(&lines, &functions, symbol, file, m.hasMatch()? m.captured(2).toInt() : 0, share, true);
+    }
+    return normalize(lines, functions, total);
+}
+
+}
+
+class HostProfiler::Priv_t
+{
+public:
+    HostProfiler *q{ nullptr };
+    ProcessManager *pman{ nullptr };
+    QStandardItemModel *model{ nullptr };
+    ProfileResult result;
+    std::shared_ptr<QTemporaryDir> tmp;
+    QPointer<ChildProcess> reporter;
+    Tool tool{ Tool::Perf };
+    QString program;
+    QString workingDir;
+    bool running{ false };
+    int generation{ 0 };
+
+    QString dataFile() const {
+        return tmp->filePath(tool == Tool::Perf? "perf.data" : "callgrind.out");
+    }
+
+    void fail(const QString& message) {
+        running = false;
+        emit q->finished(false, message);
+    }
+
+    void ingest(const ProfileResult& r) {
+        running = false;
+        result = r;
+        model->removeRows(0, model->rowCount());
+        auto base = QDir(workingDir);
+        for(const auto& f: result.functions.mid(0, MAX_HOTSPOTS)) {
+            auto nameItem = new QStandardItem(f.name);
+            // Numeric so the view sorts by cost
+            auto costItem = new QStandardItem;
+            costItem->setData(qRound(f.self * 1000) / 10.0, Qt::DisplayRole);
+            auto location = f.file.isEmpty()? QString() : QString("%1:%2").arg(base.relativeFilePath(f.file)).arg(f.line);
+            auto locationItem = new QStandardItem(location);
+            for(auto item: { nameItem, costItem, locationItem }) {
+                item->setEditable(false);
+                item->setToolTip(f.name);
+                item->setData(f.file, FILE_ROLE);
+                item->setData(f.line, LINE_ROLE);
+            }
+            model->appendRow({ nameItem, costItem, locationItem });
+        }
+        emit q->resultsChanged();
+        if (result.functions.isEmpty())
+            emit q->finished(false, HostProfiler::tr("No samples in the profile of %1").arg(program));
+        else
+            emit q->finished(true, HostProfiler::tr("Profile of %1 ready, hottest function %2 with %3% self")
+                             .arg(program, result.functions.first().name)
+                             .arg(result.functions.first().self * 100, 0, 'f', 1));
+    }
+
+    template<typename F>
+    void parseLater(F parser) {
+        auto watcher = new QFutureWatcher<ProfileResult>(q);
+        auto gen = generation;
+        QObject::connect(watcher, &QFutureWatcher<ProfileResult>::finished, q, [this, watcher, gen]() {
+            watcher->deleteLater();
+            if (gen == generation)
+                ingest(watcher->result());
+        });
+        watcher->setFuture(QtConcurrent::run(parser));
+    }
+
+    void report() {
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(workingDir)
+                .makeDeleteLater();
+        reporter = &p;
+        auto gen = generation;
+        p.onFinished([this, gen](QProcess *perf, int code) {
+            if (gen != generation)
+                return;
+            if (code != 0) {
+                fail(HostProfiler::tr("perf report failed: %1")
+                     .arg(QString::fromLocal8Bit(perf->readAllStandardError()).trimmed().section('\n', 0, 0)));
+                return;
+            }
+            auto output = perf->readAllStandardOutput();
+            auto base = workingDir;
+            parseLater([output, base]() { return parsePerfReport(output, base); });
+        }).onError([this, gen](QProcess *perf, QProcess::ProcessError err) {
+            if (err == QProcess::FailedToStart && gen == generation)
+                fail(HostProfiler::tr("Can not run %1: %2").arg(perf->program(), perf->errorString()));
+        });
+        // Resolving source lines needs addr2line over the whole binary, hence the background
+        p.start("perf", { "report", "-i", dataFile(), "--stdio", "--no-children",
+                          "--sort", "srcline,sym", "--field-separator", ";" });
+    }
+
+    void recorded() {
+        if (!running)
+            return;
+        if (QFileInfo(dataFile()).size() == 0) {
+            fail(HostProfiler::tr("%1 wrote no profile for %2, see the console")
+                 .arg(HostProfiler::toolName(tool), program));
+            return;
+        }
+        if (tool == Tool::Perf) {
+            report();
+        } else {
+            auto data = dataFile();
+            auto base = workingDir;
+            parseLater([data, base]() { return parseCallgrind(data, base); });
+        }
+    }
+};
+
+HostProfiler::HostProfiler(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({ tr("Function"), tr("Self (%)"), tr("Location") });
+}
+
+HostProfiler::~HostProfiler()
+{
+    delete priv;
+}
+
+HostProfiler &HostProfiler::instance()
+{
+    static HostProfiler *singleton = nullptr;
+    if (!singleton)
+        singleton = new HostProfiler(QCoreApplication::instance());
+    return *singleton;
+}
+
+QList<HostProfiler::Tool> HostProfiler::installedTools()
+{
+    QList<Tool> list;
+    if (!QStandardPaths::findExecutable("perf").isEmpty())
+        list.append(Tool::Perf);
+    if (!QStandardPaths::findExecutable("valgrind").isEmpty())
+        list.append(Tool::Callgrind);
+    return list;
+}
+
+QString HostProfiler::toolName(HostProfiler::Tool tool)
+{
+    return tool == Tool::Perf? "perf" : "callgrind";
+}
+
+void HostProfiler::setProcessManager(ProcessManager *pman)
+{
+    priv->pman = pman;
+    pman->setTerminationHandler(PROCESS_NAME, [this](QProcess *proc, int code, QProcess::ExitStatus status) {
+        Q_UNUSED(proc)
+        Q_UNUSED(code)
+        Q_UNUSED(status)
+        // Also after a stop, both profilers keep what was sampled until then
+        priv->recorded();
+    });
+    pman->setErrorHandler(PROCESS_NAME, [this](QProcess *proc, QProcess::ProcessError err) {
+        if (err == QProcess::FailedToStart && priv->running)
+            priv->fail(tr("Can not run %1: %2").arg(proc->program(), proc->errorString()));
+    });
+}
+
+QStandardItemModel *HostProfiler::hotspots() const
+{
+    return priv->model;
+}
+
+bool HostProfiler::isRunning() const
+{
+    return priv->running;
+}
+
+QHash<int, double> HostProfiler::lineCosts(const QString &path) const
+{
+    return priv->result.lines.value(path);
+}
+
+QList<HostProfiler::FunctionCost> HostProfiler::functionsIn(const QString &path) const
+{
+    QList<FunctionCost> list;
+    for(const auto& f: priv->result.functions)
+        if (f.file == path)
+            list.append(f);
+    return list;
+}
+
+void HostProfiler::profile(HostProfiler::Tool tool, const QString &program, const QStringList &args, const QString &workingDir)
+{
+    if (!priv->pman || priv->running)
+        return;
+    priv->generation++;
+    priv->tmp = std::make_shared<QTemporaryDir>();
+    priv->tool = tool;
+    priv->program = program;
+    priv->workingDir = workingDir;
+    priv->running = true;
+    QString command;
+    QStringList toolArgs;
+    if (tool == Tool::Perf) {
+        command = "perf";
+        toolArgs = QStringList{ "record", "-F", PERF_FREQUENCY, "-o", priv->dataFile(), "--", program } + args;
+    } else {
+        command = "valgrind";
+        toolArgs = QStringList{ "--tool=callgrind", QString("--callgrind-out-file=%1").arg(priv->dataFile()), program } + args;
+    }
+    emit started(program);
+    priv->pman->start(PROCESS_NAME, command, toolArgs, {}, workingDir);
+}
+
+void HostProfiler::stop()
+{
+    if (!priv->running)
+        return;
+    if (priv->reporter) {
+        priv->generation++;
+        priv->reporter->stop();
+        priv->fail(tr("Profiling stopped"));
+    } else if (priv->pman) {
+        priv->pman->terminate(PROCESS_NAME);
+    }
+}
+
+void HostProfiler::clear()
+{
+    priv->generation++;
+    priv->running = false;
+    priv->result = ProfileResult();
+    priv->tmp.reset();
+    priv->model->removeRows(0, priv->model->rowCount());
+    emit resultsChanged();
+}
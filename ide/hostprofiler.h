@@ -0,0 +1,79 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOSTPROFILER_H
+#define HOSTPROFILER_H
+
+#include <QHash>
+#include <QObject>
+
+class QStandardItemModel;
+
+class ProcessManager;
+
+class HostProfiler : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(HostProfiler)
+public:
+    enum class Tool { Perf, Callgrind };
+
+    struct FunctionCost {
+        QString name;
+        QString file;
+        int line{ 0 };
+        // Share of the whole profile, 0 to 1
+        double self{ 0 };
+    };
+
+    static const QString PROCESS_NAME;
+
+    static constexpr auto FILE_ROLE = Qt::UserRole + 1;
+    static constexpr auto LINE_ROLE = Qt::UserRole + 2;
+
+    static HostProfiler &instance();
+    virtual ~HostProfiler() override;
+
+    static QList<Tool> installedTools();
+    static QString toolName(Tool tool);
+
+    void setProcessManager(ProcessManager *pman);
+    QStandardItemModel *hotspots() const;
+    bool isRunning() const;
+    // One based line to its share of the whole profile
+    QHash<int, double> lineCosts(const QString& path) const;
+    QList<FunctionCost> functionsIn(const QString& path) const;
+
+signals:
+    void started(const QString& program);
+    void finished(bool ok, const QString& message);
+    void resultsChanged();
+
+public slots:
+    void profile(HostProfiler::Tool tool, const QString& program, const QStringList& args, const QString& workingDir);
+    void stop();
+    void clear();
+
+private:
+    explicit HostProfiler(QObject *parent = nullptr);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // HOSTPROFILER_H
@@ -49,14 +49,49 @@ public:
     };
     typedef QList<FileReference> FileReferenceList;
 
+    struct Diagnostic {
+        enum class Severity { Note, Warning, Error };
+
+        int line = -1;
+        int column = -1;
+        Severity severity = Severity::Error;
+        QString message;
+    };
+    typedef QList<Diagnostic> DiagnosticList;
+
+    // Zero based, both ends included
+    struct LineRange {
+        int first = -1;
+        int last = -1;
+    };
+    typedef QList<LineRange> LineRangeList;
+
+    // The exact compiler invocation make uses for a translation unit, without -c/-o/-M*
+    struct CompileCommand {
+        QString program;
+        QStringList arguments;
+        QString workingDirectory;
+
+        bool isEmpty() const { return program.isEmpty(); }
+    };
+
     typedef std::function<void (const FileReferenceList& ref)> FindReferenceCallback_t;
     typedef std::function<void (const QStringList& completionList)> CompletionCallback_t;
+    typedef std::function<void (const DiagnosticList& diagnostics)> DiagnosticsCallback_t;
+    typedef std::function<void (const LineRangeList& inactive)> InactiveRegionsCallback_t;
 
     virtual void startIndexingProject(const QString& path) = 0;
     virtual void startIndexingFile(const QString& path) = 0;
+    virtual int indexGeneration() const = 0;
+    virtual QByteArray keywordList() const = 0;
 
     virtual void referenceOf(const QString& entity, FindReferenceCallback_t cb) = 0;
     virtual void completionAt(const FileReference& ref, const QString& unsaved, CompletionCallback_t cb) = 0;
+    virtual void diagnosticsFor(const QString& path, const QString& unsaved, DiagnosticsCallback_t cb) = 0;
+    virtual void cancelDiagnostics(const QString& path) = 0;
+    virtual void inactiveRegionsFor(const QString& path, const QString& unsaved, InactiveRegionsCallback_t cb) = 0;
+    virtual QStringList wordCompletions(const QString& prefix, const QString& path) = 0;
+    virtual CompileCommand compileCommandFor(const QString& path) const = 0;
 };
 
 #endif // ICPPCODEMODELPROVIDER_H
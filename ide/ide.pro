@@ -69,7 +69,26 @@ SOURCES += \
     mapfileviewer.cpp \
     textmessagebrocker.cpp \
     regexhtmltranslator.cpp \
-    imageviewer.cpp
+    imageviewer.cpp \
+    projectfilewatcher.cpp \
+    wordindex.cpp \
+    sourceoutline.cpp \
+    preprocessorevaluator.cpp \
+    buildoutputparser.cpp \
+    jobserver.cpp \
+    buildprofiler.cpp \
+    compilecache.cpp \
+    buildstamps.cpp \
+    buildconfigurations.cpp \
+    buildconfigurationsdialog.cpp \
+    headlessrunner.cpp \
+    processhistory.cpp \
+    buildtimes.cpp \
+    buildwatcher.cpp \
+    staticanalyzer.cpp \
+    testrunner.cpp \
+    coverageengine.cpp \
+    hostprofiler.cpp
 
 HEADERS += \
     buttoneditoritemdelegate.h \
@@ -107,7 +126,26 @@ HEADERS += \
     mapfileviewer.h \
     textmessagebrocker.h \
     regexhtmltranslator.h \
-    imageviewer.h
+    imageviewer.h \
+    projectfilewatcher.h \
+    wordindex.h \
+    sourceoutline.h \
+    preprocessorevaluator.h \
+    buildoutputparser.h \
+    jobserver.h \
+    buildprofiler.h \
+    compilecache.h \
+    buildstamps.h \
+    buildconfigurations.h \
+    buildconfigurationsdialog.h \
+    headlessrunner.h \
+    processhistory.h \
+    buildtimes.h \
+    buildwatcher.h \
+    staticanalyzer.h \
+    testrunner.h \
+    coverageengine.h \
+    hostprofiler.h
 
 FORMS += \
         mainwindow.ui \
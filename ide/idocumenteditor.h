@@ -30,6 +30,7 @@
 #include <functional>
 
 class ICodeModelProvider;
+class QAbstractItemModel;
 
 class IDocumentEditor
 {
@@ -51,6 +52,7 @@ public:
     virtual void setModified(bool m) = 0;
     virtual QPoint cursor() const = 0;
     virtual void setCursor(const QPoint& pos) = 0;
+    virtual QAbstractItemModel *outlineModel() const { return nullptr; }
 
     void setDocumentManager(DocumentManager *man) { this->man = man; }
     DocumentManager *documentManager() const { return this->man; }
@@ -0,0 +1,297 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "childprocess.h"
+#include "jobserver.h"
+
+#include <QCoreApplication>
+#include <QPointer>
+#include <QProcess>
+#include <QQueue>
+#include <QSocketNotifier>
+#include <QTemporaryDir>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <memory>
+
+#include <QtDebug>
+
+// Same token byte GNU make writes back to its own pipe
+static constexpr char TOKEN = '+';
+
+static int configuredJobs()
+{
+    auto &c = AppConfig::instance();
+    return qMax(1, c.numberOfJobsOptimal()? QThread::idealThreadCount() : c.numberOfJobs());
+}
+
+class JobServer::Priv_t
+{
+public:
+    struct Waiter {
+        QPointer<QObject> context;
+        std::function<void ()> granted;
+        bool background;
+    };
+
+    QTemporaryDir dir;
+    int ownFd{ -1 };
+    int childFd{ -1 };
+    int jobs{ 1 };
+    int debt{ 0 };
+    bool backgroundHeld{ false };
+    QSocketNotifier *notifier{ nullptr };
+    QQueue<Waiter> waiters;
+
+    bool readToken() {
+#ifdef Q_OS_UNIX
+        char c;
+        ssize_t r;
+        do {
+            r = ::read(ownFd, &c, 1);
+        } while (r < 0 && errno == EINTR);
+        return r == 1;
+#else
+        return false;
+#endif
+    }
+
+    void writeTokens(int n) {
+#ifdef Q_OS_UNIX
+        for(int i = 0; i < n; i++) {
+            ssize_t r;
+            do {
+                r = ::write(ownFd, &TOKEN, 1);
+            } while (r < 0 && errno == EINTR);
+        }
+#else
+        Q_UNUSED(n)
+#endif
+    }
+
+    bool takeToken() {
+        while (readToken()) {
+            if (debt == 0)
+                return true;
+            debt--;
+        }
+        return false;
+    }
+
+    void dispatch() {
+        while (debt > 0 && readToken())
+            debt--;
+        int i = 0;
+        while (i < waiters.size()) {
+            if (!waiters.at(i).context) {
+                waiters.removeAt(i);
+                continue;
+            }
+            if (backgroundHeld && waiters.at(i).background) {
+                i++;
+                continue;
+            }
+            if (!takeToken())
+                break;
+            // Remove before the call, the callback may acquire again
+            waiters.takeAt(i).granted();
+        }
+        if (notifier)
+            notifier->setEnabled(hasEligibleWaiter() || debt > 0);
+    }
+
+    bool hasEligibleWaiter() const {
+        for(const auto& w: waiters)
+            if (!backgroundHeld || !w.background)
+                return true;
+        return false;
+    }
+
+    void enqueue(QObject *context, const std::function<void ()>& granted, bool background) {
+        waiters.enqueue({ context, granted, background });
+        dispatch();
+    }
+};
+
+JobServer::JobServer(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->jobs = configuredJobs();
+#ifdef Q_OS_UNIX
+    if (priv->dir.isValid()) {
+        auto path = priv->dir.filePath("jobserver").toLocal8Bit();
+        if (::mkfifo(path.constData(), S_IRUSR | S_IWUSR) == 0) {
+            // Separate open file descriptions so O_NONBLOCK never reaches make
+            priv->ownFd = ::open(path.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            priv->childFd = ::open(path.constData(), O_RDWR);
+        }
+    }
+    if (priv->ownFd < 0 || priv->childFd < 0) {
+        qDebug() << "jobserver unavailable, builds fall back to -j";
+        if (priv->ownFd >= 0)
+            ::close(priv->ownFd);
+        if (priv->childFd >= 0)
+            ::close(priv->childFd);
+        priv->ownFd = priv->childFd = -1;
+    } else {
+        // Makes take a token before starting like any other child, that one covers their implicit job
+        priv->writeTokens(priv->jobs);
+        priv->notifier = new QSocketNotifier(priv->ownFd, QSocketNotifier::Read, this);
+        priv->notifier->setEnabled(false);
+        connect(priv->notifier, &QSocketNotifier::activated, [this]() { priv->dispatch(); });
+    }
+#endif
+    connect(&AppConfig::instance(), &AppConfig::configChanged, [this]() { setJobs(configuredJobs()); });
+}
+
+JobServer::~JobServer()
+{
+#ifdef Q_OS_UNIX
+    if (priv->ownFd >= 0)
+        ::close(priv->ownFd);
+    if (priv->childFd >= 0)
+        ::close(priv->childFd);
+#endif
+    delete priv;
+}
+
+JobServer &JobServer::instance()
+{
+    static JobServer *singleton = nullptr;
+    if (!singleton)
+        singleton = new JobServer(QCoreApplication::instance());
+    return *singleton;
+}
+
+bool JobServer::isAvailable() const
+{
+    return priv->ownFd >= 0;
+}
+
+int JobServer::jobs() const
+{
+    return priv->jobs;
+}
+
+QHash<QString, QString> JobServer::makeEnvironment() const
+{
+    if (!isAvailable())
+        return {};
+    return {
+        { "MAKEFLAGS", QString(" -j --jobserver-auth=%1,%1").arg(priv->childFd) }
+    };
+}
+
+void JobServer::acquire(QObject *context, const std::function<void ()> &granted)
+{
+    if (!isAvailable()) {
+        granted();
+        return;
+    }
+    priv->enqueue(context, granted, false);
+}
+
+void JobServer::release()
+{
+    if (!isAvailable())
+        return;
+    if (priv->debt > 0)
+        priv->debt--;
+    else
+        priv->writeTokens(1);
+    priv->dispatch();
+}
+
+void JobServer::startWithToken(QProcess *proc, const QString &program, const QStringList &args)
+{
+    auto child = qobject_cast<ChildProcess*>(proc);
+    auto background = child && child->priorityClass() == ChildProcess::Priority::Background;
+    auto start = [this, proc, child, program, args]() {
+        // Process slots are reused, so the hooks go away with the token they give back
+        auto hooks = std::make_shared<QList<QMetaObject::Connection>>();
+        QPointer<ChildProcess> holder = child;
+        auto giveBack = [this, hooks, holder]() {
+            if (hooks->isEmpty())
+                return;
+            for(const auto& c: *hooks)
+                disconnect(c);
+            hooks->clear();
+            if (holder)
+                holder->setHoldsToken(false);
+            release();
+        };
+        hooks->append(connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, giveBack));
+        hooks->append(connect(proc, &QProcess::errorOccurred, this, [giveBack](QProcess::ProcessError err) {
+            if (err == QProcess::FailedToStart)
+                giveBack();
+        }));
+        hooks->append(connect(proc, &QObject::destroyed, this, giveBack));
+        if (child)
+            child->setHoldsToken(isAvailable());
+        proc->start(program, args);
+    };
+    if (!isAvailable())
+        start();
+    else
+        priv->enqueue(proc, start, background);
+}
+
+bool JobServer::cancel(QObject *context)
+{
+    auto before = priv->waiters.size();
+    for(int i = priv->waiters.size() - 1; i >= 0; i--)
+        if (priv->waiters.at(i).context == context)
+            priv->waiters.removeAt(i);
+    return priv->waiters.size() != before;
+}
+
+void JobServer::setBackgroundHeld(bool held)
+{
+    priv->backgroundHeld = held;
+    if (isAvailable())
+        priv->dispatch();
+}
+
+void JobServer::setJobs(int n)
+{
+    n = qMax(1, n);
+    if (!isAvailable()) {
+        priv->jobs = n;
+        return;
+    }
+    auto delta = n - priv->jobs;
+    priv->jobs = n;
+    if (delta > 0) {
+        auto paid = qMin(priv->debt, delta);
+        priv->debt -= paid;
+        priv->writeTokens(delta - paid);
+    } else {
+        // Tokens lent to running makes are swallowed as they come back
+        priv->debt -= delta;
+    }
+    priv->dispatch();
+}
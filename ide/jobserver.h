@@ -0,0 +1,65 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <QHash>
+#include <QObject>
+
+#include <functional>
+
+class QProcess;
+
+class JobServer : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(JobServer)
+public:
+    static JobServer &instance();
+    virtual ~JobServer() override;
+
+    bool isAvailable() const;
+    int jobs() const;
+
+    // Extra environment that makes a GNU make child join the shared pool
+    QHash<QString, QString> makeEnvironment() const;
+
+    // The callback owns one token and must release() it, dropped when context dies first
+    void acquire(QObject *context, const std::function<void ()>& granted);
+    void release();
+
+    // Starts the process when a token is available and gives it back when it ends
+    void startWithToken(QProcess *proc, const QString& program, const QStringList& args);
+    // Forgets requests still waiting for a token, true when there was one
+    bool cancel(QObject *context);
+
+    // Background processes stay queued without a token while held
+    void setBackgroundHeld(bool held);
+
+public slots:
+    void setJobs(int n);
+
+private:
+    explicit JobServer(QObject *parent = nullptr);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // JOBSERVER_H
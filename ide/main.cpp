@@ -17,13 +17,16 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "headlessrunner.h"
 #include "mainwindow.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QDir>
 #include <QFont>
 #include <QFontDatabase>
 #include <QIcon>
+#include <QLoggingCategory>
 #include <QNetworkProxy>
 #include <QNetworkProxyFactory>
 #include <QProcess>
@@ -32,12 +35,48 @@
 
 #include <QtDebug>
 
+// Decided before any application object exists, CI machines have no display for QApplication
+static bool isHeadless(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; i++) {
+        auto arg = QByteArray(argv[i]);
+        if (arg == "--build" || arg.startsWith("--build=") || arg == "--index")
+            return true;
+    }
+    return false;
+}
+
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser opt;
+    opt.addHelpOption();
+    opt.addOptions({
+                       { "build", "Build a target and exit with the make status", "target" },
+                       { "index", "Discover targets and index symbols, then exit" },
+                       { "project", "Project Makefile, ./Makefile by default", "makefile" }
+                   });
+    opt.process(app);
+    // stdout and stderr carry the make output only
+    QLoggingCategory::setFilterRules("*.debug=false");
+    AppConfig::instance().load();
+
+    auto makefile = opt.isSet("project")? opt.value("project") : QDir::current().absoluteFilePath("Makefile");
+    HeadlessRunner runner;
+    if (opt.isSet("build"))
+        return runner.build(makefile, opt.value("build"));
+    return runner.index(makefile);
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication::setApplicationName("Embedded IDE");
     QCoreApplication::setOrganizationName("none");
     QCoreApplication::setOrganizationDomain("unknown.tk");
 
+    if (isHeadless(argc, argv))
+        return runHeadless(argc, argv);
+
     QApplication app(argc, argv);
     QApplication::setWindowIcon(QIcon(AppConfig::resourceImage("embedded-ide" )));
     QTranslator tr;
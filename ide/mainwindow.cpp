@@ -21,13 +21,22 @@
 #include "ui_mainwindow.h"
 
 #include "appconfig.h"
+#include "buildconfigurationsdialog.h"
 #include "buildmanager.h"
+#include "buildoutputparser.h"
+#include "buildprofiler.h"
+#include "buildwatcher.h"
 #include "consoleinterceptor.h"
+#include "coverageengine.h"
 #include "filesystemmanager.h"
+#include "hostprofiler.h"
 #include "idocumenteditor.h"
 #include "externaltoolmanager.h"
+#include "processhistory.h"
 #include "processmanager.h"
 #include "projectmanager.h"
+#include "staticanalyzer.h"
+#include "testrunner.h"
 #include "unsavedfilesdialog.h"
 #include "version.h"
 #include "newprojectdialog.h"
@@ -35,7 +44,6 @@
 #include "findinfilesdialog.h"
 #include "clangautocompletionprovider.h"
 #include "textmessagebrocker.h"
-#include "regexhtmltranslator.h"
 #include "templatemanager.h"
 #include "templateitemwidget.h"
 #include "templatefile.h"
@@ -47,11 +55,20 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QFileSystemModel>
+#include <QListView>
 #include <QShortcut>
 #include <QStandardItemModel>
 #include <QFileSystemWatcher>
 #include <QTextBrowser>
 #include <QDialogButtonBox>
+#include <QTabWidget>
+#include <QTreeView>
+#include <QHeaderView>
+#include <QInputDialog>
+#include <QGuiApplication>
+#include <QSortFilterProxyModel>
+#include <QProgressBar>
+#include <QTime>
 
 #include <QtDebug>
 
@@ -62,6 +79,10 @@ public:
     ProcessManager *pman;
     ConsoleInterceptor *console;
     BuildManager *buildManager;
+    QListView *outlineView;
+    BuildOutputParser *outputParser;
+    QTabWidget *bottomTabs;
+    QTreeView *problemsView;
 };
 
 static constexpr auto MainWindowSIZE = QSize{900, 600};
@@ -155,7 +176,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
     priv->pman = new ProcessManager(this);
     priv->console = new ConsoleInterceptor(ui->logView, priv->pman, BuildManager::PROCESS_NAME, this);
-    priv->console->addStdErrFilter(RegexHTMLTranslator::CONSOLE_TRANSLATOR);
+    priv->outputParser = new BuildOutputParser(this);
+    priv->console->setOutputParser(priv->outputParser);
     priv->projectManager = new ProjectManager(ui->actionViewer, priv->pman, this);
     priv->buildManager = new BuildManager(priv->projectManager, priv->pman, this);
     priv->fileManager = new FileSystemManager(ui->fileViewer, this);
@@ -184,19 +206,40 @@ MainWindow::MainWindow(QWidget *parent) :
         priv->console->writeHtml(msg);
     });
 
-    connect(priv->buildManager, &BuildManager::buildStarted, [this]() { ui->actionViewer->setEnabled(false); });
-    connect(priv->buildManager, &BuildManager::buildTerminated, [this]() { ui->actionViewer->setEnabled(true); });
+    connect(priv->buildManager, &BuildManager::jobProcessCreated, [this](const QString& name) {
+        priv->console->attach(priv->pman, name);
+    });
+    connect(priv->buildManager, &BuildManager::jobLaunched, priv->outputParser, &BuildOutputParser::setOrigin);
     connect(priv->projectManager, &ProjectManager::targetTriggered, [this](const QString& target) {
-        ui->logView->clear();
+        if (!priv->buildManager->isBuilding()) {
+            ui->logView->clear();
+            priv->outputParser->clear();
+        }
+        // Shift forces make, as do files saved right now since the watcher has not seen them yet
+        auto force = QGuiApplication::keyboardModifiers().testFlag(Qt::ShiftModifier);
         auto unsaved = ui->documentContainer->unsavedDocuments();
         if (!unsaved.isEmpty()) {
             UnsavedFilesDialog d(unsaved, this);
             if (d.exec() == QDialog::Rejected)
                 return;
-            ui->documentContainer->saveDocuments(d.checkedForSave());
+            auto toSave = d.checkedForSave();
+            force = force || !toSave.isEmpty();
+            ui->documentContainer->saveDocuments(toSave);
         }
-        priv->buildManager->startBuild(target);
+        priv->buildManager->startBuild(target, force);
     });
+    auto buildWatcher = new BuildWatcher(priv->buildManager, priv->projectManager, this);
+    connect(priv->projectManager, &ProjectManager::watchTargetRequested, buildWatcher, &BuildWatcher::setTarget);
+    connect(buildWatcher, &BuildWatcher::targetChanged, priv->projectManager, &ProjectManager::setWatchedTarget);
+    connect(buildWatcher, &BuildWatcher::triggered, [this]() {
+        if (!priv->buildManager->isBuilding()) {
+            ui->logView->clear();
+            priv->outputParser->clear();
+        }
+    });
+    StaticAnalyzer::instance().setProject(priv->projectManager);
+    HostProfiler::instance().setProcessManager(priv->pman);
+    priv->console->attach(priv->pman, HostProfiler::PROCESS_NAME);
     connect(priv->fileManager, &FileSystemManager::requestFileOpen, ui->documentContainer, &DocumentManager::openDocument);
 
     auto showMessageCallback = [this](const QString& msg) { priv->console->writeMessage(msg, Qt::darkGreen); };
@@ -298,6 +341,8 @@ MainWindow::MainWindow(QWidget *parent) :
         AppConfig::instance().save();
         qputenv("CURRENT_PROJECT_FILE", filepath.toLocal8Bit());
         qputenv("CURRENT_PROJECT_DIR", dirpath.toLocal8Bit());
+        priv->outputParser->clear();
+        priv->outputParser->setBasePath(dirpath);
     });
     connect(priv->projectManager, &ProjectManager::projectClosed, [this, makeRecentProjects]() {
         qputenv("CURRENT_PROJECT_FILE", "");
@@ -342,6 +387,241 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->documentContainer, &DocumentManager::documentFocushed, enableEdition);
     connect(ui->documentContainer, &DocumentManager::documentClosed, enableEdition);
 
+    priv->outlineView = new QListView(ui->verticalSplitterLeft);
+    priv->outlineView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    priv->outlineView->setToolTip(tr("Outline of current document"));
+    priv->outlineView->hide();
+    ui->verticalSplitterLeft->insertWidget(1, priv->outlineView);
+    auto updateOutline = [this]() {
+        auto current = ui->documentContainer->documentEditorCurrent();
+        auto model = current? current->outlineModel() : nullptr;
+        if (priv->outlineView->model() != model)
+            priv->outlineView->setModel(model);
+        priv->outlineView->setVisible(model != nullptr);
+    };
+    connect(ui->documentContainer, &DocumentManager::documentFocushed, updateOutline);
+    connect(ui->documentContainer, &DocumentManager::documentClosed, updateOutline);
+    connect(priv->outlineView, &QListView::activated, [this](const QModelIndex& index) {
+        auto path = ui->documentContainer->documentCurrent();
+        auto line = index.data(Qt::UserRole + 1).toInt();
+        if (!path.isEmpty() && line > 0) {
+            ui->documentContainer->openDocumentHere(path, line, 0);
+            ui->documentContainer->setFocus();
+        }
+    });
+
+    auto logIndex = ui->splitterDocumentViewer->indexOf(ui->logView);
+    priv->bottomTabs = new QTabWidget(ui->splitterDocumentViewer);
+    priv->bottomTabs->setTabPosition(QTabWidget::South);
+    priv->bottomTabs->setDocumentMode(true);
+    priv->bottomTabs->addTab(ui->logView, tr("Console"));
+    priv->problemsView = new QTreeView(priv->bottomTabs);
+    priv->problemsView->setModel(priv->outputParser->model());
+    priv->problemsView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    priv->problemsView->setUniformRowHeights(true);
+    priv->problemsView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    priv->problemsView->header()->setStretchLastSection(false);
+    priv->bottomTabs->addTab(priv->problemsView, tr("Problems"));
+    auto jobsView = new QTreeView(priv->bottomTabs);
+    jobsView->setModel(priv->buildManager->jobsModel());
+    jobsView->setRootIsDecorated(false);
+    jobsView->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(jobsView, &QTreeView::customContextMenuRequested, [this, jobsView](const QPoint& pos) {
+        auto index = jobsView->indexAt(pos);
+        QMenu menu;
+        if (index.isValid()) {
+            auto row = index.row();
+            auto target = index.sibling(row, 0).data().toString();
+            auto configuration = index.sibling(row, 1).data().toString();
+            auto label = configuration.isEmpty()? target : QString("%1 [%2]").arg(target, configuration);
+            menu.addAction(tr("Cancel %1").arg(label), [this, row]() { priv->buildManager->cancelJob(row); });
+        }
+        menu.addAction(tr("Cancel all"), priv->buildManager, &BuildManager::cancelAll)->setEnabled(priv->buildManager->isBuilding());
+        menu.exec(jobsView->viewport()->mapToGlobal(pos));
+    });
+    priv->bottomTabs->addTab(jobsView, tr("Jobs"));
+    connect(priv->pman, &ProcessManager::statsChanged, [this, jobsView]() {
+        auto st = priv->pman->stats();
+        priv->bottomTabs->setTabToolTip(priv->bottomTabs->indexOf(jobsView),
+                                        tr("Processes: %1 live, %2 registered, %3 spawned, %4 KiB read")
+                                        .arg(st.live).arg(st.registered).arg(st.spawns).arg(st.bytesRead / 1024));
+    });
+    auto profileView = new QTreeView(priv->bottomTabs);
+    profileView->setModel(priv->buildManager->profiler()->model());
+    profileView->setRootIsDecorated(false);
+    profileView->setSortingEnabled(true);
+    profileView->sortByColumn(2, Qt::DescendingOrder);
+    priv->bottomTabs->addTab(profileView, tr("Build Profile"));
+    connect(profileView, &QTreeView::activated, [this](const QModelIndex& index) {
+        auto path = index.sibling(index.row(), 0).data(BuildProfiler::FILE_ROLE).toString();
+        if (QFileInfo(path).isFile())
+            ui->documentContainer->openDocument(path);
+    });
+    connect(priv->buildManager->profiler(), &BuildProfiler::profileReady, [this](const QString& tracePath) {
+        priv->console->writeMessage(tr("Build profile timeline written to %1 (open it with chrome://tracing)\n").arg(tracePath), Qt::darkGreen);
+    });
+    auto historyView = new QTreeView(priv->bottomTabs);
+    // Sorting the model itself would break the trimming of the oldest rows
+    auto historyProxy = new QSortFilterProxyModel(historyView);
+    historyProxy->setSourceModel(ProcessHistory::instance().model());
+    historyView->setModel(historyProxy);
+    historyView->setRootIsDecorated(false);
+    historyView->setUniformRowHeights(true);
+    historyView->setSortingEnabled(true);
+    historyView->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(historyView, &QTreeView::customContextMenuRequested, [historyView](const QPoint& pos) {
+        QMenu menu;
+        menu.addAction(tr("Clear history"), &ProcessHistory::instance(), &ProcessHistory::clear);
+        menu.exec(historyView->viewport()->mapToGlobal(pos));
+    });
+    priv->bottomTabs->addTab(historyView, tr("Processes"));
+    auto analysisView = new QTreeView(priv->bottomTabs);
+    analysisView->setModel(StaticAnalyzer::instance().model());
+    analysisView->setRootIsDecorated(false);
+    analysisView->setUniformRowHeights(true);
+    analysisView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    analysisView->header()->setStretchLastSection(false);
+    priv->bottomTabs->addTab(analysisView, tr("Analysis"));
+    connect(analysisView, &QTreeView::activated, [this](const QModelIndex& index) {
+        auto path = index.data(StaticAnalyzer::FILE_ROLE).toString();
+        if (!path.isEmpty()) {
+            ui->documentContainer->openDocumentHere(path,
+                                                    index.data(StaticAnalyzer::LINE_ROLE).toInt(),
+                                                    index.data(StaticAnalyzer::COLUMN_ROLE).toInt());
+            ui->documentContainer->setFocus();
+        }
+    });
+    auto updateAnalysisTab = [this, analysisView]() {
+        auto& analyzer = StaticAnalyzer::instance();
+        auto idx = priv->bottomTabs->indexOf(analysisView);
+        auto findings = analyzer.findingCount();
+        priv->bottomTabs->setTabText(idx, findings > 0? tr("Analysis (%1)").arg(findings) : tr("Analysis"));
+        if (analyzer.analyzers().isEmpty())
+            priv->bottomTabs->setTabToolTip(idx, tr("Install cppcheck or clang-tidy to analyze the sources"));
+        else
+            priv->bottomTabs->setTabToolTip(idx, tr("%1: %2 analyses pending")
+                                            .arg(analyzer.analyzers().join(", ")).arg(analyzer.pendingCount()));
+    };
+    connect(&StaticAnalyzer::instance(), &StaticAnalyzer::resultsChanged, analysisView, updateAnalysisTab);
+    connect(&StaticAnalyzer::instance(), &StaticAnalyzer::pendingChanged, analysisView, updateAnalysisTab);
+    updateAnalysisTab();
+    auto testRunner = new TestRunner(priv->projectManager, this);
+    auto testsView = new QTreeView(priv->bottomTabs);
+    testsView->setModel(testRunner->model());
+    testsView->setUniformRowHeights(true);
+    testsView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    testsView->header()->setStretchLastSection(false);
+    testsView->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(testsView, &QTreeView::customContextMenuRequested, [testRunner, testsView](const QPoint& pos) {
+        auto index = testsView->indexAt(pos);
+        QMenu menu;
+        auto idle = !testRunner->isRunning();
+        menu.addAction(tr("Run all tests"), testRunner, &TestRunner::runAll)->setEnabled(idle && !testRunner->tests().isEmpty());
+        if (index.isValid()) {
+            auto test = testRunner->testOf(index);
+            menu.addAction(tr("Run %1").arg(QFileInfo(test).fileName()), [testRunner, test]() { testRunner->run(test); })->setEnabled(idle);
+        }
+        auto failed = testRunner->failedCount();
+        menu.addAction(tr("Re-run failed (%1)").arg(failed), testRunner, &TestRunner::runFailed)->setEnabled(idle && failed > 0);
+        menu.addAction(tr("Stop"), testRunner, &TestRunner::stop)->setEnabled(!idle);
+        menu.addSeparator();
+        menu.addAction(tr("Rediscover tests"), testRunner, &TestRunner::discover)->setEnabled(idle);
+        menu.exec(testsView->viewport()->mapToGlobal(pos));
+    });
+    connect(testsView, &QTreeView::activated, [this](const QModelIndex& index) {
+        auto path = index.data(TestRunner::FILE_ROLE).toString();
+        if (!path.isEmpty()) {
+            ui->documentContainer->openDocumentHere(path, index.data(TestRunner::LINE_ROLE).toInt(), 0);
+            ui->documentContainer->setFocus();
+        }
+    });
+    priv->bottomTabs->addTab(testsView, tr("Tests"));
+    connect(testRunner, &TestRunner::resultsChanged, [this, testRunner, testsView]() {
+        auto failed = testRunner->failedCount();
+        auto idx = priv->bottomTabs->indexOf(testsView);
+        priv->bottomTabs->setTabText(idx, failed > 0? tr("Tests (%1 failed)").arg(failed) : tr("Tests"));
+    });
+    connect(testRunner, &TestRunner::finished, [this](int passed, int failed, int skipped, qint64 elapsedMs) {
+        priv->console->writeMessage(tr("Tests: %1 passed, %2 failed, %3 skipped in %4 s\n")
+                                    .arg(passed).arg(failed).arg(skipped).arg(elapsedMs / 1000.0, 0, 'f', 1),
+                                    failed > 0? Qt::red : Qt::darkGreen);
+        // Instrumented test binaries leave .gcda files behind, anything else finds none
+        CoverageEngine::instance().collect(priv->projectManager->projectPath());
+    });
+    connect(&CoverageEngine::instance(), &CoverageEngine::collected, this, [this](const CoverageEngine::Summary& s) {
+        if (s.lines == 0)
+            return;
+        priv->console->writeMessage(tr("Coverage: %1 of %2 lines (%3%) in %4 files\n")
+                                    .arg(s.coveredLines).arg(s.lines)
+                                    .arg(100.0 * s.coveredLines / s.lines, 0, 'f', 1).arg(s.files), Qt::darkGreen);
+    });
+    connect(priv->projectManager, &ProjectManager::projectClosed, &CoverageEngine::instance(), &CoverageEngine::clear);
+    auto hotspotsView = new QTreeView(priv->bottomTabs);
+    auto hotspotsProxy = new QSortFilterProxyModel(hotspotsView);
+    hotspotsProxy->setSourceModel(HostProfiler::instance().hotspots());
+    hotspotsView->setModel(hotspotsProxy);
+    hotspotsView->setRootIsDecorated(false);
+    hotspotsView->setUniformRowHeights(true);
+    hotspotsView->setSortingEnabled(true);
+    hotspotsView->sortByColumn(1, Qt::DescendingOrder);
+    hotspotsView->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    hotspotsView->header()->setStretchLastSection(false);
+    priv->bottomTabs->addTab(hotspotsView, tr("Hotspots"));
+    connect(hotspotsView, &QTreeView::activated, [this](const QModelIndex& index) {
+        auto path = index.data(HostProfiler::FILE_ROLE).toString();
+        if (QFileInfo(path).isFile()) {
+            ui->documentContainer->openDocumentHere(path, index.data(HostProfiler::LINE_ROLE).toInt(), 0);
+            ui->documentContainer->setFocus();
+        }
+    });
+    connect(&HostProfiler::instance(), &HostProfiler::started, this, [this](const QString& program) {
+        priv->console->writeMessage(tr("Profiling %1\n").arg(program), Qt::darkGreen);
+    });
+    connect(&HostProfiler::instance(), &HostProfiler::finished, this, [this, hotspotsView](bool ok, const QString& message) {
+        priv->console->writeMessage(message + "\n", ok? Qt::darkGreen : Qt::red);
+        if (ok)
+            priv->bottomTabs->setCurrentWidget(hotspotsView);
+    });
+    auto buildProgress = new QProgressBar(priv->bottomTabs);
+    buildProgress->setRange(0, 100);
+    buildProgress->setMaximumWidth(buildProgress->fontMetrics().width("0") * 30);
+    buildProgress->hide();
+    priv->bottomTabs->setCornerWidget(buildProgress, Qt::BottomRightCorner);
+    connect(priv->buildManager, &BuildManager::progressChanged, buildProgress, [buildProgress](int percent, qint64 etaMs) {
+        buildProgress->setVisible(percent >= 0);
+        if (percent < 0)
+            return;
+        buildProgress->setValue(percent);
+        if (etaMs < 0) {
+            buildProgress->setFormat("%p%");
+        } else {
+            constexpr auto MSEC_PER_SEC = 1000;
+            constexpr auto MSEC_PER_HOUR = 3600 * MSEC_PER_SEC;
+            auto eta = QTime(0, 0).addMSecs(int(etaMs + MSEC_PER_SEC - 1));
+            buildProgress->setFormat(tr("%p% - %1 left").arg(eta.toString(etaMs >= MSEC_PER_HOUR? "h:mm:ss" : "m:ss")));
+        }
+    });
+    connect(priv->outputParser, &BuildOutputParser::compileStarted, priv->buildManager, &BuildManager::noteCompileStarted);
+    ui->splitterDocumentViewer->insertWidget(logIndex, priv->bottomTabs);
+    connect(priv->outputParser, &BuildOutputParser::diagnosticsChanged, [this]() {
+        auto errors = priv->outputParser->errorCount();
+        auto warnings = priv->outputParser->warningCount();
+        auto idx = priv->bottomTabs->indexOf(priv->problemsView);
+        if (errors + warnings > 0)
+            priv->bottomTabs->setTabText(idx, tr("Problems (%1 errors, %2 warnings)").arg(errors).arg(warnings));
+        else
+            priv->bottomTabs->setTabText(idx, tr("Problems"));
+    });
+    connect(priv->problemsView, &QTreeView::activated, [this](const QModelIndex& index) {
+        auto path = index.data(BuildOutputParser::FILE_ROLE).toString();
+        if (!path.isEmpty()) {
+            ui->documentContainer->openDocumentHere(path,
+                                                    index.data(BuildOutputParser::LINE_ROLE).toInt(),
+                                                    index.data(BuildOutputParser::COLUMN_ROLE).toInt());
+            ui->documentContainer->setFocus();
+        }
+    });
+
     connect(priv->projectManager, &ProjectManager::requestFileOpen, ui->documentContainer, &DocumentManager::openDocument);
     connect(ui->buttonDocumentClose, &QToolButton::clicked, ui->documentContainer, &DocumentManager::closeCurrent);
     connect(ui->buttonDocumentCloseAll, &QToolButton::clicked, ui->documentContainer, &DocumentManager::aboutToCloseAll);
@@ -351,6 +631,31 @@ MainWindow::MainWindow(QWidget *parent) :
 
     auto setExternalTools = [this]() {
         auto m = ExternalToolManager::makeMenu(this, priv->pman, priv->projectManager);
+        m->addSeparator();
+        m->addAction(tr("Build configurations..."), [this]() {
+            if (!priv->projectManager->isProjectOpen())
+                return;
+            BuildConfigurationsDialog d(priv->buildManager->configurations(), this);
+            d.exec();
+        });
+        m->addAction(tr("Collect coverage"), [this]() {
+            CoverageEngine::instance().collect(priv->projectManager->projectPath());
+        });
+        m->addAction(tr("Clear coverage"), &CoverageEngine::instance(), &CoverageEngine::clear);
+        for(auto tool: HostProfiler::installedTools()) {
+            m->addAction(tr("Profile host program with %1...").arg(HostProfiler::toolName(tool)), [this, tool]() {
+                auto base = priv->projectManager->isProjectOpen()? priv->projectManager->projectPath() : QDir::homePath();
+                auto program = QFileDialog::getOpenFileName(this, tr("Host program to profile"), base);
+                if (program.isEmpty())
+                    return;
+                auto ok = false;
+                auto args = QInputDialog::getText(this, tr("Profile %1").arg(QFileInfo(program).fileName()),
+                                                  tr("Arguments:"), QLineEdit::Normal, QString(), &ok);
+                if (ok)
+                    HostProfiler::instance().profile(tool, program, args.split(' ', QString::SkipEmptyParts), base);
+            });
+        }
+        m->addAction(tr("Stop profiling"), &HostProfiler::instance(), &HostProfiler::stop);
         ui->buttonTools->setMenu(m);
         // ui->buttonExternalTools->setMenu(m);
     };
@@ -383,6 +688,21 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->buttonFindAll, &QToolButton::clicked, findInFilesCallback);
     connect(new QShortcut(QKeySequence("CTRL+SHIFT+F"), this), &QShortcut::activated, findInFilesCallback);
 
+    auto compileFileCallback = [this](bool syntaxOnly) {
+        auto current = ui->documentContainer->documentEditorCurrent();
+        if (!current || !priv->projectManager->isProjectOpen())
+            return;
+        if (current->isModified())
+            ui->documentContainer->saveCurrent();
+        if (!priv->buildManager->isBuilding()) {
+            ui->logView->clear();
+            priv->outputParser->clear();
+        }
+        priv->buildManager->compileFile(current->path(), syntaxOnly);
+    };
+    connect(new QShortcut(QKeySequence("CTRL+F7"), this), &QShortcut::activated, [compileFileCallback]() { compileFileCallback(false); });
+    connect(new QShortcut(QKeySequence("CTRL+SHIFT+F7"), this), &QShortcut::activated, [compileFileCallback]() { compileFileCallback(true); });
+
     connect(ui->buttonQuit, &QToolButton::clicked, this, &MainWindow::close);
     connect(new QShortcut(QKeySequence("ALT+F4"), this), &QShortcut::activated, this, &MainWindow::close);
 
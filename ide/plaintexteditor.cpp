@@ -17,7 +17,10 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "coverageengine.h"
 #include "formfindreplace.h"
+#include "hostprofiler.h"
+#include "icodemodelprovider.h"
 #include "plaintexteditor.h"
 #include "textmessagebrocker.h"
 
@@ -25,14 +28,23 @@
 #include <Qsci/qscistyle.h>
 #include <Qsci/qscilexer.h>
 
+#include <QDir>
 #include <QFile>
 #include <QMenu>
 #include <QMessageBox>
 #include <QRegularExpression>
+#include <QSet>
 #include <QtDebug>
 
 #include <cmath>
 
+static constexpr auto COVERED_MARKER = 3;
+static constexpr auto UNCOVERED_MARKER = 4;
+// 0 line numbers, 1 symbols, 2 folding
+static constexpr auto PROFILE_MARGIN = 3;
+// Below a tenth of a percent the margin would only show 0.0%
+static constexpr auto MIN_PROFILE_SHARE = 0.001;
+
 PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
 {
     loadConfig();
@@ -70,6 +82,9 @@ PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
         SendScintilla(SCI_GOTOPOS, start + text.length());
     });
 
+    connect(&CoverageEngine::instance(), &CoverageEngine::coverageChanged, this, [this]() { refreshCoverage(); });
+    connect(&HostProfiler::instance(), &HostProfiler::resultsChanged, this, [this]() { refreshProfile(); });
+
     auto findDialog = new FormFindReplace(this);
     findDialog->hide();
 
@@ -217,6 +232,8 @@ bool PlainTextEditor::load(const QString &path)
         if (read(&f)) {
             setPath(path);
             loadConfig();
+            refreshCoverage();
+            refreshProfile();
             if (AppConfig::instance().editorDetectIdent()) {
                 auto info = npp_detectident::detectIndentInfo(this);
                 if (info.type == npp_detectident::IndentInfo::IndentInfo::IndentType::Tab) {
@@ -318,6 +335,46 @@ QString PlainTextEditor::wordUnderCursor() const
     return wordAtLineIndex(line, col);
 }
 
+void PlainTextEditor::refreshCoverage()
+{
+    markerDeleteAll(COVERED_MARKER);
+    markerDeleteAll(UNCOVERED_MARKER);
+    if (path().isEmpty())
+        return;
+    auto coverage = CoverageEngine::instance().lineTable(QDir::cleanPath(path()));
+    // Counts belong to the saved file, all markers go in now so edits move them along with their lines
+    auto last = qMin(lines(), coverage.size());
+    for(int line = 0; line < last; line++) {
+        auto hits = coverage.at(line);
+        if (hits != 0)
+            markerAdd(line, hits > 1? COVERED_MARKER : UNCOVERED_MARKER);
+    }
+}
+
+void PlainTextEditor::refreshProfile()
+{
+    clearMarginText();
+    clearAnnotations();
+    auto file = path().isEmpty()? QString() : QDir::cleanPath(path());
+    auto costs = HostProfiler::instance().lineCosts(file);
+    if (costs.isEmpty()) {
+        setMarginWidth(PROFILE_MARGIN, 0);
+        return;
+    }
+    setMarginType(PROFILE_MARGIN, QsciScintilla::TextMarginRightJustified);
+    setMarginWidth(PROFILE_MARGIN, QFontMetrics(font()).width("100.0% "));
+    for(auto it = costs.begin(); it != costs.end(); ++it) {
+        if (it.value() < MIN_PROFILE_SHARE || it.key() > lines())
+            continue;
+        setMarginText(it.key() - 1, QString("%1%").arg(it.value() * 100, 0, 'f', 1), STYLE_LINENUMBER);
+    }
+    for(const auto& f: HostProfiler::instance().functionsIn(file)) {
+        if (f.line > 0 && f.line <= lines())
+            annotate(f.line - 1, tr("%1: %2% of the profile in own code").arg(f.name).arg(f.self * 100, 0, 'f', 1),
+                     STYLE_LINENUMBER);
+    }
+}
+
 void PlainTextEditor::adjustLineNumberMargin()
 {
     QFontMetrics m(font());
@@ -412,6 +469,12 @@ void PlainTextEditor::loadConfigWithStyle(const QString& styleName, const QFont&
     static constexpr auto ARROW_BG_COLOR = 0xee1111;
     setMarkerBackgroundColor(QColor(CIRCLE_BG_COLOR), SC_MARK_CIRCLE);
     setMarkerBackgroundColor(QColor(ARROW_BG_COLOR), SC_MARK_ARROW);
+    markerDefine(QsciScintilla::LeftRectangle, COVERED_MARKER);
+    markerDefine(QsciScintilla::LeftRectangle, UNCOVERED_MARKER);
+    static constexpr auto COVERED_BG_COLOR = 0x33aa33;
+    static constexpr auto UNCOVERED_BG_COLOR = 0xdd3333;
+    setMarkerBackgroundColor(QColor(COVERED_BG_COLOR), COVERED_MARKER);
+    setMarkerBackgroundColor(QColor(UNCOVERED_BG_COLOR), UNCOVERED_MARKER);
     setAnnotationDisplay(AnnotationIndented);
     adjustLineNumberMargin();
 
@@ -591,11 +654,33 @@ QStringList PlainTextEditor::allWords()
 
 void PlainTextEditor::triggerAutocompletion()
 {
-    int _;
-    if (!apiContext(int(SendScintilla(SCI_GETCURRENTPOS)), _, _).isEmpty())
-        autoCompleteFromDocument();
-    else {
+    auto position = SendScintilla(SCI_GETCURRENTPOS);
+    auto start = SendScintilla(SCI_WORDSTARTPOSITION, static_cast<unsigned long>(position), true);
+    auto prefix = text(int(start), int(position));
+    if (prefix.isEmpty()) {
         showUserList(1, allWords());
+        return;
+    }
+    // Words of this document first, then project wide words by rank
+    QStringList candidates;
+    QSet<QString> seen{ prefix };
+    auto append = [&candidates, &seen, &prefix](const QString& word) {
+        if (word.startsWith(prefix) && !seen.contains(word)) {
+            seen.insert(word);
+            candidates.append(word);
+        }
+    };
+    for(const auto& word: allWords())
+        append(word);
+    if (codeModel()) {
+        for(const auto& word: codeModel()->wordCompletions(prefix, path()))
+            append(word);
+    }
+    if (candidates.isEmpty()) {
+        autoCompleteFromDocument();
+    } else {
+        SendScintilla(SCI_AUTOCSETORDER, SC_ORDER_CUSTOM);
+        showUserList(1, candidates);
     }
 }
 
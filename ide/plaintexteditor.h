@@ -62,6 +62,10 @@ protected:
     QStringList allWords();
 
     virtual QMenu *createContextualMenu();
+
+private:
+    void refreshCoverage();
+    void refreshProfile();
 };
 
 #endif // PLAINTEXTEDITOR_H
@@ -0,0 +1,417 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "preprocessorevaluator.h"
+
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include <QtDebug>
+
+static constexpr auto MAX_EXPANSION_DEPTH = 32;
+
+namespace {
+
+struct Value {
+    bool known = true;
+    qint64 v = 0;
+
+    static Value unknown() { Value r; r.known = false; return r; }
+    static Value of(qint64 x) { Value r; r.v = x; return r; }
+};
+
+QStringList tokenize(const QString& expr)
+{
+    static const QRegularExpression TOKEN_RE(
+        R"([A-Za-z_]\w*|\d[\w.]*|'(?:\\.|[^'\\])*'|&&|\|\||==|!=|<=|>=|<<|>>|\S)");
+    QStringList tokens;
+    auto it = TOKEN_RE.globalMatch(expr);
+    while (it.hasNext())
+        tokens.append(it.next().captured());
+    return tokens;
+}
+
+class ExpressionParser
+{
+public:
+    ExpressionParser(const PreprocessorEvaluator::MacroTable& m, int d = 0) : macros(m), depth(d) {}
+
+    Value evaluate(const QString& expr) {
+        tokens = tokenize(expr);
+        pos = 0;
+        if (tokens.isEmpty())
+            return Value::unknown();
+        auto v = ternary();
+        return pos == tokens.size()? v : Value::unknown();
+    }
+
+private:
+    const PreprocessorEvaluator::MacroTable& macros;
+    int depth;
+    QStringList tokens;
+    int pos{ 0 };
+
+    QString peek() const { return pos < tokens.size()? tokens.at(pos) : QString(); }
+    QString take() { return pos < tokens.size()? tokens.at(pos++) : QString(); }
+
+    bool accept(const QString& t) {
+        if (peek() == t) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    static int precedence(const QString& op) {
+        static const QHash<QString, int> PRECEDENCE = {
+            { "*", 10 }, { "/", 10 }, { "%", 10 },
+            { "+", 9 }, { "-", 9 },
+            { "<<", 8 }, { ">>", 8 },
+            { "<", 7 }, { ">", 7 }, { "<=", 7 }, { ">=", 7 },
+            { "==", 6 }, { "!=", 6 },
+            { "&", 5 }, { "^", 4 }, { "|", 3 },
+            { "&&", 2 }, { "||", 1 },
+        };
+        return PRECEDENCE.value(op, -1);
+    }
+
+    static Value apply(const QString& op, const Value& a, const Value& b) {
+        // Short circuit operators only need the side that decides
+        if (op == "&&") {
+            if ((a.known && !a.v) || (b.known && !b.v))
+                return Value::of(0);
+            return a.known && b.known? Value::of(1) : Value::unknown();
+        }
+        if (op == "||") {
+            if ((a.known && a.v) || (b.known && b.v))
+                return Value::of(1);
+            return a.known && b.known? Value::of(0) : Value::unknown();
+        }
+        if (!a.known || !b.known)
+            return Value::unknown();
+        if (op == "*") return Value::of(a.v * b.v);
+        if (op == "/") return b.v? Value::of(a.v / b.v) : Value::unknown();
+        if (op == "%") return b.v? Value::of(a.v % b.v) : Value::unknown();
+        if (op == "+") return Value::of(a.v + b.v);
+        if (op == "-") return Value::of(a.v - b.v);
+        if (op == "<<") return Value::of(a.v << (b.v & 63));
+        if (op == ">>") return Value::of(a.v >> (b.v & 63));
+        if (op == "<") return Value::of(a.v < b.v);
+        if (op == ">") return Value::of(a.v > b.v);
+        if (op == "<=") return Value::of(a.v <= b.v);
+        if (op == ">=") return Value::of(a.v >= b.v);
+        if (op == "==") return Value::of(a.v == b.v);
+        if (op == "!=") return Value::of(a.v != b.v);
+        if (op == "&") return Value::of(a.v & b.v);
+        if (op == "^") return Value::of(a.v ^ b.v);
+        if (op == "|") return Value::of(a.v | b.v);
+        return Value::unknown();
+    }
+
+    Value ternary() {
+        auto c = binary(0);
+        if (!accept("?"))
+            return c;
+        auto a = ternary();
+        if (!accept(":"))
+            return Value::unknown();
+        auto b = ternary();
+        if (!c.known)
+            return Value::unknown();
+        return c.v? a : b;
+    }
+
+    Value binary(int minPrecedence) {
+        auto lhs = unary();
+        while (precedence(peek()) >= minPrecedence && precedence(peek()) >= 0) {
+            auto op = take();
+            auto rhs = binary(precedence(op) + 1);
+            lhs = apply(op, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    void skipArguments() {
+        if (!accept("("))
+            return;
+        int level = 1;
+        while (level > 0 && pos < tokens.size()) {
+            auto t = take();
+            if (t == "(")
+                level++;
+            else if (t == ")")
+                level--;
+        }
+    }
+
+    Value number(QString text) {
+        text.remove(QRegularExpression("[uUlL]+$"));
+        bool ok = false;
+        qint64 v;
+        if (text.startsWith("0b", Qt::CaseInsensitive))
+            v = text.mid(2).toLongLong(&ok, 2);
+        else
+            v = text.toLongLong(&ok, 0);
+        return ok? Value::of(v) : Value::unknown();
+    }
+
+    Value identifier(const QString& name) {
+        if (name == "defined") {
+            auto parens = accept("(");
+            auto macro = take();
+            if (parens && !accept(")"))
+                return Value::unknown();
+            return Value::of(macros.contains(macro));
+        }
+        auto it = macros.find(name);
+        if (it == macros.end()) {
+            if (peek() == "(") {
+                // __has_include() and friends, or an unknown function-like macro
+                skipArguments();
+                return Value::unknown();
+            }
+            if (name == "true")
+                return Value::of(1);
+            return Value::of(0);
+        }
+        if (it->functionLike) {
+            skipArguments();
+            return Value::unknown();
+        }
+        if (depth >= MAX_EXPANSION_DEPTH || it->value.trimmed().isEmpty())
+            return Value::unknown();
+        return ExpressionParser(macros, depth + 1).evaluate(it->value);
+    }
+
+    Value unary() {
+        auto t = take();
+        if (t.isEmpty())
+            return Value::unknown();
+        if (t == "!") {
+            auto v = unary();
+            return v.known? Value::of(!v.v) : v;
+        }
+        if (t == "~") {
+            auto v = unary();
+            return v.known? Value::of(~v.v) : v;
+        }
+        if (t == "-") {
+            auto v = unary();
+            return v.known? Value::of(-v.v) : v;
+        }
+        if (t == "+")
+            return unary();
+        if (t == "(") {
+            auto v = ternary();
+            return accept(")")? v : Value::unknown();
+        }
+        if (t.at(0).isDigit())
+            return number(t);
+        if (t.at(0) == '\'')
+            return t.size() == 3? Value::of(t.at(1).unicode()) : Value::unknown();
+        if (t.at(0).isLetter() || t.at(0) == '_')
+            return identifier(t);
+        return Value::unknown();
+    }
+};
+
+QString stripComments(const QString& text, bool *inComment)
+{
+    QString out;
+    int i = 0;
+    auto n = text.size();
+    while (i < n) {
+        if (*inComment) {
+            auto end = text.indexOf("*/", i);
+            if (end < 0)
+                return out;
+            *inComment = false;
+            i = end + 2;
+            out.append(' ');
+            continue;
+        }
+        auto c = text.at(i);
+        if (c == '"' || c == '\'') {
+            auto end = i + 1;
+            while (end < n && text.at(end) != c)
+                end += text.at(end) == '\\'? 2 : 1;
+            out.append(text.midRef(i, end - i + 1));
+            i = end + 1;
+        } else if (c == '/' && i + 1 < n && text.at(i + 1) == '/') {
+            break;
+        } else if (c == '/' && i + 1 < n && text.at(i + 1) == '*') {
+            *inComment = true;
+            i += 2;
+        } else {
+            out.append(c);
+            i++;
+        }
+    }
+    return out;
+}
+
+// X when the file opens with #ifndef X (or #if !defined X) directly followed by #define X
+QString includeGuardOf(const QStringList& lines)
+{
+    static const QRegularExpression IFNDEF_RE(R"(^#\s*(?:ifndef\s+(\w+)|if\s+!\s*defined\s*\(?\s*(\w+)\s*\)?)$)");
+    static const QRegularExpression DEFINE_RE(R"(^#\s*define\s+(\w+))");
+    QString guard;
+    auto inComment = false;
+    for(const auto& raw: lines) {
+        auto line = stripComments(raw, &inComment).trimmed();
+        if (line.isEmpty())
+            continue;
+        if (guard.isEmpty()) {
+            auto m = IFNDEF_RE.match(line);
+            if (!m.hasMatch())
+                return QString();
+            guard = m.captured(1).isEmpty()? m.captured(2) : m.captured(1);
+            continue;
+        }
+        auto m = DEFINE_RE.match(line);
+        return m.hasMatch() && m.captured(1) == guard? guard : QString();
+    }
+    return QString();
+}
+
+struct Frame {
+    bool parentActive;
+    bool taken;
+    bool active;
+    bool unknown;
+};
+
+}
+
+PreprocessorEvaluator::MacroTable PreprocessorEvaluator::parseDefines(const QString &text)
+{
+    static const QRegularExpression DEFINE_RE(R"(^#define (\w+)(\([^)]*\))?(?: (.*?))?\r?$)",
+                                              QRegularExpression::MultilineOption);
+    MacroTable table;
+    auto it = DEFINE_RE.globalMatch(text);
+    while (it.hasNext()) {
+        auto m = it.next();
+        Macro macro;
+        macro.functionLike = !m.captured(2).isEmpty();
+        macro.value = m.captured(3);
+        table.insert(m.captured(1), macro);
+    }
+    return table;
+}
+
+ICodeModelProvider::LineRangeList PreprocessorEvaluator::inactiveLines(const QString &text, const MacroTable &macros)
+{
+    static const QRegularExpression DIRECTIVE_RE(R"(^\s*#\s*(\w+)\s*(.*)$)");
+    static const QRegularExpression NAME_RE(R"(^(\w+)(\()?\s*(.*)$)");
+
+    auto lines = text.split('\n');
+    for(auto& l: lines)
+        if (l.endsWith('\r'))
+            l.chop(1);
+    // -dM reports the state at the end of the translation unit, where the guard of this
+    // header is already defined. Other macros it defines are tracked by the walk below,
+    // a config header may have set them before this one was included
+    auto table = macros;
+    auto guard = includeGuardOf(lines);
+    if (!guard.isEmpty())
+        table.remove(guard);
+    QVector<Frame> stack;
+    QVector<bool> dimmed(lines.size(), false);
+    auto inComment = false;
+    auto isActive = [&stack]() { return stack.isEmpty() || stack.last().active; };
+
+    for(int line = 0; line < lines.size(); line++) {
+        auto first = line;
+        auto raw = lines.at(line);
+        if (inComment || !DIRECTIVE_RE.match(raw).hasMatch()) {
+            stripComments(raw, &inComment);
+            dimmed[line] = !isActive();
+            continue;
+        }
+        while (raw.endsWith('\\') && line + 1 < lines.size()) {
+            raw.chop(1);
+            raw.append(lines.at(++line));
+        }
+        auto m = DIRECTIVE_RE.match(stripComments(raw, &inComment));
+        auto directive = m.captured(1);
+        auto argument = m.captured(2).trimmed();
+        auto dim = !isActive();
+
+        if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+            auto parentActive = isActive();
+            Frame f{ parentActive, false, false, false };
+            if (parentActive) {
+                Value v;
+                if (directive == "if") {
+                    v = ExpressionParser(table).evaluate(argument);
+                } else {
+                    auto name = NAME_RE.match(argument).captured(1);
+                    v = Value::of(table.contains(name) == (directive == "ifdef"));
+                }
+                f.unknown = !v.known;
+                f.active = f.unknown || v.v != 0;
+                f.taken = f.active;
+            }
+            stack.append(f);
+        } else if (directive == "elif" && !stack.isEmpty()) {
+            auto& f = stack.last();
+            dim = !f.parentActive;
+            if (f.parentActive && !f.unknown) {
+                if (f.taken) {
+                    f.active = false;
+                } else {
+                    auto v = ExpressionParser(table).evaluate(argument);
+                    f.unknown = !v.known;
+                    f.active = f.unknown || v.v != 0;
+                    f.taken = f.active;
+                }
+            }
+        } else if (directive == "else" && !stack.isEmpty()) {
+            auto& f = stack.last();
+            dim = !f.parentActive;
+            f.active = f.parentActive && (f.unknown || !f.taken);
+            f.taken = true;
+        } else if (directive == "endif" && !stack.isEmpty()) {
+            dim = !stack.last().parentActive;
+            stack.removeLast();
+        } else if (directive == "define" && isActive()) {
+            auto d = NAME_RE.match(argument);
+            Macro macro;
+            macro.functionLike = !d.captured(2).isEmpty();
+            macro.value = macro.functionLike? QString() : d.captured(3);
+            table.insert(d.captured(1), macro);
+        } else if (directive == "undef" && isActive()) {
+            table.remove(NAME_RE.match(argument).captured(1));
+        }
+        for(int l = first; l <= line; l++)
+            dimmed[l] = dim;
+    }
+
+    ICodeModelProvider::LineRangeList ranges;
+    for(int line = 0; line < dimmed.size(); line++) {
+        if (!dimmed.at(line))
+            continue;
+        if (!ranges.isEmpty() && ranges.last().last == line - 1)
+            ranges.last().last = line;
+        else
+            ranges.append({ line, line });
+    }
+    return ranges;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "processhistory.h"
+
+#include <QCoreApplication>
+#include <QStandardItemModel>
+
+#include <QtDebug>
+
+static constexpr auto MAX_ROWS = 2000;
+static constexpr auto USEC_PER_SEC = 1000000.0;
+static constexpr auto MSEC_PER_SEC = 1000.0;
+static constexpr auto KB_PER_MB = 1024.0;
+static constexpr auto ROUNDING = 100.0;
+
+namespace {
+
+QStandardItem *numberItem(double value, bool known = true)
+{
+    auto item = new QStandardItem;
+    if (known)
+        item->setData(qRound64(value * ROUNDING) / ROUNDING, Qt::DisplayRole);
+    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+
+}
+
+class ProcessHistory::Priv_t
+{
+public:
+    QStandardItemModel *model{ nullptr };
+};
+
+ProcessHistory::ProcessHistory(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({
+        tr("Process"), tr("Command"), tr("Started"), tr("Wall (s)"),
+        tr("~User (s)"), tr("~System (s)"), tr("~Peak RSS (MB)"), tr("Exit")
+    });
+    // Columns filled from /proc samples, see ChildProcess::Usage
+    for(int column = 4; column <= 6; column++)
+        priv->model->setHeaderData(column, Qt::Horizontal,
+                                   tr("Approximate: sampled every half second while the process runs, "
+                                      "the last interval and processes shorter than that are missing"),
+                                   Qt::ToolTipRole);
+}
+
+ProcessHistory::~ProcessHistory()
+{
+    delete priv;
+}
+
+ProcessHistory &ProcessHistory::instance()
+{
+    static ProcessHistory *singleton = nullptr;
+    if (!singleton)
+        singleton = new ProcessHistory(QCoreApplication::instance());
+    return *singleton;
+}
+
+QStandardItemModel *ProcessHistory::model() const
+{
+    return priv->model;
+}
+
+void ProcessHistory::record(const ChildProcess::Usage &usage)
+{
+    auto command = QStringList{ usage.program } + usage.arguments;
+    auto known = usage.hasResources();
+    auto commandItem = new QStandardItem(command.join(' '));
+    commandItem->setToolTip(command.join(' '));
+    auto row = QList<QStandardItem*>{
+        new QStandardItem(usage.name),
+        commandItem,
+        new QStandardItem(usage.startedAt.toString("hh:mm:ss")),
+        numberItem(usage.wallMs / MSEC_PER_SEC),
+        numberItem(usage.userUs / USEC_PER_SEC, known),
+        numberItem(usage.sysUs / USEC_PER_SEC, known),
+        numberItem(usage.maxRssKb / KB_PER_MB, known),
+        new QStandardItem(usage.crashed? tr("crashed") : QString::number(usage.exitCode)),
+    };
+    for(auto item: row)
+        item->setEditable(false);
+    priv->model->appendRow(row);
+    if (priv->model->rowCount() > MAX_ROWS)
+        priv->model->removeRows(0, priv->model->rowCount() - MAX_ROWS);
+    emit recorded(usage);
+}
+
+void ProcessHistory::clear()
+{
+    priv->model->removeRows(0, priv->model->rowCount());
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROCESSHISTORY_H
+#define PROCESSHISTORY_H
+
+#include "childprocess.h"
+
+#include <QObject>
+
+class QStandardItemModel;
+
+class ProcessHistory : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ProcessHistory)
+public:
+    static ProcessHistory &instance();
+    virtual ~ProcessHistory() override;
+
+    // Every process that finished in this session, oldest rows are dropped past a limit
+    QStandardItemModel *model() const;
+
+signals:
+    void recorded(const ChildProcess::Usage& usage);
+
+public slots:
+    void record(const ChildProcess::Usage& usage);
+    void clear();
+
+private:
+    explicit ProcessHistory(QObject *parent = nullptr);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // PROCESSHISTORY_H
@@ -16,73 +16,163 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include "jobserver.h"
 #include "processmanager.h"
 
-#ifdef Q_OS_UNIX
-#include <csignal>
-
-#elif defined(Q_OS_WIN)
-// #error TODO windows unsupported kill method
-#else
-#error Unsupported kill method
-#endif
+#include <QHash>
 
 #include <QtDebug>
 
+namespace {
+
+enum HandlerKind { Termination, Startup, Error, Stdout, Stderr, PendingStart, HANDLER_KIND_COUNT };
+
+struct Entry {
+    ChildProcess *proc{ nullptr };
+    QMetaObject::Connection handlers[HANDLER_KIND_COUNT];
+};
+
+}
+
+class ProcessManager::Priv_t
+{
+public:
+    QHash<QString, Entry> registry;
+    quint64 spawns{ 0 };
+    quint64 bytesRead{ 0 };
+
+    void replace(const QString& name, HandlerKind kind, const QMetaObject::Connection& c) {
+        auto& slot = registry[name].handlers[kind];
+        if (slot)
+            QObject::disconnect(slot);
+        slot = c;
+    }
+};
+
 ProcessManager::ProcessManager(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    priv(new Priv_t)
 {
 }
 
 ProcessManager::~ProcessManager()
-= default;
+{
+    delete priv;
+}
 
-QProcess *ProcessManager::processFor(const QString &name)
+ProcessManager::Handle ProcessManager::handle(const QString &name)
 {
-    auto proc = findChild<QProcess*>(name);
-    if (!proc) {
-        proc = new QProcess(this);
+    auto it = priv->registry.find(name);
+    if (it == priv->registry.end()) {
+        auto proc = new ChildProcess(this);
         proc->setObjectName(name);
+        connect(proc, &QObject::destroyed, this, [this, name]() {
+            priv->registry.remove(name);
+            emit statsChanged();
+        });
+        connect(proc, &QProcess::stateChanged, this, &ProcessManager::statsChanged);
+        connect(proc, &ChildProcess::stopped, this, [this, name]() { emit processStopped(name); });
+        it = priv->registry.insert(name, Entry{ proc, {} });
     }
-    return proc;
+    return Handle(name, it->proc);
+}
+
+QList<QProcess *> ProcessManager::processes() const
+{
+    QList<QProcess *> list;
+    for(const auto& e: priv->registry)
+        list.append(e.proc);
+    return list;
+}
+
+ProcessManager::Stats ProcessManager::stats() const
+{
+    Stats s;
+    s.spawns = priv->spawns;
+    s.registered = priv->registry.size();
+    s.bytesRead = priv->bytesRead;
+    for(const auto& e: priv->registry)
+        if (e.proc->state() != QProcess::NotRunning)
+            s.live++;
+    return s;
 }
 
 void ProcessManager::setTerminationHandler(const QString &name, const ProcessManager::terminationHandler_t& func)
 {
     auto proc = processFor(name);
-    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+    priv->replace(name, Termination, connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
             [proc, func](int exitCode, QProcess::ExitStatus exitStatus) {
         func(proc, exitCode, exitStatus);
-    });
+    }));
 }
 
 void ProcessManager::setStartupHandler(const QString &name, const ProcessManager::startupHandler_t& func)
 {
     auto proc = processFor(name);
-    connect(proc, &QProcess::started, [proc, func]() { func(proc); });
+    priv->replace(name, Startup, connect(proc, &QProcess::started, [proc, func]() { func(proc); }));
 }
 
 void ProcessManager::setErrorHandler(const QString &name, const ProcessManager::errorHandler_t& func)
 {
     auto proc = processFor(name);
-    connect(proc, &QProcess::errorOccurred, [proc, func](QProcess::ProcessError error) { func(proc, error); });
+    priv->replace(name, Error, connect(proc, &QProcess::errorOccurred, [proc, func](QProcess::ProcessError error) { func(proc, error); }));
 }
 
 void ProcessManager::setStderrInterceptor(const QString &name, const ProcessManager::outputHandler_t& func)
 {
     auto proc = processFor(name);
-    connect(proc, &QProcess::readyReadStandardError, [proc, func]() { func(proc, QString(proc->readAllStandardError())); });
+    priv->replace(name, Stderr, connect(proc, &QProcess::readyReadStandardError, [this, proc, func]() {
+        auto data = proc->readAllStandardError();
+        priv->bytesRead += quint64(data.size());
+        func(proc, QString(data));
+    }));
 }
 
 void ProcessManager::setStdoutInterceptor(const QString &name, const ProcessManager::outputHandler_t& func)
 {
     auto proc = processFor(name);
-    connect(proc, &QProcess::readyReadStandardOutput, [proc, func]() { func(proc, QString(proc->readAllStandardOutput())); });
+    priv->replace(name, Stdout, connect(proc, &QProcess::readyReadStandardOutput, [this, proc, func]() {
+        auto data = proc->readAllStandardOutput();
+        priv->bytesRead += quint64(data.size());
+        func(proc, QString(data));
+    }));
+}
+
+void ProcessManager::setPriority(const QString &name, ChildProcess::Priority priority)
+{
+    handle(name);
+    priv->registry[name].proc->setPriority(priority);
+}
+
+bool ProcessManager::isRunning(const QString &name) const
+{
+    auto it = priv->registry.constFind(name);
+    return it != priv->registry.constEnd() && it->proc->state() == QProcess::Running;
 }
 
 void ProcessManager::start(const QString &name, const QString &command, const QStringList &args, const QHash<QString,QString> &extraEnv, const QString &workingDir)
 {
-    auto proc = processFor(name);
+    launch(name, command, args, extraEnv, workingDir, false);
+}
+
+void ProcessManager::startWithToken(const QString &name, const QString &command, const QStringList &args, const QHash<QString, QString> &extraEnv, const QString &workingDir)
+{
+    launch(name, command, args, extraEnv, workingDir, true);
+}
+
+void ProcessManager::launch(const QString &name, const QString &command, const QStringList &args, const QHash<QString, QString> &extraEnv, const QString &workingDir, bool withToken)
+{
+    handle(name);
+    auto proc = priv->registry[name].proc;
+    if (proc->isStopping()) {
+        // terminate() does not wait, run once the previous one is gone. The last request wins
+        priv->replace(name, PendingStart, connect(proc, &ChildProcess::stopped, this,
+                [this, name, command, args, extraEnv, workingDir, withToken]() {
+            priv->replace(name, PendingStart, {});
+            launch(name, command, args, extraEnv, workingDir, withToken);
+        }, Qt::QueuedConnection));
+        return;
+    }
     if (!extraEnv.isEmpty()) {
         auto env = proc->processEnvironment();
         for (auto it = extraEnv.begin(); it != extraEnv.end(); it++)
@@ -91,23 +181,32 @@ void ProcessManager::start(const QString &name, const QString &command, const QS
     }
     proc->setWorkingDirectory(workingDir);
     qDebug() << "START:" << command << args;
-    proc->start(command, args);
+    priv->spawns++;
+    if (withToken)
+        JobServer::instance().startWithToken(proc, command, args);
+    else
+        proc->start(command, args);
 }
 
-bool ProcessManager::terminate(const QString &name, bool canKill, int timeout)
+void ProcessManager::terminate(const QString &name, int killTimeout)
 {
-    auto proc = processFor(name);
-#ifdef Q_OS_UNIX
-    ::kill(pid_t(proc->pid()), SIGINT);
-#elif defined(Q_OS_WIN)
-    proc->terminate();
-#endif
-    if (!proc->waitForFinished(timeout)) {
-        if (canKill) {
-            proc->kill();
-            return true;
-        } 
-            return false;
-    } 
-        return true;
+    auto it = priv->registry.find(name);
+    if (it != priv->registry.end())
+        it->proc->stop(killTimeout);
+}
+
+void ProcessManager::release(const QString &name)
+{
+    auto it = priv->registry.find(name);
+    if (it == priv->registry.end())
+        return;
+    auto entry = *it;
+    priv->registry.erase(it);
+    for(auto& c: entry.handlers)
+        disconnect(c);
+    disconnect(entry.proc, nullptr, this, nullptr);
+    if (entry.proc->state() != QProcess::NotRunning)
+        entry.proc->kill();
+    entry.proc->deleteLater();
+    emit statsChanged();
 }
@@ -19,7 +19,10 @@
 #ifndef PROCESSMANAGER_H
 #define PROCESSMANAGER_H
 
+#include "childprocess.h"
+
 #include <QObject>
+#include <QPointer>
 #include <QProcess>
 
 #include <functional>
@@ -34,24 +37,67 @@ public:
     typedef std::function<void (QProcess *)> startupHandler_t;
     typedef std::function<void (QProcess *, QProcess::ProcessError)> errorHandler_t;
 
+    class Handle
+    {
+    public:
+        Handle() = default;
+
+        const QString& name() const { return processName; }
+        QProcess *process() const { return proc; }
+        bool isValid() const { return !proc.isNull(); }
+        bool isRunning() const { return proc && proc->state() == QProcess::Running; }
+
+    private:
+        friend class ProcessManager;
+        Handle(const QString& n, QProcess *p) : processName(n), proc(p) {}
+
+        QString processName;
+        QPointer<QProcess> proc;
+    };
+
+    struct Stats {
+        quint64 spawns{ 0 };
+        int registered{ 0 };
+        int live{ 0 };
+        quint64 bytesRead{ 0 };
+    };
+
     explicit ProcessManager(QObject *parent = nullptr);
     virtual ~ProcessManager();
 
-    QProcess *processFor(const QString& name);
+    // Registers the name on first use, the process lives until release() or manager destruction
+    Handle handle(const QString& name);
+    QProcess *processFor(const QString& name) { return handle(name).process(); }
+    QList<QProcess*> processes() const;
+    Stats stats() const;
 
+    // Each setter replaces the previous handler of the same kind for that name
     void setTerminationHandler(const QString& name, const terminationHandler_t& func);
     void setStartupHandler(const QString& name, const startupHandler_t& func);
     void setErrorHandler(const QString& name, const errorHandler_t& func);
     void setStderrInterceptor(const QString& name, const outputHandler_t& func);
     void setStdoutInterceptor(const QString& name, const outputHandler_t& func);
+    void setPriority(const QString& name, ChildProcess::Priority priority);
 
-    bool isRunning(const QString& name) { return processFor(name)->state() == QProcess::Running; }
+    bool isRunning(const QString& name) const;
 
 public slots:
     void start(const QString& name, const QString& command, const QStringList& args = {}, const QHash<QString, QString> &extraEnv = {}, const QString& workingDir = QString());
-    bool terminate(const QString& name, bool canKill = false, int timeout = 3000);
+    // Same as start() but the process waits for a jobserver token and holds it while running
+    void startWithToken(const QString& name, const QString& command, const QStringList& args = {}, const QHash<QString, QString> &extraEnv = {}, const QString& workingDir = QString());
+    // Asynchronous, processStopped() tells when the whole process group is gone
+    void terminate(const QString& name, int killTimeout = 3000);
+    void release(const QString& name);
 
 signals:
+    void statsChanged();
+    void processStopped(const QString& name);
+
+private:
+    void launch(const QString& name, const QString& command, const QStringList& args, const QHash<QString, QString> &extraEnv, const QString& workingDir, bool withToken);
+
+    class Priv_t;
+    Priv_t *priv;
 };
 
 #endif // PROCESSMANAGER_H
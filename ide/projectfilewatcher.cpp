@@ -0,0 +1,311 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "projectfilewatcher.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QSet>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <QtDebug>
+
+// inotify watches are a per-user resource, keep some for other programs
+static constexpr auto MAX_WATCHED_PATHS = 4096;
+static constexpr auto CHANGE_COALESCE_MS = 200;
+
+namespace {
+
+struct ScanResult {
+    QString root;
+    QStringList dirs;
+    QStringList files;
+};
+
+bool isExcluded(const QString& path, const QStringList& excluded)
+{
+    for(const auto& e: excluded)
+        if (path == e || path.startsWith(e + '/'))
+            return true;
+    return false;
+}
+
+// Dot directories (.git, .cache...) and build output only burn watches and flood the consumers
+bool skipDir(const QFileInfo& info, const QStringList& excluded)
+{
+    return info.fileName().startsWith('.') || info.isSymLink() || isExcluded(info.absoluteFilePath(), excluded);
+}
+
+ScanResult scanTree(const QString& root, const QStringList& excluded)
+{
+    ScanResult r;
+    r.root = root;
+    QStringList pending{ root };
+    while (!pending.isEmpty()) {
+        auto dir = pending.takeLast();
+        r.dirs.append(dir);
+        const auto entries = QDir(dir).entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot);
+        for(const auto& info: entries) {
+            if (!info.isDir())
+                r.files.append(info.absoluteFilePath());
+            else if (!skipDir(info, excluded))
+                pending.append(info.absoluteFilePath());
+        }
+    }
+    return r;
+}
+
+}
+
+class ProjectFileWatcher::Priv_t
+{
+public:
+    QString root;
+    QFileSystemWatcher *watcher{ nullptr };
+    QFutureWatcher<ScanResult> *scanWatcher{ nullptr };
+    QHash<QString, QSet<QString>> filesByDir;
+    QSet<QString> scanningDirs;
+    QStringList excluded;
+    QSet<QString> pendingChanges;
+    QTimer coalesceTimer;
+    int watchCount{ 0 };
+    bool overflow{ false };
+
+    void watch(const QString& path) {
+        if (watchCount >= MAX_WATCHED_PATHS)
+            overflow = true;
+        else if (watcher->addPath(path))
+            watchCount++;
+    }
+
+    void unwatch(const QString& path) {
+        if (watcher->removePath(path))
+            watchCount--;
+    }
+
+    void addFile(const QString& path) {
+        filesByDir[QFileInfo(path).absolutePath()].insert(path);
+        watch(path);
+    }
+
+    QStringList removeDir(const QString& dir) {
+        QStringList removed;
+        const auto dirs = filesByDir.keys();
+        for(const auto& d: dirs) {
+            if (d == dir || d.startsWith(dir + '/')) {
+                const auto files = filesByDir.take(d);
+                for(const auto& f: files)
+                    unwatch(f);
+                removed.append(files.values());
+                unwatch(d);
+            }
+        }
+        return removed;
+    }
+};
+
+ProjectFileWatcher::ProjectFileWatcher(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->watcher = new QFileSystemWatcher(this);
+    priv->scanWatcher = new QFutureWatcher<ScanResult>(this);
+    priv->coalesceTimer.setInterval(CHANGE_COALESCE_MS);
+    priv->coalesceTimer.setSingleShot(true);
+
+    connect(priv->scanWatcher, &QFutureWatcher<ScanResult>::finished, [this]() {
+        auto r = priv->scanWatcher->result();
+        if (r.root != priv->root)
+            return;
+        for(const auto& d: r.dirs) {
+            priv->filesByDir.insert(d, {});
+            priv->watch(d);
+        }
+        for(const auto& f: r.files)
+            priv->addFile(f);
+        if (priv->overflow)
+            qDebug() << "watch limit reached for" << r.root << "some files are not tracked";
+        emit scanFinished(r.files);
+    });
+
+    connect(&priv->coalesceTimer, &QTimer::timeout, [this]() {
+        const auto changes = priv->pendingChanges;
+        priv->pendingChanges.clear();
+        for(const auto& path: changes)
+            emit fileChanged(path);
+    });
+
+    connect(priv->watcher, &QFileSystemWatcher::fileChanged, [this](const QString& path) {
+        if (!QFileInfo::exists(path))
+            return; // The directory notification handles removals
+        // Atomic saves replace the inode and drop the watch
+        if (!priv->watcher->files().contains(path))
+            priv->watch(path);
+        priv->pendingChanges.insert(path);
+        priv->coalesceTimer.start();
+    });
+
+    connect(priv->watcher, &QFileSystemWatcher::directoryChanged, [this](const QString& dir) {
+        if (!QFileInfo::exists(dir)) {
+            for(const auto& f: priv->removeDir(dir)) {
+                priv->pendingChanges.remove(f);
+                emit fileRemoved(f);
+            }
+            return;
+        }
+        auto known = priv->filesByDir.value(dir);
+        QSet<QString> current;
+        const auto entries = QDir(dir).entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot);
+        for(const auto& info: entries) {
+            auto path = info.absoluteFilePath();
+            if (info.isDir()) {
+                if (!priv->filesByDir.contains(path) && !priv->scanningDirs.contains(path) && !skipDir(info, priv->excluded))
+                    scanSubtree(path);
+            } else {
+                current.insert(path);
+                if (!known.contains(path)) {
+                    priv->addFile(path);
+                    priv->pendingChanges.insert(path);
+                }
+            }
+        }
+        for(const auto& f: known - current) {
+            priv->filesByDir[dir].remove(f);
+            priv->unwatch(f);
+            priv->pendingChanges.remove(f);
+            emit fileRemoved(f);
+        }
+        const auto dirs = priv->filesByDir.keys();
+        for(const auto& d: dirs) {
+            if (QFileInfo(d).absolutePath() == dir && !QFileInfo::exists(d)) {
+                for(const auto& f: priv->removeDir(d))
+                    emit fileRemoved(f);
+            }
+        }
+        if (!priv->pendingChanges.isEmpty())
+            priv->coalesceTimer.start();
+    });
+}
+
+void ProjectFileWatcher::scanSubtree(const QString &path)
+{
+    // A build creating thousands of files must not stall the GUI thread
+    priv->scanningDirs.insert(path);
+    auto root = priv->root;
+    auto watcher = new QFutureWatcher<ScanResult>(this);
+    connect(watcher, &QFutureWatcher<ScanResult>::finished, this, [this, watcher, root, path]() {
+        watcher->deleteLater();
+        if (root != priv->root || !priv->scanningDirs.remove(path))
+            return;
+        auto r = watcher->result();
+        for(const auto& d: r.dirs) {
+            if (!priv->filesByDir.contains(d)) {
+                priv->filesByDir.insert(d, {});
+                priv->watch(d);
+            }
+        }
+        for(const auto& f: r.files) {
+            priv->addFile(f);
+            priv->pendingChanges.insert(f);
+        }
+        if (!priv->pendingChanges.isEmpty())
+            priv->coalesceTimer.start();
+    });
+    watcher->setFuture(QtConcurrent::run(scanTree, path, priv->excluded));
+}
+
+ProjectFileWatcher::~ProjectFileWatcher()
+{
+    priv->scanWatcher->waitForFinished();
+    delete priv;
+}
+
+QString ProjectFileWatcher::rootPath() const
+{
+    return priv->root;
+}
+
+QStringList ProjectFileWatcher::files() const
+{
+    QStringList list;
+    for(const auto& set: priv->filesByDir)
+        list.append(set.values());
+    return list;
+}
+
+bool ProjectFileWatcher::isScanning() const
+{
+    return priv->scanWatcher->isRunning();
+}
+
+bool ProjectFileWatcher::isComplete() const
+{
+    return !priv->overflow;
+}
+
+bool ProjectFileWatcher::hasPendingChanges() const
+{
+    return !priv->pendingChanges.isEmpty();
+}
+
+void ProjectFileWatcher::setRootPath(const QString &path)
+{
+    clear();
+    if (path.isEmpty())
+        return;
+    priv->root = QFileInfo(path).absoluteFilePath();
+    priv->scanWatcher->setFuture(QtConcurrent::run(scanTree, priv->root, priv->excluded));
+}
+
+void ProjectFileWatcher::setExcludedPaths(const QStringList &paths)
+{
+    QStringList excluded;
+    for(const auto& p: paths)
+        excluded.append(QDir::cleanPath(p));
+    if (excluded == priv->excluded)
+        return;
+    priv->excluded = excluded;
+    // The output tree may have eaten the watch budget, only a fresh scan gets it back
+    if (!priv->root.isEmpty() && (priv->overflow || isScanning())) {
+        setRootPath(priv->root);
+        return;
+    }
+    // Stop tracking what is already watched there, nothing was removed so nobody is told
+    const auto dirs = priv->filesByDir.keys();
+    for(const auto& d: dirs)
+        if (isExcluded(d, priv->excluded))
+            priv->removeDir(d);
+}
+
+void ProjectFileWatcher::clear()
+{
+    priv->root.clear();
+    priv->filesByDir.clear();
+    priv->scanningDirs.clear();
+    priv->pendingChanges.clear();
+    priv->coalesceTimer.stop();
+    priv->watchCount = 0;
+    priv->overflow = false;
+    if (!priv->watcher->files().isEmpty())
+        priv->watcher->removePaths(priv->watcher->files());
+    if (!priv->watcher->directories().isEmpty())
+        priv->watcher->removePaths(priv->watcher->directories());
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROJECTFILEWATCHER_H
+#define PROJECTFILEWATCHER_H
+
+#include <QObject>
+
+class ProjectFileWatcher : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ProjectFileWatcher)
+public:
+    explicit ProjectFileWatcher(QObject *parent = nullptr);
+    virtual ~ProjectFileWatcher() override;
+
+    QString rootPath() const;
+    QStringList files() const;
+    bool isScanning() const;
+    // False when the watch limit left some files untracked
+    bool isComplete() const;
+    bool hasPendingChanges() const;
+
+signals:
+    void scanFinished(const QStringList& files);
+    void fileChanged(const QString& path);
+    void fileRemoved(const QString& path);
+
+public slots:
+    void setRootPath(const QString& path);
+    // Build output trees, never scanned nor watched
+    void setExcludedPaths(const QStringList& paths);
+    void clear();
+
+private:
+    void scanSubtree(const QString& path);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // PROJECTFILEWATCHER_H
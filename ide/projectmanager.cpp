@@ -21,9 +21,11 @@
 #include "childprocess.h"
 #include "icodemodelprovider.h"
 #include "processmanager.h"
+#include "projectfilewatcher.h"
 #include "projectmanager.h"
 #include "regexhtmltranslator.h"
 #include "textmessagebrocker.h"
+#include "wordindex.h"
 
 #include <QBuffer>
 #include <QFileInfo>
@@ -32,6 +34,8 @@
 #include <QHeaderView>
 #include <QLabel>
 #include <QListView>
+#include <QMenu>
+#include <QPointer>
 #include <QProcess>
 #include <QPushButton>
 #include <QRegularExpression>
@@ -56,34 +60,63 @@ public:
     QStringList targets;
     targetMap_t allTargets;
     targetMap_t allRefs;
+    QHash<QString, QString> variables;
     QRegularExpression targetFilter{ R"(^(?!Makefile)[a-zA-Z0-9_\\-]+$)", QRegularExpression::MultilineOption };
     QListView *targetView{ nullptr };
+    QHash<QString, QPointer<QPushButton>> targetButtons;
+    QString watchedTarget;
     ProcessManager *pman{ nullptr };
     QFileInfo makeFile;
     ICodeModelProvider *codeModelProvider{ nullptr };
+    ProjectFileWatcher *fileWatcher{ nullptr };
+    WordIndex *wordIndex{ nullptr };
     QTimer clearMessageTimer;
 
-    void doCloseProject() {
+    void markWatched(const QString& target, QPushButton *button) {
+        auto font = button->font();
+        font.setBold(target == watchedTarget);
+        button->setFont(font);
+    }
+
+    void clearTargets() {
         allTargets.clear();
+        variables.clear();
         targets.clear();
+        targetButtons.clear();
+
+        if (targetView) {
+            if (targetView->model())
+                targetView->model()->deleteLater();
+            targetView->setModel(new QStandardItemModel(targetView));
+        }
+    }
 
-        if (targetView->model())
-            targetView->model()->deleteLater();
-        targetView->setModel(new QStandardItemModel(targetView));
+    void startDiscover(const QString& makefile) {
+        pman->start(DISCOVER_PROC,
+                    "make",
+                    { "-B", "-p", "-r", "-n", "-f", makefile },
+                    { { "LC_ALL", "C" } },
+                    QFileInfo(makefile).absolutePath());
+    }
+
+    void doCloseProject() {
+        clearTargets();
 
-        if (pman->isRunning(DISCOVER_PROC))
-            pman->terminate(DISCOVER_PROC, true);
         makeFile = QFileInfo();
+        fileWatcher->clear();
+        wordIndex->clear();
 
-        for(auto *p: pman->findChildren<QProcess*>())
-            ChildProcess::safeStop(p);
+        // Stopping is asynchronous, a process restarted meanwhile waits for its previous run
+        for(auto *p: pman->processes())
+            pman->terminate(p->objectName());
     }
 };
 
-static QPair<targetMap_t, targetMap_t> findAllTargets(QIODevice *in)
+static QPair<targetMap_t, targetMap_t> findAllTargets(QIODevice *in, QHash<QString, QString> *variables)
 {
     QPair<targetMap_t, targetMap_t> map;
     QRegularExpression re(R"(^([^\#\s][^\%\=]*?):[^\=]\s*([^#\r\n]*?)\s*$)");
+    QRegularExpression varRe(R"(^([A-Za-z_][A-Za-z0-9_]*)\s*:?=\s*(.*?)\s*$)");
     while (!in->atEnd()) {
         auto line = in->readLine();
         if (line.startsWith("# Not a target:")) {
@@ -91,6 +124,11 @@ static QPair<targetMap_t, targetMap_t> findAllTargets(QIODevice *in)
             in->readLine();
             line = in->readLine();
         }
+        auto mv = varRe.match(line);
+        if (mv.hasMatch()) {
+            variables->insert(mv.captured(1), mv.captured(2));
+            continue;
+        }
         auto me = re.match(line);
         if (me.hasMatch()) {
             auto tgt = me.captured(1);
@@ -109,34 +147,39 @@ ProjectManager::ProjectManager(QListView *view, ProcessManager *pman, QObject *p
     priv(new Priv_t)
 {
     priv->targetView = view;
-    priv->targetView->setModel(new QStandardItemModel(priv->targetView));
     priv->pman = pman;
+    priv->fileWatcher = new ProjectFileWatcher(this);
+    priv->wordIndex = new WordIndex(priv->fileWatcher, this);
+
+    if (view) {
+        view->setModel(new QStandardItemModel(view));
+        connect(&AppConfig::instance(), &AppConfig::configChanged, [view]() {
+            for(auto *button: view->findChildren<QPushButton*>())
+                button->setIcon(QIcon(AppConfig::resourceImage({ "actions", "run-build" })));
+        });
 
-    connect(&AppConfig::instance(), &AppConfig::configChanged, [view]() {
-        for(auto *button: view->findChildren<QPushButton*>())
-            button->setIcon(QIcon(AppConfig::resourceImage({ "actions", "run-build" })));
-    });
-
-    auto label = new QLabel(view);
-    auto g = new QGridLayout(view);
-    g->addWidget(label, 1, 1);
-    g->setRowStretch(0, 1);
-    g->setColumnStretch(0, 1);
-    TextMessageBrocker::instance().subscribe(TextMessages::ACTION_LABEL, [label](const QString& s) {
-        label->setVisible(!s.isEmpty());
-        label->setText(s);
-    });
+        auto label = new QLabel(view);
+        auto g = new QGridLayout(view);
+        g->addWidget(label, 1, 1);
+        g->setRowStretch(0, 1);
+        g->setColumnStretch(0, 1);
+        TextMessageBrocker::instance().subscribe(TextMessages::ACTION_LABEL, [label](const QString& s) {
+            label->setVisible(!s.isEmpty());
+            label->setText(s);
+        });
+    }
     connect(&priv->clearMessageTimer, &QTimer::timeout, [this]() { clearMessage(); });
+    priv->pman->setPriority(DISCOVER_PROC, ChildProcess::Priority::Background);
     priv->pman->setTerminationHandler(DISCOVER_PROC, [this](QProcess *make, int code, QProcess::ExitStatus status) {
-        Q_UNUSED(code)
         if (status == QProcess::NormalExit) {
-            auto res = findAllTargets(make);
+            priv->variables.clear();
+            auto res = findAllTargets(make, &priv->variables);
             priv->allTargets = res.first;
             priv->allRefs = res.second;
             const auto targetKeys = priv->allTargets.keys();
             priv->targets = targetKeys.filter(priv->targetFilter);
             priv->targets.sort();
-            auto targetModel = qobject_cast<QStandardItemModel*>(priv->targetView->model());
+            auto targetModel = priv->targetView? qobject_cast<QStandardItemModel*>(priv->targetView->model()) : nullptr;
             if (targetModel) {
                 for(auto& t: priv->targets) {
                     auto item = new QStandardItem;
@@ -146,14 +189,33 @@ ProjectManager::ProjectManager(QListView *view, ProcessManager *pman, QObject *p
                     button->setIcon(QIcon(AppConfig::resourceImage({ "actions", "run-build" })));
                     button->setIconSize(TARGETVIEW_ICON_SIZE);
                     button->setText(name);
+                    button->setToolTip(tr("Build %1, Shift+click runs make even if nothing changed").arg(t));
                     button->setStyleSheet("text-align: left; padding: 4px;");
                     priv->targetView->setIndexWidget(item->index(), button);
                     item->setSizeHint(button->sizeHint());
                     connect(button, &QPushButton::clicked, [t, this](){ emit targetTriggered(t); });
+                    button->setContextMenuPolicy(Qt::CustomContextMenu);
+                    connect(button, &QPushButton::customContextMenuRequested, [t, button, this](const QPoint& pos) {
+                        QMenu menu;
+                        auto watch = menu.addAction(tr("Rebuild on save"));
+                        watch->setCheckable(true);
+                        watch->setChecked(priv->watchedTarget == t);
+                        connect(watch, &QAction::toggled, [t, this](bool on) { emit watchTargetRequested(on? t : QString()); });
+                        menu.exec(button->mapToGlobal(pos));
+                    });
+                    priv->targetButtons.insert(t, button);
+                    priv->markWatched(t, button);
                 }
             }
         }
         showMessageTimed(tr("Finish target discover"));
+        emit discoverFinished(status == QProcess::NormalExit && code == 0);
+    });
+    priv->pman->setErrorHandler(DISCOVER_PROC, [this](QProcess *make, QProcess::ProcessError err) {
+        if (err == QProcess::FailedToStart) {
+            showMessageTimed(tr("Can not discover targets: %1").arg(make->errorString()));
+            emit discoverFinished(false);
+        }
     });
 }
 
@@ -192,6 +254,24 @@ void ProjectManager::setCodeModelProvider(ICodeModelProvider *modelProvider)
     priv->codeModelProvider = modelProvider;
 }
 
+ProjectFileWatcher *ProjectManager::fileWatcher() const
+{
+    return priv->fileWatcher;
+}
+
+WordIndex *ProjectManager::wordIndex() const
+{
+    return priv->wordIndex;
+}
+
+void ProjectManager::setWatchedTarget(const QString &target)
+{
+    priv->watchedTarget = target;
+    for(auto it = priv->targetButtons.begin(); it != priv->targetButtons.end(); ++it)
+        if (it.value())
+            priv->markWatched(it.key(), it.value());
+}
+
 QStringList ProjectManager::dependenciesForTarget(const QString &target)
 {
     return priv->allTargets.value(target);
@@ -202,6 +282,16 @@ QStringList ProjectManager::targetsOfDependency(const QString &dep)
     return priv->allRefs.value(dep);
 }
 
+QStringList ProjectManager::targets() const
+{
+    return priv->targets;
+}
+
+QString ProjectManager::makeVariable(const QString &name) const
+{
+    return priv->variables.value(name);
+}
+
 void ProjectManager::createProject(const QString& projectFilePath, const QString& templateFile)
 {
     AppConfig::ensureExist(projectFilePath);
@@ -304,17 +394,17 @@ void ProjectManager::exportToTarGz(const QString &tgzFile)
 void ProjectManager::openProject(const QString &makefile)
 {
     auto doOpenProject = [makefile, this]() {
-        priv->pman->start(DISCOVER_PROC,
-                          "make",
-                          { "-B", "-p", "-r", "-n", "-f", makefile },
-                          { { "LC_ALL", "C" } },
-                          QFileInfo(makefile).absolutePath());
+        priv->startDiscover(makefile);
         priv->makeFile = QFileInfo(makefile);
+        // Without a view this is a headless run, it exits before a tree scan or word index would pay off
+        if (priv->targetView)
+            priv->fileWatcher->setRootPath(projectPath());
         emit projectOpened(makefile);
         showMessageTimed(tr("Discovering targets..."));
         constexpr auto DO_OPEN_DELAY_MS = 100;
         QTimer::singleShot(DO_OPEN_DELAY_MS, [this]() {
-            priv->codeModelProvider->startIndexingProject(projectPath());
+            if (priv->codeModelProvider)
+                priv->codeModelProvider->startIndexingProject(projectPath());
         });
     };
 
@@ -340,6 +430,17 @@ void ProjectManager::reloadProject()
     openProject(project);
 }
 
+void ProjectManager::rediscover()
+{
+    if (!isProjectOpen())
+        return;
+    priv->clearTargets();
+    // A discover still running works on the old makefile, start() waits until it is gone
+    priv->pman->terminate(DISCOVER_PROC);
+    priv->startDiscover(projectFile());
+    showMessageTimed(tr("Discovering targets..."));
+}
+
 void ProjectManager::showMessage(const QString &msg)
 {
     priv->clearMessageTimer.stop();
@@ -27,12 +27,15 @@ class QListView;
 
 class ProcessManager;
 class ICodeModelProvider;
+class ProjectFileWatcher;
+class WordIndex;
 
 class ProjectManager : public QObject
 {
     Q_OBJECT
     Q_DISABLE_COPY(ProjectManager)
 public:
+    // Without a view nothing is shown, as used by the command line modes
     explicit ProjectManager(QListView *view, ProcessManager *pman, QObject *parent = nullptr);
     virtual ~ProjectManager();
 
@@ -42,9 +45,15 @@ public:
     bool isProjectOpen() const;
     ICodeModelProvider *codeModel() const;
     void setCodeModelProvider(ICodeModelProvider *modelProvider);
+    ProjectFileWatcher *fileWatcher() const;
+    WordIndex *wordIndex() const;
 
+    // Buildable targets of the last discover, as shown in the target view
+    QStringList targets() const;
     QStringList dependenciesForTarget(const QString& target);
     QStringList targetsOfDependency(const QString& dep);
+    // Unexpanded value as seen in the make database of the last discover
+    QString makeVariable(const QString& name) const;
 
     void deleteOnCloseProject(QObject *p) {
         connect(this, &ProjectManager::projectClosed, p, &QObject::deleteLater);
@@ -53,7 +62,10 @@ public:
 signals:
     void projectOpened(const QString& makePath);
     void projectClosed();
+    void discoverFinished(bool ok);
     void targetTriggered(const QString& target);
+    // From the target context menu, empty to stop watching
+    void watchTargetRequested(const QString& target);
     void requestFileOpen(const QString& path);
     void exportFinish(const QString& exportMessage);
 
@@ -66,6 +78,10 @@ public slots:
     void openProject(const QString& makefile);
     void closeProject();
     void reloadProject();
+    // Runs the target discover again without touching editors, indexes or running processes
+    void rediscover();
+    // Highlights the target rebuilt on save
+    void setWatchedTarget(const QString& target);
 
     void showMessage(const QString& msg);
     void showMessageTimed(const QString& msg, int millis = 3000);
@@ -0,0 +1,433 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "sourceoutline.h"
+
+#include <QFutureWatcher>
+#include <QRegularExpression>
+#include <QStandardItemModel>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <QtDebug>
+
+#include <algorithm>
+
+using Symbol = SourceOutline::Symbol;
+using Kind = SourceOutline::Symbol::Kind;
+
+namespace {
+
+// Range of lines between two points where the scanner is at top level with
+// nothing pending. Re-parsing always restarts and resynchronizes on those.
+struct Chunk {
+    int first;
+    int last;
+    QVector<Symbol> symbols;
+};
+using ChunkList = QVector<Chunk>;
+
+struct ParseRequest {
+    QString text;
+    ChunkList previous;
+    int dirtyFirst{ 0 };
+    int dirtyLast{ -1 };
+    int lineDelta{ 0 };
+    bool full{ true };
+};
+
+const QStringList NOT_A_NAME = {
+    "if", "while", "for", "switch", "return", "sizeof", "defined",
+    "__attribute__", "__declspec", "__asm__", "asm", "alignas", "_Alignas",
+    "static_assert", "_Static_assert", "decltype", "typeof", "__typeof__",
+};
+
+class Scanner {
+public:
+    ChunkList chunks;
+
+    bool isClean() const {
+        return mode == Mode::Code && depth == 0 && !continuation && stmt.trimmed().isEmpty();
+    }
+
+    void scanLine(QStringRef text, int line) {
+        if (text.endsWith('\r'))
+            text.chop(1);
+        int i = 0;
+        auto n = text.size();
+        while (i < n && text.at(i).isSpace())
+            i++;
+        if (i < n && chunkFirst < 0)
+            chunkFirst = line;
+        if (continuation) {
+            continuation = text.endsWith('\\');
+        } else if (mode == Mode::Code && i < n && text.at(i) == '#') {
+            directive(text.mid(i + 1).trimmed(), line);
+            continuation = text.endsWith('\\');
+        } else {
+            code(text, i, line);
+        }
+        if (chunkFirst >= 0 && isClean()) {
+            chunks.append({ chunkFirst, line, symbols });
+            symbols.clear();
+            chunkFirst = -1;
+        }
+    }
+
+    void finish(int line) {
+        if (chunkFirst >= 0)
+            chunks.append({ chunkFirst, line, symbols });
+    }
+
+private:
+    enum class Mode { Code, BlockComment, String, Char };
+
+    Mode mode{ Mode::Code };
+    int depth{ 0 };
+    bool continuation{ false };
+    int chunkFirst{ -1 };
+    QVector<Symbol> symbols;
+    QVector<int> ifDepth;
+    QString stmt;
+    QVector<int> stmtLine;
+    QString header;
+    QVector<int> headerLine;
+
+    void add(const QString& name, Kind kind, int line) {
+        if (name.isEmpty() || NOT_A_NAME.contains(name))
+            return;
+        for(const auto& s: symbols)
+            if (s.name == name && s.kind == kind)
+                return;
+        symbols.append({ name, kind, line });
+    }
+
+    void push(QChar c, int line) {
+        stmt.append(c);
+        stmtLine.append(line);
+    }
+
+    void directive(const QStringRef& text, int line) {
+        static const QRegularExpression DEFINE_RE(R"(^define\s+(\w+))");
+        if (text.startsWith("if")) {
+            ifDepth.append(depth);
+        } else if (text.startsWith("el")) {
+            // Keep brace balance when both branches open the same block
+            if (!ifDepth.isEmpty())
+                depth = ifDepth.last();
+        } else if (text.startsWith("endif")) {
+            if (!ifDepth.isEmpty())
+                ifDepth.removeLast();
+        } else {
+            auto m = DEFINE_RE.match(text);
+            if (m.hasMatch())
+                add(m.captured(1), Kind::Macro, line);
+        }
+    }
+
+    void code(const QStringRef& text, int i, int line) {
+        auto n = text.size();
+        while (i < n) {
+            auto c = text.at(i);
+            auto next = i + 1 < n? text.at(i + 1) : QChar();
+            switch (mode) {
+            case Mode::BlockComment:
+                if (c == '*' && next == '/') {
+                    mode = Mode::Code;
+                    i++;
+                }
+                break;
+            case Mode::String:
+            case Mode::Char:
+                if (c == '\\') {
+                    i++;
+                } else if ((mode == Mode::String && c == '"') || (mode == Mode::Char && c == '\'')) {
+                    if (depth == 0)
+                        push(c, line);
+                    mode = Mode::Code;
+                }
+                break;
+            case Mode::Code:
+                if (c == '/' && next == '/')
+                    return;
+                if (c == '/' && next == '*') {
+                    mode = Mode::BlockComment;
+                    i++;
+                } else if (c == '"' || c == '\'') {
+                    mode = c == '"'? Mode::String : Mode::Char;
+                    if (depth == 0)
+                        push(c, line);
+                } else if (c == '{') {
+                    if (depth == 0)
+                        openBlock(line);
+                    else
+                        depth++;
+                } else if (c == '}') {
+                    if (depth > 0 && --depth == 0)
+                        closeBlock(line);
+                } else if (c == ';' && depth == 0) {
+                    statement();
+                } else if (depth == 0) {
+                    push(c, line);
+                }
+                break;
+            }
+            i++;
+        }
+        // Unterminated literals do not span lines
+        if (mode == Mode::String || mode == Mode::Char)
+            mode = Mode::Code;
+        if (depth == 0 && !stmt.isEmpty())
+            push(' ', line);
+    }
+
+    void openBlock(int line) {
+        static const QRegularExpression TRANSPARENT_RE(R"(^\s*(extern\s*""|namespace\b\s*(\w*))\s*$)");
+        static const QRegularExpression TYPE_RE(R"(^\s*(?:typedef\s+)?(struct|union|enum|class)\s+(\w+))");
+        auto m = TRANSPARENT_RE.match(stmt);
+        if (m.hasMatch()) {
+            // Linkage and namespace blocks keep their contents at top level
+            if (!m.captured(2).isEmpty())
+                add(m.captured(2), Kind::Type, stmtLine.value(m.capturedStart(2), line));
+            stmt.clear();
+            stmtLine.clear();
+            return;
+        }
+        m = TYPE_RE.match(stmt);
+        if (m.hasMatch())
+            add(m.captured(2), Kind::Type, stmtLine.value(m.capturedStart(2), line));
+        header = stmt;
+        headerLine = stmtLine;
+        depth = 1;
+    }
+
+    void closeBlock(int line) {
+        auto nameAt = functionName(header);
+        if (nameAt >= 0) {
+            static const QRegularExpression NAME_RE(R"([\w:~]+)");
+            add(NAME_RE.match(header, nameAt).captured(), Kind::Function, headerLine.value(nameAt, line));
+            stmt.clear();
+            stmtLine.clear();
+        } else {
+            push('{', line);
+            push('}', line);
+        }
+    }
+
+    void statement() {
+        static const QRegularExpression FPTR_RE(R"(\(\s*\*\s*(\w+)\s*\))");
+        static const QRegularExpression LAST_ID_RE(R"((\w+)\s*(?:\[[^\]]*\]\s*)*$)");
+        static const QRegularExpression SKIP_RE(R"(^\s*(extern|using|template|friend|return|static_assert|_Static_assert)\b)");
+        static const QRegularExpression TYPEDEF_RE(R"(^\s*typedef\b)");
+        auto text = stmt;
+        auto lines = stmtLine;
+        stmt.clear();
+        stmtLine.clear();
+        if (text.trimmed().isEmpty() || SKIP_RE.match(text).hasMatch())
+            return;
+        auto fptr = FPTR_RE.match(text);
+        if (TYPEDEF_RE.match(text).hasMatch()) {
+            auto m = fptr.hasMatch()? fptr : LAST_ID_RE.match(text);
+            if (m.hasMatch())
+                add(m.captured(1), Kind::Type, lines.value(m.capturedStart(1)));
+            return;
+        }
+        auto declarator = text.left(text.indexOf('='));
+        if (declarator.contains("{}"))
+            return; // struct/enum definition, already added when opened
+        if (fptr.hasMatch()) {
+            add(fptr.captured(1), Kind::Variable, lines.value(fptr.capturedStart(1)));
+            return;
+        }
+        if (declarator.contains('('))
+            return; // Prototype, the definition is what matters
+        auto first = declarator.left(declarator.indexOf(','));
+        auto m = LAST_ID_RE.match(first);
+        if (m.hasMatch())
+            add(m.captured(1), Kind::Variable, lines.value(m.capturedStart(1)));
+    }
+
+    static int functionName(const QString& header) {
+        static const QRegularExpression CALL_RE(R"(([\w:~]+)\s*\()");
+        static const QRegularExpression INIT_LIST_RE(R"(\)\s*:(?!:))");
+        int parens = 0;
+        for(const auto& c: header) {
+            if (c == '(')
+                parens++;
+            else if (c == ')')
+                parens--;
+            else if (c == '=' && parens == 0)
+                return -1;
+        }
+        if (!header.contains(')'))
+            return -1;
+        // The parameter list is the last call-like group, before any initializer list
+        auto cut = header.indexOf(INIT_LIST_RE);
+        auto it = CALL_RE.globalMatch(cut < 0? header : header.left(cut + 1));
+        int nameAt = -1;
+        while (it.hasNext()) {
+            auto m = it.next();
+            auto name = m.captured(1);
+            if (!NOT_A_NAME.contains(name.mid(name.lastIndexOf(':') + 1)))
+                nameAt = m.capturedStart(1);
+        }
+        return nameAt;
+    }
+};
+
+ChunkList parseOutline(const ParseRequest& r)
+{
+    const auto lines = r.text.splitRef('\n');
+    Scanner scanner;
+    int line = 0;
+    if (!r.full) {
+        for(const auto& c: r.previous) {
+            if (c.last >= r.dirtyFirst)
+                break;
+            scanner.chunks.append(c);
+            line = c.last + 1;
+        }
+    }
+    int oldIdx = 0;
+    auto resynced = false;
+    for(; line < lines.size() && !resynced; line++) {
+        scanner.scanLine(lines.at(line), line);
+        if (r.full || line < r.dirtyLast || !scanner.isClean())
+            continue;
+        // Past the edit and at top level: reuse the old tail if it agrees
+        auto oldLine = line - r.lineDelta;
+        while (oldIdx < r.previous.size() && r.previous.at(oldIdx).last < oldLine)
+            oldIdx++;
+        if (oldIdx < r.previous.size()) {
+            const auto& c = r.previous.at(oldIdx);
+            if (c.first <= oldLine && oldLine < c.last)
+                continue;
+            if (c.last == oldLine)
+                oldIdx++;
+        }
+        for(int i = oldIdx; i < r.previous.size(); i++) {
+            auto c = r.previous.at(i);
+            c.first += r.lineDelta;
+            c.last += r.lineDelta;
+            for(auto& s: c.symbols)
+                s.line += r.lineDelta;
+            scanner.chunks.append(c);
+        }
+        resynced = true;
+    }
+    if (!resynced)
+        scanner.finish(lines.size() - 1);
+    return scanner.chunks;
+}
+
+}
+
+class SourceOutline::Priv_t
+{
+public:
+    QStandardItemModel *model{ nullptr };
+    QFutureWatcher<ChunkList> *watcher{ nullptr };
+    ChunkList chunks;
+    SymbolList symbols;
+
+    void start(ParseRequest request) {
+        request.previous = chunks;
+        watcher->setFuture(QtConcurrent::run(parseOutline, request));
+    }
+
+    static QString iconFor(Kind kind) {
+        switch (kind) {
+        case Kind::Macro: return "code-context";
+        case Kind::Type: return "code-typedef";
+        case Kind::Function: return "code-function";
+        case Kind::Variable: return "code-variable";
+        }
+        return "code-block";
+    }
+
+    void rebuildModel() {
+        model->clear();
+        for(const auto& s: symbols) {
+            auto item = new QStandardItem(QIcon(AppConfig::resourceImage({ "actions", iconFor(s.kind) })), s.name);
+            item->setData(s.line + 1);
+            item->setToolTip(tr("Line %1").arg(s.line + 1));
+            item->setEditable(false);
+            model->appendRow(item);
+        }
+    }
+};
+
+SourceOutline::SourceOutline(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->model = new QStandardItemModel(this);
+    priv->watcher = new QFutureWatcher<ChunkList>(this);
+    connect(priv->watcher, &QFutureWatcher<ChunkList>::finished, [this]() {
+        priv->chunks = priv->watcher->result();
+        SymbolList list;
+        for(const auto& c: priv->chunks)
+            for(const auto& s: c.symbols)
+                list.append(s);
+        if (list != priv->symbols) {
+            priv->symbols = list;
+            priv->rebuildModel();
+        }
+        emit updated();
+    });
+}
+
+SourceOutline::~SourceOutline()
+{
+    priv->watcher->waitForFinished();
+    delete priv;
+}
+
+QStandardItemModel *SourceOutline::model() const
+{
+    return priv->model;
+}
+
+SourceOutline::SymbolList SourceOutline::symbols() const
+{
+    return priv->symbols;
+}
+
+bool SourceOutline::isBusy() const
+{
+    return priv->watcher->isRunning();
+}
+
+void SourceOutline::parse(const QString &text)
+{
+    ParseRequest r;
+    r.text = text;
+    priv->start(r);
+}
+
+void SourceOutline::reparse(const QString &text, int firstDirtyLine, int lastDirtyLine, int lineDelta)
+{
+    ParseRequest r;
+    r.text = text;
+    r.dirtyFirst = firstDirtyLine;
+    r.dirtyLast = lastDirtyLine;
+    r.lineDelta = lineDelta;
+    r.full = priv->chunks.isEmpty();
+    priv->start(r);
+}
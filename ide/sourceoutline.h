@@ -0,0 +1,63 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SOURCEOUTLINE_H
+#define SOURCEOUTLINE_H
+
+#include <QObject>
+
+class QStandardItemModel;
+
+class SourceOutline : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SourceOutline)
+public:
+    struct Symbol {
+        enum class Kind { Macro, Type, Function, Variable };
+
+        QString name;
+        Kind kind = Kind::Function;
+        int line = -1;
+
+        bool operator==(const Symbol& other) const {
+            return name == other.name && kind == other.kind && line == other.line;
+        }
+    };
+    typedef QList<Symbol> SymbolList;
+
+    explicit SourceOutline(QObject *parent = nullptr);
+    virtual ~SourceOutline() override;
+
+    QStandardItemModel *model() const;
+    SymbolList symbols() const;
+    bool isBusy() const;
+
+signals:
+    void updated();
+
+public slots:
+    void parse(const QString& text);
+    void reparse(const QString& text, int firstDirtyLine, int lastDirtyLine, int lineDelta);
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // SOURCEOUTLINE_H
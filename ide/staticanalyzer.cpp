@@ -0,0 +1,660 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "buildtimes.h"
+#include "childprocess.h"
+#include "compilecache.h"
+#include "jobserver.h"
+#include "projectfilewatcher.h"
+#include "projectmanager.h"
+#include "staticanalyzer.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStandardItemModel>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <functional>
+
+#include <QtDebug>
+
+// Lets the editing settle, analyzing half written code is wasted work
+static constexpr auto IDLE_DELAY_MS = 3000;
+static constexpr auto KEY_ROLE = Qt::UserRole + 4;
+static constexpr auto MAX_CACHE_BYTES = qint64(64) * 1024 * 1024;
+
+namespace {
+
+using Diagnostic = ICodeModelProvider::Diagnostic;
+using Severity = ICodeModelProvider::Diagnostic::Severity;
+
+const QRegularExpression FINDING_RE{
+    R"(^(.+?):(\d+):(\d+):\s+(fatal error|error|warning|note|style|performance|portability|information):\s+(.*)$)" };
+const QRegularExpression COMPILER_RE{ R"((?:^|[/-])(?:gcc|g\+\+|cc|c\+\+|clang|clang\+\+)(?:-[\d.]+)?$)" };
+const QRegularExpression SPACES_RE{ R"(\s+)" };
+
+struct Finding {
+    QString file;
+    Diagnostic diagnostic;
+};
+using FindingList = QList<Finding>;
+
+struct Analyzer {
+    QString name;
+    QString program;
+    QByteArray fingerprint;
+    std::function<QStringList (const QString& unit, const QStringList& flags)> arguments;
+};
+
+// Only what resolves the code is kept, target specific switches confuse the analyzers
+struct Unit {
+    QString workingDirectory;
+    QString compiler;
+    QStringList flags;
+};
+
+// Content hash of a dependency, reused while the file is untouched
+struct Digest {
+    qint64 size{ -1 };
+    qint64 modified{ -1 };
+    QByteArray hash;
+};
+
+struct Task {
+    QString unit;
+    int analyzer;
+};
+
+Severity severityOf(const QString& text)
+{
+    if (text == "note" || text == "information")
+        return Severity::Note;
+    if (text == "error" || text == "fatal error")
+        return Severity::Error;
+    return Severity::Warning;
+}
+
+QByteArray fingerprintOf(const QString& program)
+{
+    QFileInfo info(program);
+    return QString("%1\n%2\n%3").arg(info.canonicalFilePath()).arg(info.size())
+            .arg(info.lastModified().toMSecsSinceEpoch()).toUtf8();
+}
+
+QList<Analyzer> installedAnalyzers()
+{
+    QList<Analyzer> list;
+    auto cppcheck = QStandardPaths::findExecutable("cppcheck");
+    if (!cppcheck.isEmpty()) {
+        list.append(Analyzer{ "cppcheck", cppcheck, fingerprintOf(cppcheck),
+                              [](const QString& unit, const QStringList& flags) {
+            QStringList args{ "--quiet", "--inline-suppr", "--enable=warning,style,performance,portability",
+                              "--template={file}:{line}:{column}: {severity}: {message} [{id}]" };
+            for(int i = 0; i < flags.size(); i++) {
+                const auto& f = flags.at(i);
+                if (f == "-isystem" && i + 1 < flags.size())
+                    args.append("-I" + flags.at(++i));
+                else if (f == "-include")
+                    i++;
+                else if (f.startsWith("-I") || f.startsWith("-D") || f.startsWith("-U"))
+                    args.append(f);
+            }
+            return args << unit;
+        }});
+    }
+    auto tidy = QStandardPaths::findExecutable("clang-tidy");
+    if (!tidy.isEmpty()) {
+        list.append(Analyzer{ "clang-tidy", tidy, fingerprintOf(tidy),
+                              [](const QString& unit, const QStringList& flags) {
+            return QStringList{ "--quiet", unit, "--" } + flags;
+        }});
+    }
+    return list;
+}
+
+QHash<QString, Unit> parseUnits(const QString& text, const QString& base)
+{
+    QHash<QString, Unit> units;
+    QStringList dirs;
+    for(auto line: text.split('\n')) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        if (BuildTimes::followDirectory(line, &dirs))
+            continue;
+        auto source = BuildTimes::compiledSource(line);
+        if (source.isEmpty())
+            continue;
+        Unit u;
+        u.workingDirectory = dirs.isEmpty()? base : dirs.last();
+        const auto tokens = line.split(SPACES_RE, QString::SkipEmptyParts);
+        for(int i = 0; i < tokens.size(); i++) {
+            const auto& t = tokens.at(i);
+            if (u.compiler.isEmpty() && !t.startsWith('-') && COMPILER_RE.match(t).hasMatch())
+                u.compiler = t;
+            else if ((t == "-I" || t == "-D" || t == "-U") && i + 1 < tokens.size())
+                u.flags.append(t + tokens.at(++i));
+            else if ((t == "-isystem" || t == "-include") && i + 1 < tokens.size())
+                u.flags << t << tokens.at(++i);
+            else if (t.startsWith("-I") || t.startsWith("-D") || t.startsWith("-U") || t.startsWith("-std="))
+                u.flags.append(t);
+        }
+        units.insert(QDir::cleanPath(QDir(u.workingDirectory).absoluteFilePath(source)), u);
+    }
+    return units;
+}
+
+// The make rule a compiler prints for -M, every prerequisite is something the unit includes
+QStringList parseDependencies(const QString& text, const QString& workingDirectory)
+{
+    QStringList list;
+    auto rule = QString(text).replace("\\\n", " ");
+    auto colon = rule.indexOf(": ");
+    if (colon < 0)
+        return list;
+    for(const auto& dep: rule.mid(colon + 2).split(SPACES_RE, QString::SkipEmptyParts))
+        list.append(QDir::cleanPath(QDir(workingDirectory).absoluteFilePath(dep)));
+    return list;
+}
+
+FindingList parseFindings(const QString& output, const QString& workingDirectory)
+{
+    FindingList list;
+    for(auto line: output.split('\n')) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        auto m = FINDING_RE.match(line);
+        if (!m.hasMatch())
+            continue;
+        auto severity = severityOf(m.captured(4));
+        if (severity == Severity::Note)
+            continue;
+        Finding f;
+        f.file = QDir::cleanPath(QDir(workingDirectory).absoluteFilePath(m.captured(1)));
+        f.diagnostic.line = m.captured(2).toInt();
+        f.diagnostic.column = m.captured(3).toInt();
+        f.diagnostic.severity = severity;
+        f.diagnostic.message = m.captured(5);
+        list.append(f);
+    }
+    return list;
+}
+
+QString cacheDir()
+{
+    return AppConfig::ensureExist(QDir(AppConfig::instance().workspacePath()).absoluteFilePath("analysis-cache"));
+}
+
+QString cacheFile(const QString& key)
+{
+    return QDir(cacheDir()).absoluteFilePath(QString("%1/%2.json").arg(key.left(2), key));
+}
+
+bool loadCached(const QString& key, FindingList *list)
+{
+    QFile f(cacheFile(key));
+    if (!f.open(QFile::ReadWrite))
+        return false;
+    // Marks the entry as used for trimming
+    f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    for(const auto& v: QJsonDocument::fromJson(f.readAll()).array()) {
+        auto o = v.toObject();
+        Finding finding;
+        finding.file = o.value("file").toString();
+        finding.diagnostic.line = o.value("line").toInt();
+        finding.diagnostic.column = o.value("column").toInt();
+        finding.diagnostic.severity = Severity(o.value("severity").toInt());
+        finding.diagnostic.message = o.value("message").toString();
+        list->append(finding);
+    }
+    return true;
+}
+
+void storeCached(const QString& key, const FindingList& list)
+{
+    QJsonArray array;
+    for(const auto& finding: list)
+        array.append(QJsonObject{
+            { "file", finding.file },
+            { "line", finding.diagnostic.line },
+            { "column", finding.diagnostic.column },
+            { "severity", int(finding.diagnostic.severity) },
+            { "message", finding.diagnostic.message },
+        });
+    auto path = cacheFile(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile f(path);
+    if (f.open(QFile::WriteOnly | QFile::Truncate))
+        f.write(QJsonDocument(array).toJson(QJsonDocument::Compact));
+}
+
+QList<QStandardItem*> makeRow(const Finding& finding, const QString& location, const QString& analyzer, const QString& key)
+{
+    auto messageItem = new QStandardItem(finding.diagnostic.message);
+    auto locationItem = new QStandardItem(location);
+    auto analyzerItem = new QStandardItem(analyzer);
+    for(auto item: { messageItem, locationItem, analyzerItem }) {
+        item->setEditable(false);
+        item->setToolTip(finding.diagnostic.message);
+        item->setData(finding.file, StaticAnalyzer::FILE_ROLE);
+        item->setData(finding.diagnostic.line, StaticAnalyzer::LINE_ROLE);
+        item->setData(finding.diagnostic.column, StaticAnalyzer::COLUMN_ROLE);
+        item->setData(key, KEY_ROLE);
+    }
+    if (finding.diagnostic.severity == Severity::Error)
+        messageItem->setForeground(QColor(Qt::red));
+    else if (finding.diagnostic.severity == Severity::Warning)
+        messageItem->setForeground(QColor(Qt::darkYellow));
+    return { messageItem, locationItem, analyzerItem };
+}
+
+}
+
+class StaticAnalyzer::Priv_t
+{
+public:
+    StaticAnalyzer *q{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QStandardItemModel *model{ nullptr };
+    QList<Analyzer> analyzers;
+    QHash<QString, Unit> units;
+    // Files each unit includes, scanned again when any of them changes
+    QHash<QString, QStringList> dependencies;
+    QHash<QString, Digest> digests;
+    // Tasks waiting for the dependency scan of their unit
+    QHash<QString, QList<Task>> scanning;
+    // Keyed by unit and analyzer, see keyOf
+    QHash<QString, FindingList> findings;
+    QList<Task> queue;
+    QSet<QString> queued;
+    QSet<ChildProcess*> running;
+    QTimer idleTimer;
+    int generation{ 0 };
+    int findingCount{ 0 };
+
+    static QString keyOf(const QString& unit, const QString& analyzer) {
+        return QString("%1|%2").arg(unit, analyzer);
+    }
+
+    bool enabled() const {
+        return proj && !analyzers.isEmpty() && AppConfig::instance().staticAnalysis() &&
+                !proj->projectPath().isEmpty();
+    }
+
+    int pending() const {
+        return queue.size() + running.size();
+    }
+
+    void enqueue(const QString& unit) {
+        for(int i = 0; i < analyzers.size(); i++) {
+            auto key = keyOf(unit, analyzers.at(i).name);
+            if (queued.contains(key))
+                continue;
+            queued.insert(key);
+            queue.append(Task{ unit, i });
+        }
+        idleTimer.start();
+        emit q->pendingChanged(pending());
+    }
+
+    void fileChanged(const QString& path) {
+        QStringList affected;
+        if (units.contains(path))
+            affected.append(path);
+        for(auto it = dependencies.begin(); it != dependencies.end(); ++it)
+            if (it.value().contains(path) && !affected.contains(it.key()))
+                affected.append(it.key());
+        for(const auto& unit: affected) {
+            // The change may add or drop includes
+            dependencies.remove(unit);
+            enqueue(unit);
+        }
+    }
+
+    QByteArray digestOf(const QString& path) {
+        QFileInfo info(path);
+        auto& d = digests[path];
+        auto modified = info.exists()? info.lastModified().toMSecsSinceEpoch() : -1;
+        if (d.hash.isEmpty() || d.size != info.size() || d.modified != modified) {
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            QFile f(path);
+            if (f.open(QFile::ReadOnly))
+                hash.addData(&f);
+            d.size = info.size();
+            d.modified = modified;
+            d.hash = hash.result();
+        }
+        return d.hash;
+    }
+
+    void scan(const Task& task) {
+        auto& waiting = scanning[task.unit];
+        waiting.append(task);
+        if (waiting.size() > 1)
+            return;
+        auto unit = units.value(task.unit);
+        if (unit.compiler.isEmpty()) {
+            scanned(task.unit, {});
+            return;
+        }
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(unit.workingDirectory)
+                .makeDeleteLater();
+        p.setStandardErrorFile(QProcess::nullDevice());
+        auto gen = generation;
+        auto proc = &p;
+        auto path = task.unit;
+        p.onFinished([this, gen, proc, path, unit](QProcess *compiler, int exitCode) {
+            running.remove(proc);
+            if (gen != generation)
+                return;
+            auto ok = exitCode == 0 && compiler->exitStatus() == QProcess::NormalExit;
+            scanned(path, ok? parseDependencies(QString::fromLocal8Bit(compiler->readAllStandardOutput()),
+                                                unit.workingDirectory) : QStringList());
+        }).onError([this, gen, proc, path](QProcess *compiler, QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart)
+                return;
+            qDebug() << "can not run" << compiler->program() << compiler->errorString();
+            running.remove(proc);
+            if (gen == generation)
+                scanned(path, {});
+        });
+        running.insert(proc);
+        // -MG lists generated headers that do not exist yet instead of failing
+        JobServer::instance().startWithToken(proc, unit.compiler, QStringList{ "-M", "-MG" } + unit.flags << path);
+    }
+
+    void scanned(const QString& unit, const QStringList& list) {
+        // Without a scan only the unit itself is known, header changes are then missed
+        dependencies.insert(unit, list.isEmpty()? QStringList{ unit } : list);
+        auto tasks = scanning.take(unit);
+        for(auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+            queued.insert(keyOf(it->unit, analyzers.at(it->analyzer).name));
+            queue.prepend(*it);
+        }
+        dispatch();
+    }
+
+    void trimCache() {
+        auto watcher = new QFutureWatcher<qint64>(q);
+        QObject::connect(watcher, &QFutureWatcher<qint64>::finished, watcher, &QObject::deleteLater);
+        // Walks the whole store, keep it away from the GUI thread
+        watcher->setFuture(QtConcurrent::run(CompileCache::trim, cacheDir(), MAX_CACHE_BYTES));
+    }
+
+    void learnUnits() {
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(proj->projectPath())
+                .makeDeleteLater();
+        p.setStandardErrorFile(QProcess::nullDevice());
+        auto gen = generation;
+        p.onFinished([this, gen](QProcess *make, int) {
+            if (gen != generation)
+                return;
+            units = parseUnits(QString::fromLocal8Bit(make->readAllStandardOutput()), proj->projectPath());
+            for(auto it = units.begin(); it != units.end(); ++it)
+                enqueue(it.key());
+        });
+        // The default goal with every rule remade lists the compile line of each translation unit
+        p.start("make", { "-B", "-n", "-w", "-f", proj->projectFile() });
+    }
+
+    void dispatch() {
+        auto budget = qMax(1, AppConfig::instance().staticAnalysisJobs());
+        while (running.size() < budget && !queue.isEmpty()) {
+            auto task = queue.takeFirst();
+            queued.remove(keyOf(task.unit, analyzers.at(task.analyzer).name));
+            run(task);
+        }
+        if (pending() == 0 && scanning.isEmpty())
+            trimCache();
+        emit q->pendingChanged(pending());
+    }
+
+    void run(const Task& task) {
+        const auto& analyzer = analyzers.at(task.analyzer);
+        auto unit = units.value(task.unit);
+        if (!QFileInfo(task.unit).isFile()) {
+            apply(task.unit, analyzer.name, {});
+            return;
+        }
+        if (!dependencies.contains(task.unit)) {
+            scan(task);
+            return;
+        }
+        // Findings depend on every included header as much as on the unit
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(analyzer.name.toUtf8());
+        hash.addData(analyzer.fingerprint);
+        hash.addData(unit.flags.join(QChar(0)).toUtf8());
+        hash.addData(task.unit.toUtf8());
+        hash.addData(digestOf(task.unit));
+        for(const auto& dep: dependencies.value(task.unit)) {
+            hash.addData(dep.toUtf8());
+            hash.addData(digestOf(dep));
+        }
+        auto key = QString(hash.result().toHex());
+        FindingList cached;
+        if (loadCached(key, &cached)) {
+            apply(task.unit, analyzer.name, cached);
+            return;
+        }
+
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Background)
+                .changeCWD(unit.workingDirectory)
+                .mergeStdOutAndErr()
+                .makeDeleteLater();
+        auto gen = generation;
+        auto proc = &p;
+        auto name = analyzer.name;
+        auto path = task.unit;
+        p.onFinished([this, gen, proc, name, path, key, unit](QProcess *tool, int) {
+            running.remove(proc);
+            if (gen != generation)
+                return;
+            auto list = parseFindings(QString::fromLocal8Bit(tool->readAll()), unit.workingDirectory);
+            // A killed analyzer says nothing about the file
+            if (tool->exitStatus() == QProcess::NormalExit)
+                storeCached(key, list);
+            apply(path, name, list);
+            dispatch();
+        }).onError([this, gen, proc](QProcess *tool, QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart)
+                return;
+            qDebug() << "can not run" << tool->program() << tool->errorString();
+            running.remove(proc);
+            if (gen == generation)
+                dispatch();
+        });
+        running.insert(proc);
+        // Shares the make job pool and is held while a build runs
+        JobServer::instance().startWithToken(proc, analyzer.program, analyzer.arguments(task.unit, unit.flags));
+    }
+
+    void apply(const QString& unit, const QString& analyzer, const FindingList& list) {
+        auto key = keyOf(unit, analyzer);
+        QSet<QString> touched;
+        for(const auto& f: findings.value(key))
+            touched.insert(f.file);
+        for(int row = model->rowCount() - 1; row >= 0; row--) {
+            if (model->item(row)->data(KEY_ROLE).toString() == key) {
+                model->removeRow(row);
+                findingCount--;
+            }
+        }
+        findings.insert(key, list);
+        auto base = QDir(proj->projectPath());
+        for(const auto& f: list) {
+            touched.insert(f.file);
+            auto location = QString("%1:%2:%3").arg(base.relativeFilePath(f.file))
+                    .arg(f.diagnostic.line).arg(f.diagnostic.column);
+            model->appendRow(makeRow(f, location, analyzer, key));
+            findingCount++;
+        }
+        for(const auto& path: touched)
+            emit q->resultsChanged(path);
+    }
+
+    void reset() {
+        generation++;
+        for(auto p: running) {
+            // Still waiting for a job token, dropping it takes it off the queue
+            if (p->state() == QProcess::NotRunning)
+                p->deleteLater();
+            else
+                p->stop();
+        }
+        running.clear();
+        queue.clear();
+        queued.clear();
+        idleTimer.stop();
+        auto files = QSet<QString>();
+        for(const auto& list: findings)
+            for(const auto& f: list)
+                files.insert(f.file);
+        findings.clear();
+        units.clear();
+        dependencies.clear();
+        digests.clear();
+        scanning.clear();
+        model->removeRows(0, model->rowCount());
+        findingCount = 0;
+        for(const auto& path: files)
+            emit q->resultsChanged(path);
+        emit q->pendingChanged(0);
+    }
+};
+
+StaticAnalyzer::StaticAnalyzer(QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({ tr("Message"), tr("Location"), tr("Analyzer") });
+    priv->analyzers = installedAnalyzers();
+    priv->idleTimer.setInterval(IDLE_DELAY_MS);
+    priv->idleTimer.setSingleShot(true);
+    connect(&priv->idleTimer, &QTimer::timeout, this, [this]() { priv->dispatch(); });
+    connect(&AppConfig::instance(), &AppConfig::configChanged, this, [this]() {
+        if (!priv->enabled())
+            clear();
+        else if (priv->units.isEmpty())
+            analyzeAll();
+    });
+}
+
+StaticAnalyzer::~StaticAnalyzer()
+{
+    delete priv;
+}
+
+StaticAnalyzer &StaticAnalyzer::instance()
+{
+    static StaticAnalyzer *singleton = nullptr;
+    if (!singleton)
+        singleton = new StaticAnalyzer(QCoreApplication::instance());
+    return *singleton;
+}
+
+void StaticAnalyzer::setProject(ProjectManager *proj)
+{
+    priv->proj = proj;
+    connect(proj, &ProjectManager::discoverFinished, this, [this](bool ok) {
+        if (ok)
+            analyzeAll();
+    });
+    connect(proj, &ProjectManager::projectClosed, this, &StaticAnalyzer::clear);
+    connect(proj->fileWatcher(), &ProjectFileWatcher::fileChanged, this, [this](const QString& path) {
+        if (priv->enabled())
+            priv->fileChanged(path);
+    });
+}
+
+QStringList StaticAnalyzer::analyzers() const
+{
+    QStringList names;
+    for(const auto& a: priv->analyzers)
+        names.append(a.name);
+    return names;
+}
+
+QStandardItemModel *StaticAnalyzer::model() const
+{
+    return priv->model;
+}
+
+int StaticAnalyzer::findingCount() const
+{
+    return priv->findingCount;
+}
+
+int StaticAnalyzer::pendingCount() const
+{
+    return priv->pending();
+}
+
+ICodeModelProvider::DiagnosticList StaticAnalyzer::diagnostics(const QString &path) const
+{
+    ICodeModelProvider::DiagnosticList list;
+    // Headers show up once per unit including them
+    QSet<QString> seen;
+    for(auto it = priv->findings.begin(); it != priv->findings.end(); ++it) {
+        auto analyzer = it.key().mid(it.key().lastIndexOf('|') + 1);
+        for(const auto& f: it.value()) {
+            if (f.file != path)
+                continue;
+            auto d = f.diagnostic;
+            d.message = QString("[%1] %2").arg(analyzer, d.message);
+            auto id = QString("%1:%2:%3").arg(d.line).arg(d.column).arg(d.message);
+            if (seen.contains(id))
+                continue;
+            seen.insert(id);
+            list.append(d);
+        }
+    }
+    return list;
+}
+
+void StaticAnalyzer::analyzeAll()
+{
+    if (!priv->enabled())
+        return;
+    priv->reset();
+    priv->learnUnits();
+}
+
+void StaticAnalyzer::clear()
+{
+    priv->reset();
+}
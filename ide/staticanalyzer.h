@@ -0,0 +1,67 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef STATICANALYZER_H
+#define STATICANALYZER_H
+
+#include "icodemodelprovider.h"
+
+#include <QObject>
+
+class QStandardItemModel;
+
+class ProjectManager;
+
+class StaticAnalyzer : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(StaticAnalyzer)
+public:
+    static constexpr auto FILE_ROLE = Qt::UserRole + 1;
+    static constexpr auto LINE_ROLE = Qt::UserRole + 2;
+    static constexpr auto COLUMN_ROLE = Qt::UserRole + 3;
+
+    static StaticAnalyzer &instance();
+    virtual ~StaticAnalyzer() override;
+
+    void setProject(ProjectManager *proj);
+    // Names of the analyzers found in PATH
+    QStringList analyzers() const;
+    QStandardItemModel *model() const;
+    int findingCount() const;
+    int pendingCount() const;
+    // Findings of every analyzed translation unit that point into path, as of its last save
+    ICodeModelProvider::DiagnosticList diagnostics(const QString& path) const;
+
+signals:
+    void resultsChanged(const QString& path);
+    void pendingChanged(int pending);
+
+public slots:
+    // Queues every translation unit, cached results make unchanged ones cheap
+    void analyzeAll();
+    void clear();
+
+private:
+    explicit StaticAnalyzer(QObject *parent = nullptr);
+
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // STATICANALYZER_H
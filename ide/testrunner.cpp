@@ -0,0 +1,683 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "childprocess.h"
+#include "jobserver.h"
+#include "projectmanager.h"
+#include "testrunner.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QRegularExpression>
+#include <QStandardItemModel>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QtConcurrent>
+
+#include <memory>
+
+#include <QtDebug>
+
+// Enough to see the assertion, the console keeps the rest
+static constexpr auto MAX_DETAIL_LINES = 20;
+static constexpr auto STATUS_ROLE = Qt::UserRole + 4;
+
+namespace {
+
+enum class Kind { MakeTarget, Executable, GoogleTest };
+enum class Status { Running, Passed, Failed, Skipped };
+
+struct TestInfo {
+    QString name;
+    Kind kind{ Kind::Executable };
+    QString program;
+};
+using TestInfoList = QList<TestInfo>;
+
+struct CaseResult {
+    QString name;
+    Status status{ Status::Passed };
+    qint64 timeMs{ -1 };
+    QString details;
+    QString file;
+    int line{ 0 };
+};
+using CaseResultList = QList<CaseResult>;
+
+const QRegularExpression TEST_NAME_RE{ R"((^|[^a-z])tests?([^a-z]|$)|^check$)",
+                                       QRegularExpression::CaseInsensitiveOption };
+const QRegularExpression GTEST_RUN_RE{ R"(^\[\s*RUN\s*\]\s+(\S+))" };
+const QRegularExpression GTEST_END_RE{ R"(^\[\s*(OK|FAILED|SKIPPED)\s*\]\s+(\S+)(?:\s+\((\d+) ms\))?)" };
+const QRegularExpression GTEST_FAILURE_RE{ R"(^(.+?):(\d+): Failure$)" };
+const QRegularExpression UNITY_RE{ R"(^(.+?):(\d+):(\w+):(PASS|FAIL|IGNORE)(?::\s*(.*))?$)" };
+// Numbered results only, a bare "ok" is too common in plain output
+const QRegularExpression TAP_RE{ R"(^(not ok|ok)\s+(\d+)(?:\s*-)?\s*([^#]*?)\s*(?:#\s*(\w+).*)?$)" };
+
+QString statusText(Status s)
+{
+    switch (s) {
+    case Status::Running: return TestRunner::tr("running");
+    case Status::Passed: return TestRunner::tr("passed");
+    case Status::Failed: return TestRunner::tr("failed");
+    case Status::Skipped: return TestRunner::tr("skipped");
+    }
+    return {};
+}
+
+QColor statusColor(Status s)
+{
+    switch (s) {
+    case Status::Running: return Qt::blue;
+    case Status::Passed: return Qt::darkGreen;
+    case Status::Failed: return Qt::red;
+    case Status::Skipped: return Qt::gray;
+    }
+    return {};
+}
+
+// Class, data encoding and machine, what the host must share to run a binary
+QByteArray elfSignature(const QByteArray& header)
+{
+    if (header.size() < 20 || !header.startsWith("\x7f" "ELF"))
+        return {};
+    return header.mid(4, 2) + header.mid(18, 2);
+}
+
+bool isExecutableElf(const QByteArray& header)
+{
+    auto littleEndian = header.at(5) == 1;
+    auto type = littleEndian? quint8(header.at(16)) | quint8(header.at(17)) << 8 :
+                              quint8(header.at(17)) | quint8(header.at(16)) << 8;
+    // ET_DYN covers PIE executables as well as shared libraries
+    return type == 2 || type == 3;
+}
+
+// Walks the tree itself, test binaries live in the build output the file watcher skips
+TestInfoList findTestExecutables(const QString& root, const QString& hostBinary)
+{
+    TestInfoList list;
+    QFile host(hostBinary);
+    if (!host.open(QFile::ReadOnly))
+        return list;
+    auto hostSignature = elfSignature(host.read(20));
+    if (hostSignature.isEmpty())
+        return list;
+    QDirIterator it(root, QDir::Files | QDir::Executable, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto path = it.next();
+        auto info = it.fileInfo();
+        if (!info.isExecutable() || info.fileName().contains(".so") ||
+                !TEST_NAME_RE.match(info.completeBaseName()).hasMatch())
+            continue;
+        QFile f(path);
+        if (!f.open(QFile::ReadOnly))
+            continue;
+        auto header = f.read(20);
+        // Cross compiled firmware images are named like tests too
+        if (elfSignature(header) != hostSignature || !isExecutableElf(header))
+            continue;
+        TestInfo t{ path, Kind::Executable, path };
+        auto data = f.map(0, f.size());
+        if (data && QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(f.size())).contains("gtest_list_tests"))
+            t.kind = Kind::GoogleTest;
+        list.append(t);
+    }
+    return list;
+}
+
+// Only reports tied to this test: the directory handed to it and files named after it
+QStringList reportFiles(const QString& reportDir, const QString& root, const TestInfo& info, const QDateTime& since)
+{
+    QFileInfo program(info.kind == Kind::MakeTarget? QDir(root).absoluteFilePath(info.name) : info.program);
+    auto base = program.completeBaseName();
+    QFileInfoList candidates;
+    if (!reportDir.isEmpty())
+        candidates = QDir(reportDir).entryInfoList({ "*.xml" }, QDir::Files);
+    candidates += program.absoluteDir().entryInfoList({ program.fileName() + ".xml", base + ".xml", "TEST-" + base + "*.xml" },
+                                                      QDir::Files);
+    QStringList files;
+    for(const auto& c: candidates)
+        if (c.lastModified() >= since && !files.contains(c.absoluteFilePath()))
+            files.append(c.absoluteFilePath());
+    return files;
+}
+
+CaseResultList readJUnitReports(const QStringList& files, const QString& root)
+{
+    CaseResultList list;
+    for(const auto& path: files) {
+        QFile f(path);
+        if (!f.open(QFile::ReadOnly))
+            continue;
+        QXmlStreamReader xml(&f);
+        auto inCase = false;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                auto a = xml.attributes();
+                if (xml.name() == QLatin1String("testcase")) {
+                    CaseResult r;
+                    auto className = a.value("classname").toString();
+                    r.name = className.isEmpty()? a.value("name").toString() :
+                                                  QString("%1.%2").arg(className, a.value("name").toString());
+                    if (a.hasAttribute("time"))
+                        r.timeMs = qint64(a.value("time").toDouble() * 1000);
+                    if (a.hasAttribute("file"))
+                        r.file = QDir(root).absoluteFilePath(a.value("file").toString());
+                    r.line = a.value("line").toInt();
+                    list.append(r);
+                    inCase = true;
+                } else if (inCase && (xml.name() == QLatin1String("failure") || xml.name() == QLatin1String("error"))) {
+                    auto message = a.value("message").toString();
+                    auto text = xml.readElementText(QXmlStreamReader::IncludeChildElements).trimmed();
+                    list.last().status = Status::Failed;
+                    list.last().details = message.isEmpty()? text : QString("%1\n%2").arg(message, text).trimmed();
+                } else if (inCase && xml.name() == QLatin1String("skipped")) {
+                    list.last().status = Status::Skipped;
+                    list.last().details = a.value("message").toString();
+                }
+            } else if (xml.isEndElement() && xml.name() == QLatin1String("testcase")) {
+                inCase = false;
+            }
+        }
+    }
+    return list;
+}
+
+}
+
+class TestRunner::Priv_t
+{
+public:
+    struct Test {
+        TestInfo info;
+        QStandardItem *item{ nullptr };
+        QHash<QString, QStandardItem*> cases;
+        int pendingShards{ 0 };
+        bool exitFailed{ false };
+        QDateTime started;
+        QElapsedTimer elapsed;
+        // Handed to the test as XML_OUTPUT_FILE and EIDE_TEST_REPORT_DIR
+        std::shared_ptr<QTemporaryDir> reports;
+    };
+
+    struct Shard {
+        QString test;
+        QByteArray partial;
+        QString currentCase;
+        QStringList output;
+        QString file;
+        int line{ 0 };
+    };
+
+    TestRunner *q{ nullptr };
+    ProjectManager *proj{ nullptr };
+    QStandardItemModel *model{ nullptr };
+    QFutureWatcher<TestInfoList> *scanWatcher{ nullptr };
+    QStringList order;
+    QHash<QString, Test> tests;
+    QHash<QProcess*, Shard> shards;
+    QElapsedTimer runTimer;
+    int activeTests{ 0 };
+    int generation{ 0 };
+
+    QString absolute(const QString& path) const {
+        return QDir::cleanPath(QDir(proj->projectPath()).absoluteFilePath(path));
+    }
+
+    void addTest(const TestInfo& info) {
+        if (tests.contains(info.name))
+            return;
+        auto nameItem = new QStandardItem(QDir(proj->projectPath()).relativeFilePath(info.name));
+        nameItem->setData(info.name, TEST_ROLE);
+        auto kind = info.kind == Kind::MakeTarget? TestRunner::tr("make target") :
+                    info.kind == Kind::GoogleTest? TestRunner::tr("GoogleTest executable") :
+                                                   TestRunner::tr("executable");
+        QList<QStandardItem*> row{ nameItem, new QStandardItem, new QStandardItem, new QStandardItem(kind) };
+        for(auto i: row)
+            i->setEditable(false);
+        model->appendRow(row);
+        Test t;
+        t.info = info;
+        t.item = nameItem;
+        tests.insert(info.name, t);
+        order.append(info.name);
+    }
+
+    void setCase(const QString& test, const CaseResult& r) {
+        auto& t = tests[test];
+        auto nameItem = t.cases.value(r.name);
+        if (!nameItem) {
+            nameItem = new QStandardItem(r.name);
+            QList<QStandardItem*> row{ nameItem, new QStandardItem, new QStandardItem, new QStandardItem };
+            for(auto i: row)
+                i->setEditable(false);
+            t.item->appendRow(row);
+            t.cases.insert(r.name, nameItem);
+        }
+        auto row = nameItem->row();
+        auto statusItem = t.item->child(row, 1);
+        statusItem->setText(statusText(r.status));
+        statusItem->setForeground(statusColor(r.status));
+        statusItem->setData(int(r.status), STATUS_ROLE);
+        t.item->child(row, 2)->setText(r.timeMs < 0? QString() : QString::number(r.timeMs));
+        auto detailsItem = t.item->child(row, 3);
+        detailsItem->setText(r.details.section('\n', 0, 0));
+        detailsItem->setToolTip(r.details);
+        for(int c = 0; c < 4; c++) {
+            auto item = t.item->child(row, c);
+            item->setData(r.file, FILE_ROLE);
+            item->setData(r.line, LINE_ROLE);
+        }
+    }
+
+    void parseLine(Shard& s, const QString& line) {
+        auto m = GTEST_RUN_RE.match(line);
+        if (m.hasMatch()) {
+            s.currentCase = m.captured(1);
+            s.output.clear();
+            s.file.clear();
+            s.line = 0;
+            setCase(s.test, { s.currentCase, Status::Running, -1, {}, {}, 0 });
+            return;
+        }
+        m = GTEST_END_RE.match(line);
+        // The summary lists failed cases again, only the one in progress counts
+        if (m.hasMatch() && m.captured(2) == s.currentCase) {
+            CaseResult r;
+            r.name = s.currentCase;
+            r.status = m.captured(1) == "OK"? Status::Passed : m.captured(1) == "FAILED"? Status::Failed : Status::Skipped;
+            r.timeMs = m.captured(3).isEmpty()? -1 : m.captured(3).toLongLong();
+            r.details = s.output.join('\n');
+            r.file = s.file;
+            r.line = s.line;
+            setCase(s.test, r);
+            s.currentCase.clear();
+            return;
+        }
+        if (!s.currentCase.isEmpty()) {
+            m = GTEST_FAILURE_RE.match(line);
+            if (m.hasMatch() && s.file.isEmpty()) {
+                s.file = absolute(m.captured(1));
+                s.line = m.captured(2).toInt();
+            }
+            if (s.output.size() < MAX_DETAIL_LINES)
+                s.output.append(line);
+            return;
+        }
+        m = UNITY_RE.match(line);
+        if (m.hasMatch()) {
+            CaseResult r;
+            r.name = m.captured(3);
+            r.status = m.captured(4) == "PASS"? Status::Passed : m.captured(4) == "FAIL"? Status::Failed : Status::Skipped;
+            r.details = m.captured(5);
+            r.file = absolute(m.captured(1));
+            r.line = m.captured(2).toInt();
+            setCase(s.test, r);
+            return;
+        }
+        m = TAP_RE.match(line);
+        if (m.hasMatch()) {
+            CaseResult r;
+            r.name = m.captured(3).isEmpty()? TestRunner::tr("test %1").arg(m.captured(2)) : m.captured(3);
+            auto directive = m.captured(4).toUpper();
+            if (directive == "SKIP" || directive == "TODO")
+                r.status = Status::Skipped;
+            else
+                r.status = m.captured(1) == "ok"? Status::Passed : Status::Failed;
+            setCase(s.test, r);
+        }
+    }
+
+    void feed(QProcess *proc, const QByteArray& data) {
+        auto it = shards.find(proc);
+        if (it == shards.end())
+            return;
+        auto& s = it.value();
+        s.partial.append(data);
+        int end;
+        while ((end = s.partial.indexOf('\n')) >= 0) {
+            auto line = QString::fromLocal8Bit(s.partial.left(end));
+            s.partial.remove(0, end + 1);
+            if (line.endsWith('\r'))
+                line.chop(1);
+            parseLine(s, line);
+        }
+    }
+
+    void spawn(const QString& test, const QString& program, const QStringList& args, const QHash<QString, QString>& env) {
+        auto& p = ChildProcess::create(q)
+                .setPriority(ChildProcess::Priority::Build)
+                .changeCWD(proj->projectPath())
+                .mergeStdOutAndErr()
+                .setenv(env)
+                .makeDeleteLater();
+        p.onReadyReadStdout([this](QProcess *out) {
+            feed(out, out->readAllStandardOutput());
+        }).onFinished([this](QProcess *done, int code) {
+            shardDone(done, done->exitStatus() == QProcess::NormalExit && code == 0);
+        }).onError([this](QProcess *failed, QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart)
+                return;
+            auto it = shards.find(failed);
+            if (it != shards.end())
+                setCase(it->test, { TestRunner::tr("(start)"), Status::Failed, -1, failed->errorString(), {}, 0 });
+            shardDone(failed, false);
+        });
+        shards.insert(&p, Shard{ test, {}, {}, {}, {}, 0 });
+        tests[test].pendingShards++;
+        JobServer::instance().startWithToken(&p, program, args);
+    }
+
+    // A fresh directory per run keeps reports of other tests and older runs out
+    QHash<QString, QString> reportEnvironment(Test& t) {
+        t.reports = std::make_shared<QTemporaryDir>();
+        if (!t.reports->isValid())
+            return {};
+        return {
+            { "XML_OUTPUT_FILE", t.reports->filePath("report.xml") },
+            { "EIDE_TEST_REPORT_DIR", t.reports->path() },
+        };
+    }
+
+    void startTest(const QString& name, const QStringList& onlyCases) {
+        auto it = tests.find(name);
+        if (it == tests.end() || it->pendingShards > 0)
+            return;
+        auto& t = it.value();
+        if (onlyCases.isEmpty()) {
+            t.item->removeRows(0, t.item->rowCount());
+            t.cases.clear();
+        } else {
+            for(const auto& c: onlyCases)
+                setCase(name, { c, Status::Running, -1, {}, {}, 0 });
+        }
+        t.exitFailed = false;
+        t.started = QDateTime::currentDateTime();
+        t.elapsed.start();
+        auto statusItem = model->item(t.item->row(), 1);
+        statusItem->setText(statusText(Status::Running));
+        statusItem->setForeground(statusColor(Status::Running));
+        if (activeTests++ == 0) {
+            runTimer.start();
+            emit q->started();
+        }
+
+        switch (t.info.kind) {
+        case Kind::GoogleTest: {
+            QStringList args{ "--gtest_color=no" };
+            if (!onlyCases.isEmpty()) {
+                spawn(name, t.info.program, args << QString("--gtest_filter=%1").arg(onlyCases.join(':')), {});
+                break;
+            }
+            // GoogleTest splits the cases itself, one shard per job slot
+            auto n = qMax(1, JobServer::instance().jobs());
+            for(int i = 0; i < n; i++)
+                spawn(name, t.info.program, args, {
+                          { "GTEST_TOTAL_SHARDS", QString::number(n) },
+                          { "GTEST_SHARD_INDEX", QString::number(i) },
+                      });
+            break;
+        }
+        case Kind::MakeTarget: {
+            auto env = JobServer::instance().makeEnvironment();
+            env.unite(reportEnvironment(t));
+            spawn(name, "make", { "-f", proj->projectFile(), name }, env);
+            break;
+        }
+        case Kind::Executable:
+            spawn(name, t.info.program, {}, reportEnvironment(t));
+            break;
+        }
+    }
+
+    void shardDone(QProcess *proc, bool ok) {
+        auto it = shards.find(proc);
+        if (it == shards.end())
+            return;
+        auto s = it.value();
+        shards.erase(it);
+        if (!s.partial.isEmpty())
+            parseLine(s, QString::fromLocal8Bit(s.partial).trimmed());
+        if (!s.currentCase.isEmpty()) {
+            s.output.prepend(TestRunner::tr("Ended before reporting a result"));
+            setCase(s.test, { s.currentCase, Status::Failed, -1, s.output.join('\n'), s.file, s.line });
+        }
+        auto& t = tests[s.test];
+        if (!ok)
+            t.exitFailed = true;
+        if (t.pendingShards > 1) {
+            t.pendingShards--;
+            return;
+        }
+        if (t.info.kind == Kind::GoogleTest) {
+            testDone(s.test);
+            return;
+        }
+        // Unity and other runners may only leave a JUnit report behind
+        auto watcher = new QFutureWatcher<CaseResultList>(q);
+        auto gen = generation;
+        auto name = s.test;
+        auto reports = t.reports;
+        QObject::connect(watcher, &QFutureWatcher<CaseResultList>::finished, q, [this, watcher, gen, name, reports]() {
+            watcher->deleteLater();
+            if (gen != generation)
+                return;
+            for(const auto& r: watcher->result())
+                setCase(name, r);
+            if (tests[name].reports == reports)
+                tests[name].reports.reset();
+            testDone(name);
+        });
+        auto root = proj->projectPath();
+        auto reportDir = reports && reports->isValid()? reports->path() : QString();
+        auto info = t.info;
+        // Report timestamps may be truncated to seconds
+        auto since = t.started.addSecs(-1);
+        watcher->setFuture(QtConcurrent::run([reportDir, root, info, since]() {
+            return readJUnitReports(reportFiles(reportDir, root, info, since), root);
+        }));
+    }
+
+    void testDone(const QString& name) {
+        auto& t = tests[name];
+        t.pendingShards = 0;
+        int passed = 0, failed = 0, skipped = 0;
+        for(auto c: t.cases) {
+            auto statusItem = t.item->child(c->row(), 1);
+            auto status = Status(statusItem->data(STATUS_ROLE).toInt());
+            if (status == Status::Running) {
+                status = Status::Failed;
+                setCase(name, { c->text(), status, -1, TestRunner::tr("No result reported"), {}, 0 });
+            }
+            switch (status) {
+            case Status::Passed: passed++; break;
+            case Status::Failed: failed++; break;
+            case Status::Skipped: skipped++; break;
+            case Status::Running: break;
+            }
+        }
+        auto bad = failed > 0 || t.exitFailed;
+        auto text = statusText(bad? Status::Failed : Status::Passed);
+        if (!t.cases.isEmpty())
+            text = TestRunner::tr("%1 (%2 passed, %3 failed, %4 skipped)").arg(text).arg(passed).arg(failed).arg(skipped);
+        auto row = t.item->row();
+        model->item(row, 1)->setText(text);
+        model->item(row, 1)->setForeground(statusColor(bad? Status::Failed : Status::Passed));
+        model->item(row, 2)->setText(QString::number(t.elapsed.elapsed()));
+        emit q->resultsChanged();
+        if (--activeTests > 0)
+            return;
+        int allPassed = 0, allFailed = 0, allSkipped = 0;
+        for(const auto& test: tests)
+            countOf(test, &allPassed, &allFailed, &allSkipped);
+        emit q->finished(allPassed, allFailed, allSkipped, runTimer.elapsed());
+    }
+
+    void countOf(const Test& t, int *passed, int *failed, int *skipped) const {
+        auto failedCases = 0;
+        for(auto c: t.cases) {
+            switch (Status(t.item->child(c->row(), 1)->data(STATUS_ROLE).toInt())) {
+            case Status::Passed: (*passed)++; break;
+            case Status::Failed: failedCases++; break;
+            case Status::Skipped: (*skipped)++; break;
+            case Status::Running: break;
+            }
+        }
+        *failed += failedCases == 0 && t.exitFailed? 1 : failedCases;
+    }
+
+    QStringList failedCases(const Test& t) const {
+        QStringList list;
+        for(auto c: t.cases)
+            if (Status(t.item->child(c->row(), 1)->data(STATUS_ROLE).toInt()) == Status::Failed)
+                list.append(c->text());
+        return list;
+    }
+};
+
+TestRunner::TestRunner(ProjectManager *proj, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->q = this;
+    priv->proj = proj;
+    priv->model = new QStandardItemModel(this);
+    priv->model->setHorizontalHeaderLabels({ tr("Test"), tr("Result"), tr("Time (ms)"), tr("Details") });
+    priv->scanWatcher = new QFutureWatcher<TestInfoList>(this);
+    connect(priv->scanWatcher, &QFutureWatcher<TestInfoList>::finished, this, [this]() {
+        if (isRunning() || !priv->proj->isProjectOpen())
+            return;
+        clear();
+        for(const auto& t: priv->proj->targets())
+            if (TEST_NAME_RE.match(t).hasMatch())
+                priv->addTest(TestInfo{ t, Kind::MakeTarget, {} });
+        for(const auto& t: priv->scanWatcher->result())
+            priv->addTest(t);
+        emit discovered(priv->order.size());
+        emit resultsChanged();
+    });
+    connect(proj, &ProjectManager::discoverFinished, this, &TestRunner::discover);
+    connect(proj, &ProjectManager::projectClosed, this, [this]() {
+        stop();
+        clear();
+    });
+}
+
+TestRunner::~TestRunner()
+{
+    priv->scanWatcher->waitForFinished();
+    delete priv;
+}
+
+QStandardItemModel *TestRunner::model() const
+{
+    return priv->model;
+}
+
+QStringList TestRunner::tests() const
+{
+    return priv->order;
+}
+
+bool TestRunner::isRunning() const
+{
+    return priv->activeTests > 0;
+}
+
+int TestRunner::failedCount() const
+{
+    int passed = 0, failed = 0, skipped = 0;
+    for(const auto& t: priv->tests)
+        priv->countOf(t, &passed, &failed, &skipped);
+    return failed;
+}
+
+QString TestRunner::testOf(const QModelIndex &index) const
+{
+    auto first = index.sibling(index.row(), 0);
+    return first.parent().isValid()? first.parent().data(TEST_ROLE).toString() : first.data(TEST_ROLE).toString();
+}
+
+void TestRunner::discover()
+{
+    if (priv->scanWatcher->isRunning() || !priv->proj->isProjectOpen())
+        return;
+    // Reading binaries is slow on big trees, keep it off the GUI thread
+    priv->scanWatcher->setFuture(QtConcurrent::run(findTestExecutables, priv->proj->projectPath(),
+                                                   QCoreApplication::applicationFilePath()));
+}
+
+void TestRunner::runAll()
+{
+    for(const auto& name: priv->order)
+        priv->startTest(name, {});
+}
+
+void TestRunner::run(const QString &test)
+{
+    priv->startTest(test, {});
+}
+
+void TestRunner::runFailed()
+{
+    for(const auto& name: priv->order) {
+        const auto& t = priv->tests[name];
+        auto cases = priv->failedCases(t);
+        if (!cases.isEmpty())
+            priv->startTest(name, t.info.kind == Kind::GoogleTest? cases : QStringList());
+        else if (t.exitFailed)
+            priv->startTest(name, {});
+    }
+}
+
+void TestRunner::stop()
+{
+    const auto procs = priv->shards.keys();
+    for(auto p: procs) {
+        auto child = qobject_cast<ChildProcess*>(p);
+        if (p->state() != QProcess::NotRunning) {
+            if (child)
+                child->stop();
+            else
+                p->kill();
+            continue;
+        }
+        // Still waiting for a job token, dropping it takes it off the queue
+        priv->shardDone(p, false);
+        p->deleteLater();
+    }
+}
+
+void TestRunner::clear()
+{
+    priv->generation++;
+    priv->shards.clear();
+    priv->tests.clear();
+    priv->order.clear();
+    priv->activeTests = 0;
+    priv->model->removeRows(0, priv->model->rowCount());
+    emit resultsChanged();
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TESTRUNNER_H
+#define TESTRUNNER_H
+
+#include <QObject>
+
+class QModelIndex;
+class QStandardItemModel;
+
+class ProjectManager;
+
+class TestRunner : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TestRunner)
+public:
+    static constexpr auto FILE_ROLE = Qt::UserRole + 1;
+    static constexpr auto LINE_ROLE = Qt::UserRole + 2;
+    static constexpr auto TEST_ROLE = Qt::UserRole + 3;
+
+    explicit TestRunner(ProjectManager *proj, QObject *parent = nullptr);
+    virtual ~TestRunner() override;
+
+    QStandardItemModel *model() const;
+    QStringList tests() const;
+    bool isRunning() const;
+    // Failed cases plus tests that failed without reporting any case
+    int failedCount() const;
+    // Test owning a row of the model, case rows give their parent
+    QString testOf(const QModelIndex& index) const;
+
+signals:
+    void discovered(int count);
+    void started();
+    void finished(int passed, int failed, int skipped, qint64 elapsedMs);
+    void resultsChanged();
+
+public slots:
+    // Make targets named like tests plus host executables in the project tree
+    void discover();
+    void runAll();
+    void run(const QString& test);
+    // GoogleTest binaries rerun only the failed cases, anything else reruns whole
+    void runFailed();
+    void stop();
+    void clear();
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // TESTRUNNER_H
@@ -26,6 +26,7 @@ constexpr auto STDERR_LOG = "stderrLog";
 constexpr auto STDOUT_LOG = "stdoutLog";
 constexpr auto ACTION_LABEL = "actionLabel";
 constexpr auto DEBUG_IP_CHANGE = "debug_ip_change";
+constexpr auto SYMBOL_INDEX_UPDATED = "symbolIndexUpdated";
 };
 
 class TextMessageBrocker : public QObject
@@ -49,6 +50,17 @@ public:
         return *this;
     }
 
+    template<typename Function>
+    TextMessageBrocker& subscribe(QObject *context, const QString& topic, Function func) {
+        connect(this, &TextMessageBrocker::published, context,
+                [topic, func](const QString& t, const QString& msg)
+        {
+            if (topic == t)
+                func(msg);
+        });
+        return *this;
+    }
+
     template<typename Class, typename Function>
     TextMessageBrocker& subscribe(const QString& topic, Class obj, Function func) {
         connect(this, &TextMessageBrocker::published,
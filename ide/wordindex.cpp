@@ -0,0 +1,247 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "projectfilewatcher.h"
+#include "wordindex.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QMimeDatabase>
+#include <QSet>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <QtDebug>
+
+#include <algorithm>
+
+static constexpr auto MAX_INDEXED_FILE_SIZE = 512 * 1024;
+static constexpr auto BINARY_PROBE_SIZE = 4096;
+static constexpr auto MIN_WORD_LENGTH = 3;
+static constexpr auto MAX_WORD_LENGTH = 64;
+static constexpr auto UPDATE_DELAY_MS = 300;
+
+static constexpr auto SAME_FILE_WEIGHT = 16;
+static constexpr auto SAME_DIR_WEIGHT = 4;
+
+using wordCount_t = QHash<QString, int>;
+using fileWords_t = QHash<QString, wordCount_t>;
+
+static bool isWordStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isWordChar(char c)
+{
+    return isWordStart(c) || (c >= '0' && c <= '9');
+}
+
+static wordCount_t scanWords(const QString& path)
+{
+    wordCount_t words;
+    QFileInfo info(path);
+    if (!info.isFile() || info.size() > MAX_INDEXED_FILE_SIZE)
+        return words;
+    if (!QMimeDatabase().mimeTypeForFile(info).inherits("text/plain"))
+        return words;
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return words;
+    auto data = f.readAll();
+    if (data.left(BINARY_PROBE_SIZE).contains('\0'))
+        return words;
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    while (p < end) {
+        if (isWordStart(*p) && (p == data.constData() || !isWordChar(p[-1]))) {
+            const char *start = p;
+            while (p < end && isWordChar(*p))
+                p++;
+            auto len = int(p - start);
+            if (len >= MIN_WORD_LENGTH && len <= MAX_WORD_LENGTH)
+                words[QString::fromLatin1(start, len)]++;
+        } else
+            p++;
+    }
+    return words;
+}
+
+static fileWords_t scanFiles(const QStringList& paths)
+{
+    fileWords_t result;
+    for(const auto& path: paths)
+        result.insert(path, scanWords(path));
+    return result;
+}
+
+class WordIndex::Priv_t
+{
+public:
+    fileWords_t fileWords;
+    QHash<QString, wordCount_t> dirWords;
+    QMap<QString, int> totals;
+    QSet<QString> pending;
+    QTimer updateTimer;
+    QFutureWatcher<fileWords_t> *scanWatcher{ nullptr };
+    int generation{ 0 };
+    int scanGeneration{ 0 };
+
+    static void add(wordCount_t& to, const wordCount_t& from, int sign) {
+        for(auto it = from.cbegin(); it != from.cend(); ++it) {
+            auto& n = to[it.key()];
+            n += sign * it.value();
+            if (n <= 0)
+                to.remove(it.key());
+        }
+    }
+
+    void account(const QString& path, const wordCount_t& words, int sign) {
+        auto dir = QFileInfo(path).absolutePath();
+        add(dirWords[dir], words, sign);
+        if (dirWords[dir].isEmpty())
+            dirWords.remove(dir);
+        for(auto it = words.cbegin(); it != words.cend(); ++it) {
+            auto& n = totals[it.key()];
+            n += sign * it.value();
+            if (n <= 0)
+                totals.remove(it.key());
+        }
+    }
+
+    void drop(const QString& path) {
+        auto it = fileWords.find(path);
+        if (it != fileWords.end()) {
+            account(path, *it, -1);
+            fileWords.erase(it);
+        }
+    }
+
+    void merge(const fileWords_t& result) {
+        for(auto it = result.cbegin(); it != result.cend(); ++it) {
+            drop(it.key());
+            if (!it.value().isEmpty()) {
+                fileWords.insert(it.key(), it.value());
+                account(it.key(), it.value(), +1);
+            }
+        }
+    }
+
+    void startScan() {
+        if (pending.isEmpty() || scanWatcher->isRunning())
+            return;
+        auto paths = pending.values();
+        pending.clear();
+        scanGeneration = generation;
+        scanWatcher->setFuture(QtConcurrent::run(scanFiles, paths));
+    }
+};
+
+WordIndex::WordIndex(ProjectFileWatcher *watcher, QObject *parent) :
+    QObject(parent),
+    priv(new Priv_t)
+{
+    priv->scanWatcher = new QFutureWatcher<fileWords_t>(this);
+    priv->updateTimer.setInterval(UPDATE_DELAY_MS);
+    priv->updateTimer.setSingleShot(true);
+    connect(&priv->updateTimer, &QTimer::timeout, [this]() { priv->startScan(); });
+    connect(priv->scanWatcher, &QFutureWatcher<fileWords_t>::finished, [this]() {
+        if (priv->scanGeneration == priv->generation) {
+            priv->merge(priv->scanWatcher->result());
+            emit indexUpdated();
+        }
+        priv->startScan();
+    });
+
+    if (watcher) {
+        connect(watcher, &ProjectFileWatcher::scanFinished, [this](const QStringList& files) {
+            clear();
+            updateFiles(files);
+        });
+        connect(watcher, &ProjectFileWatcher::fileChanged, [this](const QString& path) { updateFiles({ path }); });
+        connect(watcher, &ProjectFileWatcher::fileRemoved, this, &WordIndex::removeFile);
+    }
+}
+
+WordIndex::~WordIndex()
+{
+    priv->scanWatcher->waitForFinished();
+    delete priv;
+}
+
+QStringList WordIndex::completions(const QString &prefix, const QString &nearPath, int limit) const
+{
+    struct Candidate { QString word; int score; };
+    QVector<Candidate> candidates;
+    const auto& sameFile = priv->fileWords.value(nearPath);
+    const auto& sameDir = priv->dirWords.value(QFileInfo(nearPath).absolutePath());
+    for(auto it = priv->totals.lowerBound(prefix); it != priv->totals.cend() && it.key().startsWith(prefix); ++it) {
+        if (it.key() == prefix)
+            continue;
+        auto score = it.value() +
+                SAME_DIR_WEIGHT * sameDir.value(it.key()) +
+                SAME_FILE_WEIGHT * sameFile.value(it.key());
+        candidates.append({ it.key(), score });
+    }
+    auto byScore = [](const Candidate& a, const Candidate& b) {
+        return a.score != b.score? a.score > b.score : a.word < b.word;
+    };
+    auto count = std::min(candidates.size(), limit);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), byScore);
+    QStringList list;
+    list.reserve(count);
+    for(int i = 0; i < count; i++)
+        list.append(candidates.at(i).word);
+    return list;
+}
+
+int WordIndex::fileCount() const
+{
+    return priv->fileWords.size();
+}
+
+int WordIndex::wordCount() const
+{
+    return priv->totals.size();
+}
+
+void WordIndex::clear()
+{
+    priv->generation++;
+    priv->pending.clear();
+    priv->updateTimer.stop();
+    priv->fileWords.clear();
+    priv->dirWords.clear();
+    priv->totals.clear();
+    emit indexUpdated();
+}
+
+void WordIndex::updateFiles(const QStringList &paths)
+{
+    for(const auto& p: paths)
+        priv->pending.insert(p);
+    priv->updateTimer.start();
+}
+
+void WordIndex::removeFile(const QString &path)
+{
+    priv->pending.remove(path);
+    priv->drop(path);
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef WORDINDEX_H
+#define WORDINDEX_H
+
+#include <QObject>
+
+class ProjectFileWatcher;
+
+class WordIndex : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(WordIndex)
+public:
+    static constexpr auto DEFAULT_COMPLETION_LIMIT = 200;
+
+    explicit WordIndex(ProjectFileWatcher *watcher, QObject *parent = nullptr);
+    virtual ~WordIndex() override;
+
+    QStringList completions(const QString& prefix, const QString& nearPath, int limit = DEFAULT_COMPLETION_LIMIT) const;
+    int fileCount() const;
+    int wordCount() const;
+
+signals:
+    void indexUpdated();
+
+public slots:
+    void clear();
+    void updateFiles(const QStringList& paths);
+    void removeFile(const QString& path);
+
+private:
+    class Priv_t;
+    Priv_t *priv;
+};
+
+#endif // WORDINDEX_H